@@ -0,0 +1,145 @@
+#include "AssetManager.h"
+
+#include <iomanip>
+#include <iostream>
+
+#include "DataTypes.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "Texture.h"
+
+namespace dae
+{
+	std::shared_ptr<const Texture> AssetManager::LoadTexture(const std::string& path)
+	{
+		return Load<Texture>(m_Textures, path, [&path]()
+		{
+			std::shared_ptr<const Texture> pTexture{ Texture::LoadFromFile(path) };
+			return std::pair{ pTexture, pTexture ? pTexture->GetMemorySize() : size_t{} };
+		});
+	}
+
+	std::shared_ptr<const Mesh> AssetManager::LoadMesh(const std::string& path)
+	{
+		return Load<Mesh>(m_Meshes, path, [&path]()
+		{
+			IndexedMesh mesh{};
+			if (!LoadOBJ(path, mesh)) return std::pair{ std::shared_ptr<const Mesh>{}, size_t{} };
+
+			std::shared_ptr<const Mesh> pMesh{ std::make_shared<const Mesh>(CreateMesh(std::move(mesh))) };
+			return std::pair{ pMesh, pMesh->GetMemorySize() };
+		});
+	}
+
+	template<typename TAsset, typename TLoad>
+	std::shared_ptr<const TAsset> AssetManager::Load(AssetTable& table, const std::string& path, const TLoad& load)
+	{
+		const auto findResident = [&table](const auto& map, const auto& key)
+		{
+			const auto it{ map.find(key) };
+			return it == map.end() ? std::shared_ptr<const TAsset>{} : std::static_pointer_cast<const TAsset>(table.entries[it->second].pAsset.lock());
+		};
+		//Without the lock, the thread that loads it needs the lock to finish
+		const auto waitFor = [](std::unique_lock<std::mutex>& lock, PendingAsset pendingAsset)
+		{
+			lock.unlock();
+			std::shared_ptr<const TAsset> pAsset{ std::static_pointer_cast<const TAsset>(pendingAsset.get()) };
+			lock.lock();
+			return pAsset;
+		};
+
+		std::unique_lock lock{ m_Mutex };
+		if (std::shared_ptr<const TAsset> pAsset{ findResident(table.pathEntries, path) }) return pAsset;
+
+		const auto pendingPathIt{ table.pendingPaths.find(path) };
+		if (pendingPathIt != table.pendingPaths.end()) return waitFor(lock, pendingPathIt->second);
+
+		//From here on this thread is the one that loads the path, every way out hands the result to the threads that wait for it
+		std::promise<std::shared_ptr<const void>> promise{};
+		const PendingAsset pendingAsset{ promise.get_future().share() };
+		table.pendingPaths.emplace(path, pendingAsset);
+
+		uint64_t contentHash{};
+		bool isHashPending{};
+		const auto finish = [&](const std::shared_ptr<const TAsset>& pAsset)
+		{
+			table.pendingPaths.erase(path);
+			if (isHashPending) table.pendingHashes.erase(contentHash);
+			promise.set_value(pAsset);
+			return pAsset;
+		};
+
+		//A new path can still hold the bytes of an asset that is already resident or being loaded
+		lock.unlock();
+		bool isOpen{};
+		{
+			const MappedFile file{ path };
+			isOpen = file.IsOpen();
+			if (isOpen) contentHash = HashBytes(file.GetView());
+		}
+		lock.lock();
+
+		if (!isOpen) return finish(nullptr);
+		if (std::shared_ptr<const TAsset> pAsset{ findResident(table.hashEntries, contentHash) })
+		{
+			table.pathEntries[path] = table.hashEntries[contentHash];
+			return finish(pAsset);
+		}
+
+		const auto pendingHashIt{ table.pendingHashes.find(contentHash) };
+		if (pendingHashIt != table.pendingHashes.end())
+		{
+			std::shared_ptr<const TAsset> pAsset{ waitFor(lock, pendingHashIt->second) };
+			if (pAsset) table.pathEntries[path] = table.hashEntries[contentHash];
+			return finish(pAsset);
+		}
+		table.pendingHashes.emplace(contentHash, pendingAsset);
+		isHashPending = true;
+
+		//Outside of the lock, so different assets load in parallel
+		lock.unlock();
+		auto [pAsset, bytes] { load() };
+		lock.lock();
+
+		if (pAsset)
+		{
+			//The entry of an earlier copy of the same bytes is reused, so freeing and loading an asset again does not grow the table
+			const auto hashIt{ table.hashEntries.find(contentHash) };
+			const uint32_t entryIdx{ hashIt == table.hashEntries.end() ? static_cast<uint32_t>(table.entries.size()) : hashIt->second };
+			if (entryIdx == table.entries.size()) table.entries.emplace_back();
+
+			table.entries[entryIdx] = { path, bytes, pAsset };
+			table.pathEntries[path] = entryIdx;
+			table.hashEntries[contentHash] = entryIdx;
+		}
+		return finish(pAsset);
+	}
+
+	std::vector<AssetMemory> AssetManager::GetResidentAssets() const
+	{
+		const std::lock_guard lock{ m_Mutex };
+		std::vector<AssetMemory> assets{};
+		for (const AssetTable* pTable : { &m_Textures, &m_Meshes })
+		{
+			for (const Entry& entry : pTable->entries)
+			{
+				const long handleCount{ entry.pAsset.use_count() };
+				if (handleCount > 0) assets.push_back({ entry.path, entry.bytes, handleCount });
+			}
+		}
+		return assets;
+	}
+
+	void AssetManager::PrintResidentAssets() const
+	{
+		size_t totalBytes{};
+		const std::vector<AssetMemory> assets{ GetResidentAssets() };
+		for (const AssetMemory& asset : assets)
+		{
+			std::cerr << "  " << std::fixed << std::setprecision(2) << std::setw(8) << static_cast<double>(asset.bytes) / (1024.0 * 1024.0) << " MiB  "
+				<< asset.handleCount << (asset.handleCount == 1 ? " handle   " : " handles  ") << asset.path << "\n";
+			totalBytes += asset.bytes;
+		}
+		std::cerr << assets.size() << " resident assets use " << static_cast<double>(totalBytes) / (1024.0 * 1024.0) << " MiB" << std::defaultfloat << std::endl;
+	}
+}
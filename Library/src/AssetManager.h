@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dae
+{
+	class Texture;
+	struct Mesh;
+
+	//Resident size of an asset the manager loaded
+	struct AssetMemory
+	{
+		std::string path{};
+		size_t bytes{};
+		//Handles to the asset outside of the manager
+		long handleCount{};
+	};
+
+	//Loads every texture and mesh once and hands out shared handles to it
+	//Assets are keyed by path and by a hash of the file, so two paths to the same bytes share one asset as well
+	//The manager only holds weak references, an asset is freed with its last handle and loaded again when it is asked for after that
+	//Safe to call from several threads, a thread that asks for an asset that another thread is loading waits for that load
+	class AssetManager final
+	{
+	public:
+		//Null when the file can not be read or decoded
+		std::shared_ptr<const Texture> LoadTexture(const std::string& path);
+		//Through LoadOBJ, so from the mesh cache when it is up to date
+		std::shared_ptr<const Mesh> LoadMesh(const std::string& path);
+
+		//The assets that still have handles, in the order they were first loaded
+		std::vector<AssetMemory> GetResidentAssets() const;
+		//To std::cerr, so the output of the benchmark on std::cout stays clean
+		void PrintResidentAssets() const;
+
+	private:
+		struct Entry
+		{
+			std::string path{};
+			size_t bytes{};
+			std::weak_ptr<const void> pAsset{};
+		};
+
+		//Null when the load failed
+		using PendingAsset = std::shared_future<std::shared_ptr<const void>>;
+
+		//Textures and meshes are kept apart, a path or hash only refers to an asset of its own kind
+		struct AssetTable
+		{
+			std::vector<Entry> entries{};
+			std::unordered_map<std::string, uint32_t> pathEntries{};
+			std::unordered_map<uint64_t, uint32_t> hashEntries{};
+
+			//Loads that are running on some thread, by path and once the file is hashed by hash as well
+			std::unordered_map<std::string, PendingAsset> pendingPaths{};
+			std::unordered_map<uint64_t, PendingAsset> pendingHashes{};
+		};
+
+		//Looks the asset up by path, then by the hash of the file, and only calls load when neither is resident or pending
+		//load returns the asset and its size in bytes
+		template<typename TAsset, typename TLoad>
+		std::shared_ptr<const TAsset> Load(AssetTable& table, const std::string& path, const TLoad& load);
+
+		mutable std::mutex m_Mutex{};
+		AssetTable m_Textures{};
+		AssetTable m_Meshes{};
+	};
+}
@@ -0,0 +1,104 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace dae
+{
+	namespace
+	{
+		double RunIterations(const BenchmarkCase& benchmarkCase, uint64_t iterations, uint64_t& itemsPerIteration)
+		{
+			using Clock = std::chrono::steady_clock;
+
+			BenchmarkState state{ iterations };
+			const Clock::time_point start{ Clock::now() };
+			benchmarkCase.function(state);
+			const double seconds{ std::chrono::duration<double>(Clock::now() - start).count() };
+
+			itemsPerIteration = state.GetItemsPerIteration();
+			return seconds;
+		}
+
+		//Grows the iteration count until a run takes minSeconds, at most 10 times per step
+		uint64_t FindIterationCount(const BenchmarkCase& benchmarkCase, double minSeconds)
+		{
+			uint64_t iterations{ 1 };
+			while (true)
+			{
+				uint64_t itemsPerIteration{};
+				const double seconds{ RunIterations(benchmarkCase, iterations, itemsPerIteration) };
+				if (seconds >= minSeconds) return iterations;
+
+				const double growth{ seconds > 0.0 ? std::min(minSeconds * 1.4 / seconds, 10.0) : 10.0 };
+				iterations = std::max(iterations + 1, static_cast<uint64_t>(static_cast<double>(iterations) * growth));
+			}
+		}
+	}
+
+	void UseCharPointer(const volatile char*)
+	{
+	}
+
+	std::vector<BenchmarkResult> RunBenchmarks(const std::vector<BenchmarkCase>& cases, const BenchmarkSettings& settings)
+	{
+		std::vector<BenchmarkResult> results{};
+
+		std::cout << std::left << std::setw(40) << "Benchmark" << std::right
+			<< std::setw(14) << "Min ns" << std::setw(14) << "Median ns" << std::setw(14) << "Max ns"
+			<< std::setw(14) << "Iterations" << std::setw(16) << "Items/s" << '\n';
+
+		for (const BenchmarkCase& benchmarkCase : cases)
+		{
+			if (!settings.filter.empty() && benchmarkCase.name.find(settings.filter) == std::string::npos) continue;
+
+			BenchmarkResult result{};
+			result.name = benchmarkCase.name;
+			result.iterations = FindIterationCount(benchmarkCase, settings.minSeconds);
+
+			std::vector<double> nanoseconds{};
+			uint64_t itemsPerIteration{};
+			for (int repetition{}; repetition < std::max(settings.repetitions, 1); ++repetition)
+			{
+				const double seconds{ RunIterations(benchmarkCase, result.iterations, itemsPerIteration) };
+				nanoseconds.push_back(seconds * 1e9 / static_cast<double>(result.iterations));
+			}
+
+			std::ranges::sort(nanoseconds);
+			result.minNanoseconds = nanoseconds.front();
+			result.medianNanoseconds = nanoseconds[nanoseconds.size() / 2];
+			result.maxNanoseconds = nanoseconds.back();
+			result.itemsPerSecond = static_cast<double>(itemsPerIteration) * 1e9 / result.minNanoseconds;
+
+			std::cout << std::left << std::setw(40) << result.name << std::right << std::fixed << std::setprecision(1)
+				<< std::setw(14) << result.minNanoseconds << std::setw(14) << result.medianNanoseconds << std::setw(14) << result.maxNanoseconds
+				<< std::setw(14) << result.iterations << std::setw(16) << std::setprecision(0) << result.itemsPerSecond << std::endl;
+
+			results.push_back(result);
+		}
+
+		return results;
+	}
+
+	bool WriteBenchmarkReport(const std::vector<BenchmarkResult>& results, const std::string& path)
+	{
+		std::ofstream file{ path };
+		file << std::fixed << std::setprecision(3) << "{\n  \"benchmarks\": [\n";
+		for (size_t resultIdx{}; resultIdx < results.size(); ++resultIdx)
+		{
+			const BenchmarkResult& result{ results[resultIdx] };
+			file << "    { \"name\": \"" << result.name << "\""
+				<< ", \"iterations\": " << result.iterations
+				<< ", \"minNs\": " << result.minNanoseconds
+				<< ", \"medianNs\": " << result.medianNanoseconds
+				<< ", \"maxNs\": " << result.maxNanoseconds
+				<< ", \"itemsPerSecond\": " << result.itemsPerSecond << " }"
+				<< (resultIdx + 1 < results.size() ? ",\n" : "\n");
+		}
+		file << "  ]\n}\n";
+		return static_cast<bool>(file);
+	}
+}
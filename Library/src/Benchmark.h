@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace dae
+{
+	//Minimal microbenchmark harness in the spirit of Google Benchmark, without the dependency
+	//A case runs its kernel in a while (state.KeepRunning()) loop, the harness picks the iteration count
+	class BenchmarkState final
+	{
+	public:
+		explicit BenchmarkState(uint64_t iterations) :
+			m_IterationsLeft{ iterations },
+			m_Iterations{ iterations }
+		{}
+
+		bool KeepRunning() { return m_IterationsLeft-- > 0; }
+		uint64_t GetIterations() const { return m_Iterations; }
+
+		//Work done by one iteration, e.g. pixels or vertices, reported as items per second
+		void SetItemsPerIteration(uint64_t items) { m_ItemsPerIteration = items; }
+		uint64_t GetItemsPerIteration() const { return m_ItemsPerIteration; }
+
+	private:
+		uint64_t m_IterationsLeft{};
+		uint64_t m_Iterations{};
+		uint64_t m_ItemsPerIteration{};
+	};
+
+	struct BenchmarkCase
+	{
+		std::string name{};
+		std::function<void(BenchmarkState& state)> function{};
+	};
+
+	struct BenchmarkSettings
+	{
+		//Only cases with this text in their name run, all of them when empty
+		std::string filter{};
+		//Every repetition runs at least this long
+		double minSeconds{ 0.2 };
+		//The fastest repetition is reported, the spread shows how noisy the machine is
+		int repetitions{ 5 };
+		//JSON results, nothing is written when empty
+		std::string reportPath{};
+	};
+
+	struct BenchmarkResult
+	{
+		std::string name{};
+		uint64_t iterations{};
+		double minNanoseconds{};
+		double medianNanoseconds{};
+		double maxNanoseconds{};
+		//Per second at the fastest repetition, 0 when the case does not report items
+		double itemsPerSecond{};
+	};
+
+	//Runs the cases one after the other on the calling thread and prints a table
+	std::vector<BenchmarkResult> RunBenchmarks(const std::vector<BenchmarkCase>& cases, const BenchmarkSettings& settings);
+	bool WriteBenchmarkReport(const std::vector<BenchmarkResult>& results, const std::string& path);
+
+	void UseCharPointer(const volatile char* pValue);
+
+	//Keeps the compiler from removing a result that is never read
+	template<typename T>
+	void DoNotOptimize(const T& value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		UseCharPointer(&reinterpret_cast<const volatile char&>(value));
+#endif
+	}
+}
@@ -5,6 +5,7 @@
 #include "Maths.h"
 #include "Timer.h"
 #include "DataTypes.h"
+#include "Frustum.h"
 
 namespace dae
 {
@@ -50,6 +51,25 @@ namespace dae
 		}
 
 
+		//Places the camera without input, yaw and pitch are in radians like totalYaw and totalPitch
+		void SetPose(const Vector3& _origin, float yaw, float pitch)
+		{
+			origin = _origin;
+			totalYaw = yaw;
+			totalPitch = std::clamp(pitch, -89.f * TO_RADIANS, 89.f * TO_RADIANS);
+
+			const Matrix rotationMatrix = Matrix::CreateRotationX(totalPitch) * Matrix::CreateRotationY(totalYaw);
+			forward = rotationMatrix.TransformVector(Vector3::UnitZ);
+
+			CalculateViewMatrix();
+		}
+
+		//World space planes of the volume IsOutsideFrustum keeps
+		Frustum GetFrustum() const
+		{
+			return Frustum::FromMatrix(viewMatrix * projectionMatrix);
+		}
+
 		static bool IsOutsideFrustum(const Vector4& vector)
 		{			
 			return vector.x < -1.f || vector.x > 1.f
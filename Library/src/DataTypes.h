@@ -2,6 +2,9 @@
 #include "Maths.h"
 #include "vector"
 #include "../Misc/ITriangleIndicesIterator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <memory>
 
 namespace dae
@@ -16,21 +19,56 @@ namespace dae
 		Vector3 viewDirection{}; //W4
 	};
 
-	struct Vertex_Out
-	{
-		Vector4 position{};
-		//ColorRGB color{ colors::White };
-		Vector2 uv{};
-		Vector3 normal{};
-		Vector3 tangent{};
-		Vector3 viewDirection{};
-	};
-
 
 	struct BoundingBox
 	{
 		Vector3 min{};
 		Vector3 max{};
+
+		Vector3 GetCenter() const { return (min + max) * 0.5f; }
+		//Half the size along every axis
+		Vector3 GetExtents() const { return (max - min) * 0.5f; }
+
+		void Grow(const BoundingBox& other)
+		{
+			min = Vector3::Min(min, other.min);
+			max = Vector3::Max(max, other.max);
+		}
+
+		//The box around this box placed with transform, every transformed axis adds its extent in absolute value
+		BoundingBox Transformed(const Matrix& transform) const
+		{
+			const auto absolute = [](const Vector3& v) { return Vector3{ std::abs(v.x), std::abs(v.y), std::abs(v.z) }; };
+			const Vector3 extents{ GetExtents() };
+			const Vector3 center{ transform.TransformPoint(GetCenter()) };
+			const Vector3 transformedExtents{ absolute(transform.GetAxisX()) * extents.x + absolute(transform.GetAxisY()) * extents.y + absolute(transform.GetAxisZ()) * extents.z };
+			return { center - transformedExtents, center + transformedExtents };
+		}
+	};
+
+	struct BoundingSphere
+	{
+		Vector3 center{};
+		float radius{};
+	};
+	
+	//Neighbouring triangles of a mesh that are culled together before the vertex stage
+	//Owns a contiguous range of the vertices and of the indices of its mesh
+	struct Meshlet
+	{
+		uint32_t vertexOffset{};
+		uint32_t vertexCount{};
+		uint32_t indexOffset{};
+		uint32_t triangleCount{};
+
+		//Object space bounding sphere
+		Vector3 center{};
+		float radius{};
+
+		//Every triangle faces within the cone around coneAxis
+		Vector3 coneAxis{};
+		//Sine of the cone angle, 1 when the triangles face too many directions to ever cull the meshlet
+		float coneCutoff{ 1.f };
 	};
 	
 	enum class PrimitiveTopology
@@ -45,7 +83,19 @@ namespace dae
 		Mesh(const  std::vector<Vertex>& vertices, PrimitiveTopology primitiveTopology = PrimitiveTopology::TriangleList) :
 			vertices{ (vertices) },
 			primitiveTopology{ primitiveTopology }
-		{}
+		{
+			UpdateBounds();
+		}
+
+		//Indexed triangle list, optionally split into meshlets
+		Mesh(std::vector<Vertex>&& vertices, std::vector<uint32_t>&& indices, std::vector<Meshlet>&& meshlets = {}) :
+			vertices{ std::move(vertices) },
+			indices{ std::move(indices) },
+			meshlets{ std::move(meshlets) },
+			primitiveTopology{ PrimitiveTopology::TriangleList }
+		{
+			UpdateBounds();
+		}
 
 		
 		void Rotate(float angle, const Vector3& axis)
@@ -54,10 +104,59 @@ namespace dae
 		}
 		
 		std::vector<Vertex> vertices{};
+		//Every three indices are a triangle, empty when every three vertices are a triangle
+		std::vector<uint32_t> indices{};
+		//Cover every triangle when not empty, the renderer then culls per meshlet
+		std::vector<Meshlet> meshlets{};
+
+		uint32_t GetTriangleCount() const { return static_cast<uint32_t>((indices.empty() ? vertices.size() : indices.size()) / 3); }
+
+		//Bytes of the geometry of the mesh and its levels of detail
+		size_t GetMemorySize() const
+		{
+			size_t size{ sizeof(Mesh) + vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t) + meshlets.size() * sizeof(Meshlet) };
+			for (const Mesh& lod : lods) size += lod.GetMemorySize();
+			return size;
+		}
+
+		//Object space bounds of the vertices, the constructors compute them, call it again after changing the vertices
+		void UpdateBounds()
+		{
+			if (vertices.empty())
+			{
+				bounds = {};
+				boundingSphere = {};
+				return;
+			}
+
+			bounds = { vertices.front().position, vertices.front().position };
+			for (const Vertex& vertex : vertices)
+			{
+				bounds.min = Vector3::Min(bounds.min, vertex.position);
+				bounds.max = Vector3::Max(bounds.max, vertex.position);
+			}
+
+			//Around the center of the box, only the vertices that lie furthest out decide the radius
+			boundingSphere = { bounds.GetCenter(), 0.f };
+			float sqrRadius{};
+			for (const Vertex& vertex : vertices)
+			{
+				sqrRadius = std::max(sqrRadius, (vertex.position - boundingSphere.center).SqrMagnitude());
+			}
+			boundingSphere.radius = std::sqrt(sqrRadius);
+		}
+
+		BoundingBox bounds{};
+		BoundingSphere boundingSphere{};
+
+		//Simplified versions, each with about half the triangles of the one before, for when the mesh covers few pixels
+		//Only their geometry is used, they are drawn with the world matrix and bounds of this mesh
+		std::vector<Mesh> lods{};
+		//Upper bound on the distance to the surface of the full mesh in object space, zero for the full mesh
+		float simplificationError{};
 
 		PrimitiveTopology primitiveTopology{ PrimitiveTopology::TriangleStrip };
 
-		std::vector<Vertex_Out> vertices_out{};
 		Matrix worldMatrix{};
 	};
 }
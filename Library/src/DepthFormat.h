@@ -0,0 +1,83 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+
+namespace dae
+{
+	enum class DepthFormat
+	{
+		Float32,
+		Unorm16,
+		Unorm24,
+		ReversedFloat32
+	};
+
+	//Storage and depth test of every format, specialized so the raster loop has no runtime switch
+	//Forward formats store the NDC depth, smaller is closer
+	//Reversed formats store nearPlane / viewDepth, bigger is closer, which keeps float precision over the whole range
+	template<DepthFormat Format>
+	struct DepthTraits;
+
+	template<>
+	struct DepthTraits<DepthFormat::Float32>
+	{
+		using Storage = float;
+		static constexpr bool reversed{ false };
+		static constexpr Storage clearValue{ FLT_MAX };
+
+		static Storage Encode(float depth) { return depth; }
+		static float Decode(Storage depth) { return depth; }
+		static bool Passes(Storage depth, Storage storedDepth) { return depth <= storedDepth; }
+	};
+
+	template<>
+	struct DepthTraits<DepthFormat::Unorm16>
+	{
+		using Storage = uint16_t;
+		static constexpr bool reversed{ false };
+		static constexpr Storage clearValue{ 0xFFFF };
+
+		static Storage Encode(float depth) { return static_cast<Storage>(std::lround(std::clamp(depth, 0.f, 1.f) * 65535.f)); }
+		static float Decode(Storage depth) { return static_cast<float>(depth) / 65535.f; }
+		static bool Passes(Storage depth, Storage storedDepth) { return depth <= storedDepth; }
+	};
+
+	//24 bits of precision in a 32 bit word, the top byte stays unused
+	template<>
+	struct DepthTraits<DepthFormat::Unorm24>
+	{
+		using Storage = uint32_t;
+		static constexpr bool reversed{ false };
+		static constexpr Storage clearValue{ 0xFFFFFF };
+
+		static Storage Encode(float depth) { return static_cast<Storage>(std::llround(std::clamp(depth, 0.f, 1.f) * 16777215.0)); }
+		static float Decode(Storage depth) { return static_cast<float>(depth) / 16777215.f; }
+		static bool Passes(Storage depth, Storage storedDepth) { return depth <= storedDepth; }
+	};
+
+	template<>
+	struct DepthTraits<DepthFormat::ReversedFloat32>
+	{
+		using Storage = float;
+		static constexpr bool reversed{ true };
+		static constexpr Storage clearValue{ 0.f };
+
+		static Storage Encode(float depth) { return depth; }
+		static float Decode(Storage depth) { return depth; }
+		static bool Passes(Storage depth, Storage storedDepth) { return depth >= storedDepth; }
+	};
+
+	inline const char* GetDepthFormatName(DepthFormat format)
+	{
+		switch (format)
+		{
+		case DepthFormat::Float32: return "Float32";
+		case DepthFormat::Unorm16: return "Unorm16";
+		case DepthFormat::Unorm24: return "Unorm24";
+		case DepthFormat::ReversedFloat32: return "ReversedFloat32";
+		}
+		return "Unknown";
+	}
+}
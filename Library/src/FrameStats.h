@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+
+//The counters cost a few additions per triangle and quad, build with RASTERIZER_STATS=0 to compile them out
+#ifndef RASTERIZER_STATS
+#define RASTERIZER_STATS 1
+#endif
+
+namespace dae
+{
+	//Pipeline statistics of one frame
+	//Every thread counts into its own copy, they are merged at the end of the frame
+	struct alignas(64) FrameStats
+	{
+		static constexpr bool m_IsEnabled{ RASTERIZER_STATS != 0 };
+
+		//Meshes outside of the frustum are dropped before the vertex stage, the counters below only see the drawn meshes
+		//Every instance of an instanced draw counts as a mesh
+		uint64_t meshesSubmitted{};
+		uint64_t meshesFrustumCulled{};
+		//Boxes of the scene hierarchy and its objects tested against the frustum, most culled meshes are never tested on their own
+		uint64_t sceneBoxesTested{};
+		//Triangles of the full meshes their level of detail leaves out, trianglesSubmitted only counts the drawn level
+		uint64_t trianglesLodRemoved{};
+
+		uint64_t verticesTransformed{};
+		uint64_t trianglesSubmitted{};
+
+		//Whole meshlets rejected before the vertex stage, the triangle counters below never see their triangles
+		uint64_t meshletsFrustumCulled{};
+		uint64_t meshletsBackFaceCulled{};
+		uint64_t trianglesMeshletCulled{};
+
+		//Every vertex is outside of the same frustum plane
+		uint64_t trianglesFrustumCulled{};
+		uint64_t trianglesBackFaceCulled{};
+		//Zero area or no sample position inside the bounding box
+		uint64_t trianglesSmallCulled{};
+		//Crossing the frustum, the clipper drops these for now
+		uint64_t trianglesClipped{};
+		uint64_t trianglesRasterized{};
+
+		//Covered pixels that were depth tested and passed, samples with MSAA
+		uint64_t pixelsTested{};
+		uint64_t pixelsDepthPassed{};
+		//Pixel shader invocations, once per pixel and triangle with MSAA
+		uint64_t pixelsShaded{};
+		//Pixels that at least one triangle wrote to, counted the first time a sample of the pixel passes the depth test
+		uint64_t pixelsCovered{};
+		uint64_t textureSamples{};
+
+		//Shaded pixels per covered pixel, 1 when every covered pixel was shaded once
+		double GetOverdrawRatio() const { return pixelsCovered ? static_cast<double>(pixelsShaded) / static_cast<double>(pixelsCovered) : 0.0; }
+
+		FrameStats& operator+=(const FrameStats& other)
+		{
+			meshesSubmitted += other.meshesSubmitted;
+			meshesFrustumCulled += other.meshesFrustumCulled;
+			sceneBoxesTested += other.sceneBoxesTested;
+			trianglesLodRemoved += other.trianglesLodRemoved;
+			verticesTransformed += other.verticesTransformed;
+			trianglesSubmitted += other.trianglesSubmitted;
+			meshletsFrustumCulled += other.meshletsFrustumCulled;
+			meshletsBackFaceCulled += other.meshletsBackFaceCulled;
+			trianglesMeshletCulled += other.trianglesMeshletCulled;
+			trianglesFrustumCulled += other.trianglesFrustumCulled;
+			trianglesBackFaceCulled += other.trianglesBackFaceCulled;
+			trianglesSmallCulled += other.trianglesSmallCulled;
+			trianglesClipped += other.trianglesClipped;
+			trianglesRasterized += other.trianglesRasterized;
+			pixelsTested += other.pixelsTested;
+			pixelsDepthPassed += other.pixelsDepthPassed;
+			pixelsShaded += other.pixelsShaded;
+			pixelsCovered += other.pixelsCovered;
+			textureSamples += other.textureSamples;
+			return *this;
+		}
+	};
+}
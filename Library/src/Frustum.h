@@ -0,0 +1,87 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "DataTypes.h"
+#include "Maths.h"
+
+namespace dae
+{
+	//The clip volume of a view projection matrix as six planes, in the space the matrix transforms from
+	//Built from a world view projection matrix the planes are in object space, so object space bounds need no transform
+	struct Frustum
+	{
+		//Normal in xyz pointing inside, distance in w, normalized so a sphere radius can be compared directly
+		std::array<Vector4, 6> planes{};
+
+		//The volume the clipper keeps, -w <= x, y, z <= w
+		static Frustum FromMatrix(const Matrix& viewProjection)
+		{
+			//Row vectors, so a clip space coordinate is the dot product with a column
+			const auto getColumn = [&viewProjection](int column)
+			{
+				return Vector4{ viewProjection[0][column], viewProjection[1][column], viewProjection[2][column], viewProjection[3][column] };
+			};
+			const Vector4 x{ getColumn(0) };
+			const Vector4 y{ getColumn(1) };
+			const Vector4 z{ getColumn(2) };
+			const Vector4 w{ getColumn(3) };
+
+			Frustum frustum{ { w + x, w - x, w + y, w - y, w + z, w - z } };
+			for (Vector4& plane : frustum.planes)
+			{
+				const float length{ plane.GetXYZ().Magnitude() };
+				if (length > 0.f) plane = plane * (1.f / length);
+			}
+			return frustum;
+		}
+
+		//True when the sphere lies completely outside one of the planes
+		//Conservative, a sphere near a corner can be outside the frustum without being outside a single plane
+		bool IsSphereOutside(const Vector3& center, float radius) const
+		{
+			for (const Vector4& plane : planes)
+			{
+				if (Vector3::Dot(plane.GetXYZ(), center) + plane.w < -radius) return true;
+			}
+			return false;
+		}
+
+		//Same test for a box that is aligned with its own axes, given as its center and half its size
+		bool IsBoxOutside(const Vector3& center, const Vector3& extents) const
+		{
+			for (const Vector4& plane : planes)
+			{
+				//How far the box reaches towards the plane
+				const float reach{ std::abs(plane.x) * extents.x + std::abs(plane.y) * extents.y + std::abs(plane.z) * extents.z };
+				if (Vector3::Dot(plane.GetXYZ(), center) + plane.w < -reach) return true;
+			}
+			return false;
+		}
+
+		//Upper bound on how much transform stretches a length, from the dot products of its axes (Gershgorin)
+		//Exact for a rotation with uniform scale, where the axes are perpendicular and equally long
+		static float GetMaxScale(const Matrix& transform)
+		{
+			//The rows of the matrix are the transformed axes
+			const Vector3 axisX{ transform.GetAxisX() };
+			const Vector3 axisY{ transform.GetAxisY() };
+			const Vector3 axisZ{ transform.GetAxisZ() };
+
+			const float xy{ std::abs(Vector3::Dot(axisX, axisY)) };
+			const float xz{ std::abs(Vector3::Dot(axisX, axisZ)) };
+			const float yz{ std::abs(Vector3::Dot(axisY, axisZ)) };
+			return std::sqrt(std::max({ axisX.SqrMagnitude() + xy + xz, axisY.SqrMagnitude() + xy + yz, axisZ.SqrMagnitude() + xz + yz }));
+		}
+
+		//Tests the bounds of a mesh placed with transform, the sphere first as it is cheaper, then the tighter box
+		bool AreBoundsOutside(const BoundingBox& box, const BoundingSphere& sphere, const Matrix& transform) const
+		{
+			if (IsSphereOutside(transform.TransformPoint(sphere.center), sphere.radius * GetMaxScale(transform))) return true;
+
+			const BoundingBox worldBox{ box.Transformed(transform) };
+			return IsBoxOutside(worldBox.GetCenter(), worldBox.GetExtents());
+		}
+	};
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+
+#include "RenderTarget.h"
+
+namespace dae
+{
+	enum class ImageFileFormat
+	{
+		BMP,
+		PPM,
+		PNG,
+		QOI
+	};
+
+	const char* GetImageFileExtension(ImageFileFormat format);
+
+	//Writes the pixels of a render target to disk, alpha is dropped for every file format
+	//Returns false when the file could not be written
+	bool SaveImage(const RenderTarget& image, const std::string& path, ImageFileFormat format);
+}
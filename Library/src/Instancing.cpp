@@ -0,0 +1,99 @@
+#include "Instancing.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define INSTANCING_SSE 1
+#else
+#define INSTANCING_SSE 0
+#endif
+
+namespace dae
+{
+	namespace
+	{
+		static_assert(sizeof(Matrix) == 16 * sizeof(float), "The instance culling loads the rows of the world matrices directly");
+
+		bool IsInstanceOutside(const Frustum& frustum, const BoundingSphere& sphere, const MeshInstance& instance)
+		{
+			const Matrix& world{ instance.worldMatrix };
+			return frustum.IsSphereOutside(world.TransformPoint(sphere.center), sphere.radius * Frustum::GetMaxScale(world));
+		}
+
+#if INSTANCING_SSE
+		//Same test as IsInstanceOutside for four instances, as a mask with a bit per instance
+		int AreInstancesOutside(const Frustum& frustum, const BoundingSphere& sphere, const MeshInstance* pInstances)
+		{
+			//Row r of the four matrices, transposed so every register holds one component of the four instances
+			const auto loadRow = [pInstances](int row, __m128& x, __m128& y, __m128& z, __m128& w)
+			{
+				x = _mm_loadu_ps(reinterpret_cast<const float*>(&pInstances[0].worldMatrix) + row * 4);
+				y = _mm_loadu_ps(reinterpret_cast<const float*>(&pInstances[1].worldMatrix) + row * 4);
+				z = _mm_loadu_ps(reinterpret_cast<const float*>(&pInstances[2].worldMatrix) + row * 4);
+				w = _mm_loadu_ps(reinterpret_cast<const float*>(&pInstances[3].worldMatrix) + row * 4);
+				_MM_TRANSPOSE4_PS(x, y, z, w);
+			};
+
+			__m128 axisXx, axisXy, axisXz, axisXw;
+			__m128 axisYx, axisYy, axisYz, axisYw;
+			__m128 axisZx, axisZy, axisZz, axisZw;
+			__m128 translationX, translationY, translationZ, translationW;
+			loadRow(0, axisXx, axisXy, axisXz, axisXw);
+			loadRow(1, axisYx, axisYy, axisYz, axisYw);
+			loadRow(2, axisZx, axisZy, axisZz, axisZw);
+			loadRow(3, translationX, translationY, translationZ, translationW);
+
+			const auto dot = [](__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+			{
+				return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+			};
+
+			//The center of the sphere in world space
+			const __m128 sphereX{ _mm_set1_ps(sphere.center.x) };
+			const __m128 sphereY{ _mm_set1_ps(sphere.center.y) };
+			const __m128 sphereZ{ _mm_set1_ps(sphere.center.z) };
+			const __m128 centerX{ _mm_add_ps(dot(sphereX, sphereY, sphereZ, axisXx, axisYx, axisZx), translationX) };
+			const __m128 centerY{ _mm_add_ps(dot(sphereX, sphereY, sphereZ, axisXy, axisYy, axisZy), translationY) };
+			const __m128 centerZ{ _mm_add_ps(dot(sphereX, sphereY, sphereZ, axisXz, axisYz, axisZz), translationZ) };
+
+			//The radius scaled with the same bound as Frustum::GetMaxScale
+			const __m128 absMask{ _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF)) };
+			const __m128 xy{ _mm_and_ps(dot(axisXx, axisXy, axisXz, axisYx, axisYy, axisYz), absMask) };
+			const __m128 xz{ _mm_and_ps(dot(axisXx, axisXy, axisXz, axisZx, axisZy, axisZz), absMask) };
+			const __m128 yz{ _mm_and_ps(dot(axisYx, axisYy, axisYz, axisZx, axisZy, axisZz), absMask) };
+			const __m128 rowX{ _mm_add_ps(dot(axisXx, axisXy, axisXz, axisXx, axisXy, axisXz), _mm_add_ps(xy, xz)) };
+			const __m128 rowY{ _mm_add_ps(dot(axisYx, axisYy, axisYz, axisYx, axisYy, axisYz), _mm_add_ps(xy, yz)) };
+			const __m128 rowZ{ _mm_add_ps(dot(axisZx, axisZy, axisZz, axisZx, axisZy, axisZz), _mm_add_ps(xz, yz)) };
+			const __m128 maxScale{ _mm_sqrt_ps(_mm_max_ps(rowX, _mm_max_ps(rowY, rowZ))) };
+			const __m128 negativeRadius{ _mm_mul_ps(_mm_set1_ps(-sphere.radius), maxScale) };
+
+			__m128 isOutside{ _mm_setzero_ps() };
+			for (const Vector4& plane : frustum.planes)
+			{
+				const __m128 distance{ _mm_add_ps(dot(centerX, centerY, centerZ, _mm_set1_ps(plane.x), _mm_set1_ps(plane.y), _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)) };
+				isOutside = _mm_or_ps(isOutside, _mm_cmplt_ps(distance, negativeRadius));
+			}
+			return _mm_movemask_ps(isOutside);
+		}
+#endif
+	}
+
+	void FindVisibleInstances(const Frustum& frustum, const BoundingSphere& sphere, std::span<const MeshInstance> instances, std::vector<uint32_t>& visibleInstances)
+	{
+		const uint32_t instanceCount{ static_cast<uint32_t>(instances.size()) };
+		uint32_t instanceIdx{};
+#if INSTANCING_SSE
+		for (; instanceIdx + 4 <= instanceCount; instanceIdx += 4)
+		{
+			const int outsideMask{ AreInstancesOutside(frustum, sphere, &instances[instanceIdx]) };
+			for (uint32_t lane{}; lane < 4; ++lane)
+			{
+				if (!(outsideMask & (1 << lane))) visibleInstances.push_back(instanceIdx + lane);
+			}
+		}
+#endif
+		for (; instanceIdx < instanceCount; ++instanceIdx)
+		{
+			if (!IsInstanceOutside(frustum, sphere, instances[instanceIdx])) visibleInstances.push_back(instanceIdx);
+		}
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "DataTypes.h"
+#include "Frustum.h"
+
+namespace dae
+{
+	//One drawn copy of a mesh, the mesh only provides the object space geometry
+	struct MeshInstance
+	{
+		Matrix worldMatrix{};
+		//Free for the shaders, the vertex shader gets them in DrawConstants
+		//A vertex shader that moves the vertices with them has to opt out of the culling with the bounds, see VertexShader
+		Vector4 parameters{};
+	};
+
+	//Geometry that is drawn many times, shared and never changed, so every copy of a scene can point at the same mesh
+	//The worldMatrix of the mesh is not used, every instance has its own
+	struct InstancedMesh
+	{
+		std::shared_ptr<const Mesh> pMesh{};
+		std::vector<MeshInstance> instances{};
+	};
+
+	//Appends the indices of the instances whose bounding sphere is not outside of the frustum, in order
+	//sphere is the object space sphere of the mesh, it is placed and scaled with the world matrix of every instance
+	//Four instances are tested at once with SSE
+	void FindVisibleInstances(const Frustum& frustum, const BoundingSphere& sphere, std::span<const MeshInstance> instances, std::vector<uint32_t>& visibleInstances);
+}
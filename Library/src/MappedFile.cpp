@@ -0,0 +1,83 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dae
+{
+#ifdef _WIN32
+	MappedFile::MappedFile(const std::string& path)
+	{
+		const HANDLE file{ CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+		if (file == INVALID_HANDLE_VALUE) return;
+		m_FileHandle = file;
+
+		LARGE_INTEGER size{};
+		if (!GetFileSizeEx(file, &size)) return;
+		m_Size = static_cast<size_t>(size.QuadPart);
+
+		//Mapping an empty file fails, but it is still a valid file
+		if (m_Size == 0)
+		{
+			m_IsOpen = true;
+			return;
+		}
+
+		m_MappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!m_MappingHandle) return;
+
+		m_pData = static_cast<const char*>(MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0));
+		m_IsOpen = m_pData != nullptr;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (m_pData) UnmapViewOfFile(m_pData);
+		if (m_MappingHandle) CloseHandle(m_MappingHandle);
+		if (m_FileHandle) CloseHandle(m_FileHandle);
+	}
+#else
+	MappedFile::MappedFile(const std::string& path)
+	{
+		const int file{ open(path.c_str(), O_RDONLY) };
+		if (file < 0) return;
+
+		struct stat status{};
+		if (fstat(file, &status) == 0)
+		{
+			m_Size = static_cast<size_t>(status.st_size);
+			if (m_Size == 0)
+			{
+				m_IsOpen = true;
+			}
+			else
+			{
+				void* pData{ mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0) };
+				if (pData != MAP_FAILED)
+				{
+					//Readers usually go through the whole file, start paging it in right away
+					madvise(pData, m_Size, MADV_WILLNEED);
+					m_pData = static_cast<const char*>(pData);
+					m_IsOpen = true;
+				}
+			}
+		}
+
+		//The mapping keeps the file alive
+		close(file);
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (m_pData) munmap(const_cast<char*>(m_pData), m_Size);
+	}
+#endif
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace dae
+{
+	//Read only view of a whole file, mapped into memory instead of read through a stream
+	//The operating system pages the file in on first touch, so nothing is copied up front
+	class MappedFile final
+	{
+	public:
+		explicit MappedFile(const std::string& path);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&&) noexcept = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile& operator=(MappedFile&&) noexcept = delete;
+
+		//An empty file is open but has no data
+		bool IsOpen() const { return m_IsOpen; }
+		std::string_view GetView() const { return { m_pData, m_Size }; }
+
+	private:
+		const char* m_pData{};
+		size_t m_Size{};
+		bool m_IsOpen{};
+
+#ifdef _WIN32
+		void* m_FileHandle{};
+		void* m_MappingHandle{};
+#endif
+	};
+}
@@ -0,0 +1,344 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+
+#include "MappedFile.h"
+#include "Meshlet.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Trace.h"
+#include "Utils.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Bumped whenever the layout of the file changes
+		constexpr uint32_t m_MeshCacheVersion{ 4 };
+		constexpr size_t m_StreamAlignment{ 64 };
+
+		//Levels of detail below the full mesh, each targets half the triangles of the level before
+		constexpr uint32_t m_MaxLodCount{ 4 };
+		//No level gets fewer triangles than this, smaller meshes get fewer levels
+		constexpr uint32_t m_MinLodTriangles{ 64 };
+
+		static_assert(std::is_trivially_copyable_v<Vertex>, "The vertex stream is copied as raw bytes");
+		static_assert(std::is_trivially_copyable_v<Meshlet>, "The meshlet stream is copied as raw bytes");
+
+		//Native byte order, a cache file is rebuilt rather than moved between machines
+		struct MeshCacheHeader
+		{
+			std::array<char, 8> magic{ 'D', 'A', 'E', 'M', 'E', 'S', 'H', '\0' };
+			uint32_t version{ m_MeshCacheVersion };
+			uint32_t vertexStride{ sizeof(Vertex) };
+			uint64_t sourceHash{};
+			uint32_t flipAxisAndWinding{};
+			uint32_t meshletStride{ sizeof(Meshlet) };
+			//Entries of the level table that directly follows the header
+			uint32_t levelCount{};
+
+			BoundingBox bounds{};
+		};
+
+		//The streams of one level of detail, offsets are from the start of the file
+		struct MeshCacheLevel
+		{
+			uint64_t vertexCount{};
+			uint64_t vertexOffset{};
+			uint64_t indexCount{};
+			uint64_t indexOffset{};
+			uint64_t meshletCount{};
+			uint64_t meshletOffset{};
+			float simplificationError{};
+			//Written as zero rather than as uninitialized padding
+			uint32_t reserved{};
+		};
+
+		uint64_t AlignOffset(uint64_t offset)
+		{
+			return (offset + m_StreamAlignment - 1) / m_StreamAlignment * m_StreamAlignment;
+		}
+
+		uint64_t MixWord(uint64_t word)
+		{
+			word ^= word >> 33;
+			word *= 0xff51afd7ed558ccdull;
+			word ^= word >> 33;
+			return word;
+		}
+
+		bool ReadMeshCacheLevel(std::string_view bytes, const MeshCacheLevel& level, IndexedMesh& mesh)
+		{
+			//Every stream has to lie inside the file
+			const uint64_t fileSize{ bytes.size() };
+			if (level.vertexOffset > fileSize || level.vertexCount > (fileSize - level.vertexOffset) / sizeof(Vertex)) return false;
+			if (level.indexOffset > fileSize || level.indexCount > (fileSize - level.indexOffset) / sizeof(uint32_t)) return false;
+			if (level.meshletOffset > fileSize || level.meshletCount > (fileSize - level.meshletOffset) / sizeof(Meshlet)) return false;
+
+			const uint32_t* pIndices{ reinterpret_cast<const uint32_t*>(bytes.data() + level.indexOffset) };
+			const bool hasValidIndices{ std::all_of(pIndices, pIndices + level.indexCount, [&level](uint32_t index) { return index < level.vertexCount; }) };
+			if (!hasValidIndices || level.indexCount % 3 != 0) return false;
+
+			std::vector<Meshlet> meshlets(level.meshletCount);
+			std::memcpy(meshlets.data(), bytes.data() + level.meshletOffset, level.meshletCount * sizeof(Meshlet));
+			//The renderer only transforms the vertex range of a meshlet, so its triangles may not reach outside of it
+			const bool hasValidMeshlets{ std::all_of(meshlets.begin(), meshlets.end(), [&level, pIndices](const Meshlet& meshlet)
+			{
+				if (uint64_t{ meshlet.vertexOffset } + meshlet.vertexCount > level.vertexCount) return false;
+				if (uint64_t{ meshlet.indexOffset } + uint64_t{ meshlet.triangleCount } * 3 > level.indexCount) return false;
+				return std::all_of(pIndices + meshlet.indexOffset, pIndices + meshlet.indexOffset + meshlet.triangleCount * 3, [&meshlet](uint32_t index)
+				{
+					return index >= meshlet.vertexOffset && index - meshlet.vertexOffset < meshlet.vertexCount;
+				});
+			}) };
+			if (!hasValidMeshlets) return false;
+
+			mesh.vertices.resize(level.vertexCount);
+			std::memcpy(mesh.vertices.data(), bytes.data() + level.vertexOffset, level.vertexCount * sizeof(Vertex));
+			mesh.indices.assign(pIndices, pIndices + level.indexCount);
+			mesh.meshlets = std::move(meshlets);
+			mesh.simplificationError = level.simplificationError;
+			return true;
+		}
+
+		//Optimizes and splits a level into meshlets like the full mesh
+		IndexedMesh CreateLod(SimplifiedMesh&& simplifiedMesh)
+		{
+			IndexedMesh lod{};
+			lod.vertices = std::move(simplifiedMesh.vertices);
+			lod.indices = std::move(simplifiedMesh.indices);
+			lod.simplificationError = simplifiedMesh.error;
+			OptimizeMesh(lod.vertices, lod.indices);
+			lod.meshlets = BuildMeshlets(lod.vertices, lod.indices);
+			return lod;
+		}
+	}
+
+	Mesh CreateMesh(IndexedMesh&& mesh)
+	{
+		Mesh result{ std::move(mesh.vertices), std::move(mesh.indices), std::move(mesh.meshlets) };
+		result.simplificationError = mesh.simplificationError;
+		for (IndexedMesh& lod : mesh.lods)
+		{
+			result.lods.push_back(CreateMesh(std::move(lod)));
+		}
+		return result;
+	}
+
+	IndexedMesh BuildIndexedMesh(const std::vector<Vertex>& triangleList)
+	{
+		IndexedMesh mesh{};
+		mesh.indices.reserve(triangleList.size());
+
+		//Keys are the bytes of the vertices in the triangle list, which outlives the map
+		std::unordered_map<std::string_view, uint32_t> vertexIndices{};
+		vertexIndices.reserve(triangleList.size());
+
+		for (const Vertex& vertex : triangleList)
+		{
+			const std::string_view key{ reinterpret_cast<const char*>(&vertex), sizeof(Vertex) };
+			const auto [it, isNew] { vertexIndices.try_emplace(key, static_cast<uint32_t>(mesh.vertices.size())) };
+			if (isNew) mesh.vertices.push_back(vertex);
+			mesh.indices.push_back(it->second);
+		}
+
+		if (!mesh.vertices.empty())
+		{
+			mesh.bounds = { mesh.vertices.front().position, mesh.vertices.front().position };
+			for (const Vertex& vertex : mesh.vertices)
+			{
+				mesh.bounds.min = Vector3::Min(mesh.bounds.min, vertex.position);
+				mesh.bounds.max = Vector3::Max(mesh.bounds.max, vertex.position);
+			}
+		}
+		return mesh;
+	}
+
+	uint64_t HashBytes(std::string_view bytes)
+	{
+		//Four independent lanes of eight bytes, so the multiplies of neighbouring words overlap
+		std::array<uint64_t, 4> lanes{ 0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull, 0x27d4eb2f165667c5ull };
+
+		size_t offset{};
+		for (; offset + sizeof(lanes) <= bytes.size(); offset += sizeof(lanes))
+		{
+			for (size_t lane{}; lane < lanes.size(); ++lane)
+			{
+				uint64_t word{};
+				std::memcpy(&word, bytes.data() + offset + lane * sizeof(uint64_t), sizeof(uint64_t));
+				lanes[lane] = std::rotl(lanes[lane] ^ (word * 0x9e3779b97f4a7c15ull), 29) * 0xbf58476d1ce4e5b9ull;
+			}
+		}
+
+		uint64_t hash{ bytes.size() };
+		for (const uint64_t lane : lanes)
+		{
+			hash = MixWord(hash ^ lane);
+		}
+		for (; offset < bytes.size(); ++offset)
+		{
+			hash = (hash ^ static_cast<uint8_t>(bytes[offset])) * 0x100000001b3ull;
+		}
+		return MixWord(hash);
+	}
+
+	bool WriteMeshCache(const std::string& path, const IndexedMesh& mesh, uint64_t sourceHash, bool flipAxisAndWinding)
+	{
+		const TraceZone zone{ "Write mesh cache" };
+
+		std::vector<const IndexedMesh*> levelMeshes{ &mesh };
+		for (const IndexedMesh& lod : mesh.lods) levelMeshes.push_back(&lod);
+
+		MeshCacheHeader header{};
+		header.sourceHash = sourceHash;
+		header.flipAxisAndWinding = flipAxisAndWinding;
+		header.levelCount = static_cast<uint32_t>(levelMeshes.size());
+		header.bounds = mesh.bounds;
+
+		std::vector<MeshCacheLevel> levels(levelMeshes.size());
+		uint64_t offset{ sizeof(MeshCacheHeader) + levels.size() * sizeof(MeshCacheLevel) };
+		for (size_t levelIdx{}; levelIdx < levels.size(); ++levelIdx)
+		{
+			const IndexedMesh& levelMesh{ *levelMeshes[levelIdx] };
+			MeshCacheLevel& level{ levels[levelIdx] };
+			level.vertexCount = levelMesh.vertices.size();
+			level.vertexOffset = AlignOffset(offset);
+			level.indexCount = levelMesh.indices.size();
+			level.indexOffset = AlignOffset(level.vertexOffset + level.vertexCount * sizeof(Vertex));
+			level.meshletCount = levelMesh.meshlets.size();
+			level.meshletOffset = AlignOffset(level.indexOffset + level.indexCount * sizeof(uint32_t));
+			level.simplificationError = levelMesh.simplificationError;
+			offset = level.meshletOffset + level.meshletCount * sizeof(Meshlet);
+		}
+
+		//Written next to the cache and renamed when complete, so a reader never sees half a file
+		//Named after the thread, two threads that write the cache of the same mesh do not write into each other's file
+		const std::string temporaryPath{ path + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp" };
+		bool isWritten{};
+		{
+			std::ofstream file{ temporaryPath, std::ios::binary | std::ios::trunc };
+			const auto writePadding = [&file](uint64_t offset)
+			{
+				const std::array<char, m_StreamAlignment> zeros{};
+				file.write(zeros.data(), static_cast<std::streamsize>(offset - static_cast<uint64_t>(file.tellp())));
+			};
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(levels.data()), static_cast<std::streamsize>(levels.size() * sizeof(MeshCacheLevel)));
+			for (size_t levelIdx{}; levelIdx < levels.size(); ++levelIdx)
+			{
+				const IndexedMesh& levelMesh{ *levelMeshes[levelIdx] };
+				const MeshCacheLevel& level{ levels[levelIdx] };
+				writePadding(level.vertexOffset);
+				file.write(reinterpret_cast<const char*>(levelMesh.vertices.data()), static_cast<std::streamsize>(level.vertexCount * sizeof(Vertex)));
+				writePadding(level.indexOffset);
+				file.write(reinterpret_cast<const char*>(levelMesh.indices.data()), static_cast<std::streamsize>(level.indexCount * sizeof(uint32_t)));
+				writePadding(level.meshletOffset);
+				file.write(reinterpret_cast<const char*>(levelMesh.meshlets.data()), static_cast<std::streamsize>(level.meshletCount * sizeof(Meshlet)));
+			}
+			isWritten = static_cast<bool>(file);
+		}
+
+		std::error_code error{};
+		if (isWritten)
+		{
+			std::filesystem::rename(temporaryPath, path, error);
+			if (!error) return true;
+		}
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+
+	bool ReadMeshCache(const std::string& path, IndexedMesh& mesh, uint64_t sourceHash, bool flipAxisAndWinding)
+	{
+		const TraceZone zone{ "Read mesh cache" };
+
+		const MappedFile file{ path };
+		const std::string_view bytes{ file.GetView() };
+		if (bytes.size() < sizeof(MeshCacheHeader)) return false;
+
+		MeshCacheHeader header{};
+		std::memcpy(&header, bytes.data(), sizeof(header));
+
+		const MeshCacheHeader expected{};
+		if (header.magic != expected.magic || header.version != expected.version) return false;
+		if (header.vertexStride != expected.vertexStride || header.meshletStride != expected.meshletStride) return false;
+		if (header.sourceHash != sourceHash || header.flipAxisAndWinding != static_cast<uint32_t>(flipAxisAndWinding)) return false;
+		if (header.levelCount == 0 || header.levelCount > m_MaxLodCount + 1) return false;
+		if (bytes.size() < sizeof(MeshCacheHeader) + header.levelCount * sizeof(MeshCacheLevel)) return false;
+
+		std::vector<MeshCacheLevel> levels(header.levelCount);
+		std::memcpy(levels.data(), bytes.data() + sizeof(MeshCacheHeader), levels.size() * sizeof(MeshCacheLevel));
+
+		IndexedMesh result{};
+		if (!ReadMeshCacheLevel(bytes, levels.front(), result)) return false;
+		result.lods.resize(levels.size() - 1);
+		for (size_t lodIdx{}; lodIdx < result.lods.size(); ++lodIdx)
+		{
+			if (!ReadMeshCacheLevel(bytes, levels[lodIdx + 1], result.lods[lodIdx])) return false;
+		}
+		result.bounds = header.bounds;
+		mesh = std::move(result);
+		return true;
+	}
+
+	bool LoadOBJ(const std::string& path, IndexedMesh& mesh, bool flipAxisAndWinding, ThreadPool* pThreadPool)
+	{
+		const TraceZone zone{ "Load OBJ" };
+
+		uint64_t sourceHash{};
+		{
+			const MappedFile source{ path };
+			if (!source.IsOpen()) return false;
+			sourceHash = HashBytes(source.GetView());
+		}
+
+		const std::string cachePath{ path + ".meshcache" };
+		if (ReadMeshCache(cachePath, mesh, sourceHash, flipAxisAndWinding)) return true;
+
+		std::vector<Vertex> triangleList{};
+		if (!Utils::ParseOBJ(path, triangleList, flipAxisAndWinding, pThreadPool)) return false;
+		mesh = BuildIndexedMesh(triangleList);
+
+		//The cache stores the optimized mesh, so only a cache miss pays for the optimization
+		const MeshOptimizationReport report{ OptimizeMesh(mesh.vertices, mesh.indices) };
+		std::cerr << "Optimized " << path << ": " << report.degenerateTriangles << " degenerate triangles and " << report.unusedVertices << " unused vertices removed\n"
+			<< "  ACMR " << report.vertexCacheBefore.acmr << " -> " << report.vertexCacheAfter.acmr
+			<< ", ATVR " << report.vertexCacheBefore.atvr << " -> " << report.vertexCacheAfter.atvr
+			<< ", overdraw " << report.overdrawBefore.overdraw << " -> " << report.overdrawAfter.overdraw << std::endl;
+
+		//Simplified from the optimized mesh, before the meshlets duplicate its vertices
+		std::vector<uint32_t> lodTriangleCounts{};
+		for (uint32_t triangleCount{ static_cast<uint32_t>(mesh.indices.size() / 3) / 2 }; triangleCount >= m_MinLodTriangles && lodTriangleCounts.size() < m_MaxLodCount; triangleCount /= 2)
+		{
+			lodTriangleCounts.push_back(triangleCount);
+		}
+		for (SimplifiedMesh& simplifiedMesh : SimplifyMesh(mesh.vertices, mesh.indices, lodTriangleCounts))
+		{
+			mesh.lods.push_back(CreateLod(std::move(simplifiedMesh)));
+			std::cerr << "  LOD " << mesh.lods.size() << ": " << mesh.lods.back().indices.size() / 3 << " triangles, error " << mesh.lods.back().simplificationError << std::endl;
+		}
+
+		const size_t optimizedVertexCount{ mesh.vertices.size() };
+		mesh.meshlets = BuildMeshlets(mesh.vertices, mesh.indices);
+		std::cerr << "  " << mesh.meshlets.size() << " meshlets, " << mesh.vertices.size() - optimizedVertexCount << " vertices duplicated between them" << std::endl;
+
+		//The mesh is still usable without a cache, the next start just parses again
+		if (!WriteMeshCache(cachePath, mesh, sourceHash, flipAxisAndWinding))
+		{
+			std::cerr << "Could not write mesh cache " << cachePath << std::endl;
+		}
+		return true;
+	}
+}
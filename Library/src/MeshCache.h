@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	class ThreadPool;
+
+	//An indexed triangle list with its meshlets, bounds and levels of detail, the geometry a mesh cache file holds
+	struct IndexedMesh
+	{
+		std::vector<Vertex> vertices{};
+		std::vector<uint32_t> indices{};
+		std::vector<Meshlet> meshlets{};
+		//Object space
+		BoundingBox bounds{};
+
+		//Simplified versions with fewer and fewer triangles, without levels of their own
+		std::vector<IndexedMesh> lods{};
+		//Upper bound on the distance to the surface of the full mesh, zero for the full mesh
+		float simplificationError{};
+	};
+
+	//Moves the geometry and the levels of detail into a Mesh
+	Mesh CreateMesh(IndexedMesh&& mesh);
+
+	//Merges bitwise identical vertices of a triangle list, the triangles keep their order
+	IndexedMesh BuildIndexedMesh(const std::vector<Vertex>& triangleList);
+
+	//Fast non cryptographic hash, only used to notice that a source file changed
+	uint64_t HashBytes(std::string_view bytes);
+
+	//Binary cache file: a header and a table of levels, the full mesh first, followed by the vertex, index and meshlet streams of every level
+	//All streams are aligned to a cache line
+	//The vertex stream has the memory layout of Vertex, so loading it is a single copy out of the mapped file
+	//Reading fails when the file was written for other source bytes, parse settings or Vertex layout
+	bool WriteMeshCache(const std::string& path, const IndexedMesh& mesh, uint64_t sourceHash, bool flipAxisAndWinding);
+	bool ReadMeshCache(const std::string& path, IndexedMesh& mesh, uint64_t sourceHash, bool flipAxisAndWinding);
+
+	//Loads an OBJ through its cache file, path + ".meshcache"
+	//Only parses the OBJ when the cache is missing or its source hash does not match
+	//and then optimizes it, simplifies it into levels of detail, splits every level into meshlets and writes a new cache
+	//What the optimization did is printed to std::cerr, so the output of the benchmark on std::cout stays clean
+	bool LoadOBJ(const std::string& path, IndexedMesh& mesh, bool flipAxisAndWinding = true, ThreadPool* pThreadPool = nullptr);
+}
@@ -0,0 +1,444 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include "Trace.h"
+
+namespace dae
+{
+	namespace
+	{
+		constexpr uint32_t m_InvalidIndex{ std::numeric_limits<uint32_t>::max() };
+		//A cluster is split further where its first triangles already reach this ratio of the cache misses of the whole cluster
+		constexpr float m_OverdrawClusterThreshold{ 1.05f };
+		//Width and height of every view of the overdraw analysis
+		constexpr int m_OverdrawViewSize{ 256 };
+
+		//FIFO cache as timestamps, a vertex is cached while fewer than cacheSize misses happened after its own
+		class VertexCache final
+		{
+		public:
+			VertexCache(size_t vertexCount, uint32_t cacheSize) :
+				m_Timestamps(vertexCount, 0),
+				m_CacheSize{ cacheSize },
+				m_Time{ cacheSize + 1 }
+			{}
+
+			bool IsCached(uint32_t vertex) const { return m_Time - m_Timestamps[vertex] <= m_CacheSize; }
+			uint32_t GetAge(uint32_t vertex) const { return m_Time - m_Timestamps[vertex]; }
+
+			//Returns true on a miss
+			bool Use(uint32_t vertex)
+			{
+				if (IsCached(vertex)) return false;
+				m_Timestamps[vertex] = m_Time++;
+				return true;
+			}
+
+			//Every vertex is out of the cache afterwards
+			void Flush() { m_Time += m_CacheSize + 1; }
+
+		private:
+			std::vector<uint32_t> m_Timestamps{};
+			uint32_t m_CacheSize{};
+			uint32_t m_Time{};
+		};
+
+		//For every vertex, the triangles that use it
+		struct VertexAdjacency
+		{
+			//Triangles of vertex v are triangles[offsets[v]] up to triangles[offsets[v + 1]]
+			std::vector<uint32_t> offsets{};
+			std::vector<uint32_t> triangles{};
+		};
+
+		VertexAdjacency BuildAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount)
+		{
+			VertexAdjacency adjacency{};
+			adjacency.offsets.assign(vertexCount + 1, 0);
+			for (const uint32_t index : indices) ++adjacency.offsets[index + 1];
+			std::partial_sum(adjacency.offsets.begin(), adjacency.offsets.end(), adjacency.offsets.begin());
+
+			std::vector<uint32_t> fill{ adjacency.offsets.begin(), adjacency.offsets.end() - 1 };
+			adjacency.triangles.resize(indices.size());
+			for (uint32_t index{}; index < indices.size(); ++index)
+			{
+				adjacency.triangles[fill[indices[index]]++] = index / 3;
+			}
+			return adjacency;
+		}
+
+		//Triangles with a repeated vertex or without area never cover a sample
+		uint32_t RemoveDegenerateTriangles(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+		{
+			size_t writeIdx{};
+			for (size_t index{}; index < indices.size(); index += 3)
+			{
+				const uint32_t i0{ indices[index] };
+				const uint32_t i1{ indices[index + 1] };
+				const uint32_t i2{ indices[index + 2] };
+				if (i0 == i1 || i1 == i2 || i0 == i2) continue;
+
+				//Exact, Vector3 compares with a tolerance that would also drop small triangles
+				const Vector3& p0{ vertices[i0].position };
+				const Vector3 normal{ Vector3::Cross(vertices[i1].position - p0, vertices[i2].position - p0) };
+				if (normal.x == 0.f && normal.y == 0.f && normal.z == 0.f) continue;
+
+				indices[writeIdx++] = i0;
+				indices[writeIdx++] = i1;
+				indices[writeIdx++] = i2;
+			}
+
+			const uint32_t removedCount{ static_cast<uint32_t>((indices.size() - writeIdx) / 3) };
+			indices.resize(writeIdx);
+			return removedCount;
+		}
+
+		//Tipsify, Sander et al. 2007: emits the fans of the vertices that are most likely still cached
+		//Every restart from a dead end begins a new cluster, clusters holds the first triangle of each of them
+		std::vector<uint32_t> OptimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize, std::vector<uint32_t>& clusters)
+		{
+			const VertexAdjacency adjacency{ BuildAdjacency(indices, vertexCount) };
+
+			std::vector<uint32_t> liveTriangles(vertexCount);
+			for (size_t vertex{}; vertex < vertexCount; ++vertex)
+			{
+				liveTriangles[vertex] = adjacency.offsets[vertex + 1] - adjacency.offsets[vertex];
+			}
+
+			std::vector<uint8_t> isEmitted(indices.size() / 3);
+			std::vector<uint32_t> deadEnds{};
+			std::vector<uint32_t> candidates{};
+			VertexCache cache{ vertexCount, cacheSize };
+			uint32_t scanCursor{};
+
+			//The most recently used vertex that still has triangles left, otherwise the first one in index order
+			const auto skipDeadEnd = [&]()
+			{
+				while (!deadEnds.empty())
+				{
+					const uint32_t vertex{ deadEnds.back() };
+					deadEnds.pop_back();
+					if (liveTriangles[vertex] > 0) return vertex;
+				}
+				for (; scanCursor < vertexCount; ++scanCursor)
+				{
+					if (liveTriangles[scanCursor] > 0) return scanCursor;
+				}
+				return m_InvalidIndex;
+			};
+
+			std::vector<uint32_t> output{};
+			output.reserve(indices.size());
+			clusters.clear();
+
+			uint32_t fanVertex{ skipDeadEnd() };
+			if (fanVertex != m_InvalidIndex) clusters.push_back(0);
+
+			while (fanVertex != m_InvalidIndex)
+			{
+				candidates.clear();
+				for (uint32_t adjacent{ adjacency.offsets[fanVertex] }; adjacent < adjacency.offsets[fanVertex + 1]; ++adjacent)
+				{
+					const uint32_t triangle{ adjacency.triangles[adjacent] };
+					if (isEmitted[triangle]) continue;
+					isEmitted[triangle] = true;
+
+					for (uint32_t corner{}; corner < 3; ++corner)
+					{
+						const uint32_t vertex{ indices[triangle * 3 + corner] };
+						output.push_back(vertex);
+						deadEnds.push_back(vertex);
+						candidates.push_back(vertex);
+						--liveTriangles[vertex];
+						cache.Use(vertex);
+					}
+				}
+
+				//The oldest candidate that is still cached after its own fan is emitted, else any candidate with triangles left
+				fanVertex = m_InvalidIndex;
+				int bestPriority{ -1 };
+				for (const uint32_t vertex : candidates)
+				{
+					if (liveTriangles[vertex] == 0) continue;
+
+					int priority{};
+					if (cache.GetAge(vertex) + 2 * liveTriangles[vertex] <= cacheSize) priority = static_cast<int>(cache.GetAge(vertex));
+					if (priority > bestPriority)
+					{
+						bestPriority = priority;
+						fanVertex = vertex;
+					}
+				}
+
+				if (fanVertex == m_InvalidIndex)
+				{
+					fanVertex = skipDeadEnd();
+					clusters.push_back(static_cast<uint32_t>(output.size() / 3));
+				}
+			}
+
+			if (!clusters.empty() && clusters.back() == output.size() / 3) clusters.pop_back();
+			return output;
+		}
+
+		//Splits the clusters where their first triangles already reuse the cache about as well as the whole cluster
+		//Smaller clusters sort better for overdraw, the threshold bounds what the split may cost the vertex cache
+		std::vector<uint32_t> SplitClusters(const std::vector<uint32_t>& indices, size_t vertexCount, const std::vector<uint32_t>& clusters, uint32_t cacheSize)
+		{
+			const uint32_t triangleCount{ static_cast<uint32_t>(indices.size() / 3) };
+			VertexCache cache{ vertexCount, cacheSize };
+
+			const auto countMisses = [&](uint32_t triangle)
+			{
+				uint32_t misses{};
+				for (uint32_t corner{}; corner < 3; ++corner) misses += cache.Use(indices[triangle * 3 + corner]);
+				return misses;
+			};
+
+			std::vector<uint32_t> splitClusters{};
+			for (size_t clusterIdx{}; clusterIdx < clusters.size(); ++clusterIdx)
+			{
+				const uint32_t begin{ clusters[clusterIdx] };
+				const uint32_t end{ clusterIdx + 1 < clusters.size() ? clusters[clusterIdx + 1] : triangleCount };
+
+				cache.Flush();
+				uint32_t clusterMisses{};
+				for (uint32_t triangle{ begin }; triangle < end; ++triangle) clusterMisses += countMisses(triangle);
+				const float missesPerTriangle{ static_cast<float>(clusterMisses) / static_cast<float>(end - begin) * m_OverdrawClusterThreshold };
+
+				cache.Flush();
+				splitClusters.push_back(begin);
+				uint32_t splitBegin{ begin };
+				uint32_t splitMisses{};
+				for (uint32_t triangle{ begin }; triangle < end; ++triangle)
+				{
+					splitMisses += countMisses(triangle);
+
+					const bool isLast{ triangle + 1 == end };
+					if (!isLast && static_cast<float>(splitMisses) <= missesPerTriangle * static_cast<float>(triangle + 1 - splitBegin))
+					{
+						cache.Flush();
+						splitBegin = triangle + 1;
+						splitMisses = 0;
+						splitClusters.push_back(splitBegin);
+					}
+				}
+			}
+			return splitClusters;
+		}
+
+		//Fast triangle reordering for vertex locality and reduced overdraw, Sander et al. 2007
+		//Clusters that lie far out in the direction they face are drawn first, they are the most likely to hide the rest
+		std::vector<uint32_t> SortClustersForOverdraw(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& clusters)
+		{
+			const uint32_t triangleCount{ static_cast<uint32_t>(indices.size() / 3) };
+
+			struct ClusterShape
+			{
+				Vector3 centroid{};
+				Vector3 normal{};
+				float area{};
+			};
+			std::vector<ClusterShape> shapes(clusters.size());
+
+			Vector3 meshCentroid{};
+			float meshArea{};
+			for (size_t clusterIdx{}; clusterIdx < clusters.size(); ++clusterIdx)
+			{
+				const uint32_t end{ clusterIdx + 1 < clusters.size() ? clusters[clusterIdx + 1] : triangleCount };
+				ClusterShape& shape{ shapes[clusterIdx] };
+
+				for (uint32_t triangle{ clusters[clusterIdx] }; triangle < end; ++triangle)
+				{
+					const Vector3& p0{ vertices[indices[triangle * 3]].position };
+					const Vector3& p1{ vertices[indices[triangle * 3 + 1]].position };
+					const Vector3& p2{ vertices[indices[triangle * 3 + 2]].position };
+
+					//Left handed, the cross product of the edges points into the mesh
+					const Vector3 normal{ Vector3::Cross(p2 - p0, p1 - p0) };
+					const float area{ normal.Magnitude() };
+
+					shape.centroid += (p0 + p1 + p2) * (area / 3.f);
+					shape.normal += normal;
+					shape.area += area;
+				}
+
+				meshCentroid += shape.centroid;
+				meshArea += shape.area;
+				if (shape.area > 0.f) shape.centroid /= shape.area;
+			}
+			if (meshArea > 0.f) meshCentroid /= meshArea;
+
+			std::vector<float> sortKeys(clusters.size());
+			for (size_t clusterIdx{}; clusterIdx < clusters.size(); ++clusterIdx)
+			{
+				const ClusterShape& shape{ shapes[clusterIdx] };
+				const float normalLength{ shape.normal.Magnitude() };
+				sortKeys[clusterIdx] = normalLength > 0.f ? Vector3::Dot(shape.centroid - meshCentroid, shape.normal) / normalLength : 0.f;
+			}
+
+			std::vector<uint32_t> order(clusters.size());
+			std::iota(order.begin(), order.end(), 0);
+			std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+			std::vector<uint32_t> output{};
+			output.reserve(indices.size());
+			for (const uint32_t clusterIdx : order)
+			{
+				const uint32_t end{ clusterIdx + 1 < clusters.size() ? clusters[clusterIdx + 1] : triangleCount };
+				output.insert(output.end(), indices.begin() + clusters[clusterIdx] * 3, indices.begin() + end * 3);
+			}
+			return output;
+		}
+
+		//Vertices in the order the triangles first use them, so the clip stage reads them front to back
+		//Vertices no triangle uses are dropped
+		uint32_t OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+		{
+			std::vector<uint32_t> remap(vertices.size(), m_InvalidIndex);
+			std::vector<Vertex> fetchOrder{};
+			fetchOrder.reserve(vertices.size());
+
+			for (uint32_t& index : indices)
+			{
+				if (remap[index] == m_InvalidIndex)
+				{
+					remap[index] = static_cast<uint32_t>(fetchOrder.size());
+					fetchOrder.push_back(vertices[index]);
+				}
+				index = remap[index];
+			}
+
+			const uint32_t unusedCount{ static_cast<uint32_t>(vertices.size() - fetchOrder.size()) };
+			vertices = std::move(fetchOrder);
+			return unusedCount;
+		}
+	}
+
+	VertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+	{
+		VertexCacheStatistics statistics{};
+		if (indices.empty()) return statistics;
+
+		VertexCache cache{ vertexCount, cacheSize };
+		for (const uint32_t index : indices) statistics.misses += cache.Use(index);
+
+		statistics.acmr = static_cast<float>(statistics.misses) / static_cast<float>(indices.size() / 3);
+		statistics.atvr = vertexCount > 0 ? static_cast<float>(statistics.misses) / static_cast<float>(vertexCount) : 0.f;
+		return statistics;
+	}
+
+	OverdrawStatistics AnalyzeOverdraw(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		const TraceZone zone{ "Analyze overdraw" };
+
+		OverdrawStatistics statistics{};
+		if (vertices.empty()) return statistics;
+
+		Vector3 boundsMin{ vertices.front().position };
+		Vector3 boundsMax{ vertices.front().position };
+		for (const Vertex& vertex : vertices)
+		{
+			boundsMin = Vector3::Min(boundsMin, vertex.position);
+			boundsMax = Vector3::Max(boundsMax, vertex.position);
+		}
+
+		std::vector<float> depthBuffer(m_OverdrawViewSize * m_OverdrawViewSize);
+		for (int axis{}; axis < 3; ++axis)
+		{
+			//The view plane spans the other two axes, both share one scale so the mesh keeps its proportions
+			const int axisU{ (axis + 1) % 3 };
+			const int axisV{ (axis + 2) % 3 };
+			const float extent{ std::max(boundsMax[axisU] - boundsMin[axisU], boundsMax[axisV] - boundsMin[axisV]) };
+			const float scale{ extent > 0.f ? (m_OverdrawViewSize - 1) / extent : 0.f };
+
+			for (const float viewDirection : { 1.f, -1.f })
+			{
+				std::fill(depthBuffer.begin(), depthBuffer.end(), std::numeric_limits<float>::infinity());
+
+				for (size_t index{}; index + 2 < indices.size(); index += 3)
+				{
+					const Vector3& p0{ vertices[indices[index]].position };
+					const Vector3& p1{ vertices[indices[index + 1]].position };
+					const Vector3& p2{ vertices[indices[index + 2]].position };
+
+					//Same facing test as the renderer, the view looks down the axis in viewDirection
+					if (Vector3::Cross(p1 - p0, p2 - p0)[axis] * viewDirection <= 0.f) continue;
+
+					//Screen position and depth, smaller depth is closer
+					const auto project = [&](const Vector3& position)
+					{
+						return Vector3{ (position[axisU] - boundsMin[axisU]) * scale, (position[axisV] - boundsMin[axisV]) * scale, position[axis] * viewDirection };
+					};
+					const Vector3 s0{ project(p0) };
+					Vector3 s1{ project(p1) };
+					Vector3 s2{ project(p2) };
+
+					float area{ (s1.x - s0.x) * (s2.y - s0.y) - (s1.y - s0.y) * (s2.x - s0.x) };
+					if (area == 0.f) continue;
+					//Mirrored views flip the winding in the view plane
+					if (area < 0.f)
+					{
+						std::swap(s1, s2);
+						area = -area;
+					}
+
+					const int minX{ std::max(0, static_cast<int>(std::ceil(std::min({ s0.x, s1.x, s2.x }) - 0.5f))) };
+					const int minY{ std::max(0, static_cast<int>(std::ceil(std::min({ s0.y, s1.y, s2.y }) - 0.5f))) };
+					const int maxX{ std::min(m_OverdrawViewSize - 1, static_cast<int>(std::max({ s0.x, s1.x, s2.x }))) };
+					const int maxY{ std::min(m_OverdrawViewSize - 1, static_cast<int>(std::max({ s0.y, s1.y, s2.y }))) };
+
+					for (int y{ minY }; y <= maxY; ++y)
+					{
+						for (int x{ minX }; x <= maxX; ++x)
+						{
+							const float px{ x + 0.5f };
+							const float py{ y + 0.5f };
+							const float w0{ (s2.x - s1.x) * (py - s1.y) - (s2.y - s1.y) * (px - s1.x) };
+							const float w1{ (s0.x - s2.x) * (py - s2.y) - (s0.y - s2.y) * (px - s2.x) };
+							const float w2{ (s1.x - s0.x) * (py - s0.y) - (s1.y - s0.y) * (px - s0.x) };
+							if (w0 < 0.f || w1 < 0.f || w2 < 0.f) continue;
+
+							const float depth{ (w0 * s0.z + w1 * s1.z + w2 * s2.z) / area };
+							float& storedDepth{ depthBuffer[y * m_OverdrawViewSize + x] };
+							if (depth >= storedDepth) continue;
+
+							statistics.pixelsCovered += storedDepth == std::numeric_limits<float>::infinity();
+							++statistics.pixelsShaded;
+							storedDepth = depth;
+						}
+					}
+				}
+			}
+		}
+
+		statistics.overdraw = statistics.pixelsCovered > 0 ? static_cast<float>(statistics.pixelsShaded) / static_cast<float>(statistics.pixelsCovered) : 0.f;
+		return statistics;
+	}
+
+	MeshOptimizationReport OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		const TraceZone zone{ "Optimize mesh" };
+
+		MeshOptimizationReport report{};
+		report.vertexCacheBefore = AnalyzeVertexCache(indices, vertices.size());
+		report.overdrawBefore = AnalyzeOverdraw(vertices, indices);
+
+		report.degenerateTriangles = RemoveDegenerateTriangles(vertices, indices);
+
+		std::vector<uint32_t> clusters{};
+		indices = OptimizeVertexCache(indices, vertices.size(), m_VertexCacheSize, clusters);
+		clusters = SplitClusters(indices, vertices.size(), clusters, m_VertexCacheSize);
+		indices = SortClustersForOverdraw(indices, vertices, clusters);
+
+		report.unusedVertices = OptimizeVertexFetch(vertices, indices);
+
+		report.vertexCacheAfter = AnalyzeVertexCache(indices, vertices.size());
+		report.overdrawAfter = AnalyzeOverdraw(vertices, indices);
+		return report;
+	}
+}
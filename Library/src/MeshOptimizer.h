@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Simulated FIFO post transform cache, misses are vertices the vertex stage would have to transform again
+	struct VertexCacheStatistics
+	{
+		uint32_t misses{};
+		//Average cache miss ratio, misses per triangle, 3 is the worst and about 0.5 the best a regular grid can do
+		float acmr{};
+		//Average transform to vertex ratio, misses per vertex, 1 is the best
+		float atvr{};
+	};
+
+	//The mesh drawn in index order from the six axis directions with back faces culled
+	struct OverdrawStatistics
+	{
+		uint64_t pixelsCovered{};
+		uint64_t pixelsShaded{};
+		//Shaded per covered pixel, 1 when every covered pixel is only shaded once
+		float overdraw{};
+	};
+
+	struct MeshOptimizationReport
+	{
+		uint32_t degenerateTriangles{};
+		uint32_t unusedVertices{};
+		VertexCacheStatistics vertexCacheBefore{};
+		VertexCacheStatistics vertexCacheAfter{};
+		OverdrawStatistics overdrawBefore{};
+		OverdrawStatistics overdrawAfter{};
+	};
+
+	//Entries of the simulated cache, the size of the transform caches the reordering was designed for
+	constexpr uint32_t m_VertexCacheSize{ 16 };
+
+	VertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = m_VertexCacheSize);
+	OverdrawStatistics AnalyzeOverdraw(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+	//Load time optimization of an indexed triangle list, the drawn surface stays the same:
+	//Drops triangles without area, reorders the triangles for the vertex cache (Tipsify),
+	//sorts the resulting clusters so the outside of the mesh is drawn first,
+	//and reorders the vertices in the order the triangles first use them
+	MeshOptimizationReport OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+}
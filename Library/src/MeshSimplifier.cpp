@@ -0,0 +1,396 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <string_view>
+#include <unordered_map>
+
+#include "Trace.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Open edges keep their place with a plane through the edge, weighted above the planes of the triangles
+		constexpr double m_BorderWeight{ 10.0 };
+		//A collapse is rejected when it turns one of the remaining triangles by more than about 75 degrees
+		constexpr float m_MinNormalDot{ 0.25f };
+
+		//Sum of squared distances to a set of planes, the symmetric 4x4 matrix of Garland and Heckbert as its upper triangle
+		struct Quadric
+		{
+			std::array<double, 10> m{};
+
+			static Quadric FromPlane(const Vector3& normal, float distance, double weight)
+			{
+				const double a{ normal.x };
+				const double b{ normal.y };
+				const double c{ normal.z };
+				const double d{ distance };
+				return { { a * a * weight, a * b * weight, a * c * weight, a * d * weight, b * b * weight, b * c * weight, b * d * weight, c * c * weight, c * d * weight, d * d * weight } };
+			}
+
+			Quadric& operator+=(const Quadric& other)
+			{
+				for (size_t idx{}; idx < m.size(); ++idx) m[idx] += other.m[idx];
+				return *this;
+			}
+
+			double Evaluate(const Vector3& point) const
+			{
+				const double x{ point.x };
+				const double y{ point.y };
+				const double z{ point.z };
+				return x * x * m[0] + 2.0 * x * y * m[1] + 2.0 * x * z * m[2] + 2.0 * x * m[3]
+					+ y * y * m[4] + 2.0 * y * z * m[5] + 2.0 * y * m[6]
+					+ z * z * m[7] + 2.0 * z * m[8]
+					+ m[9];
+			}
+		};
+
+		//Moves every vertex at position from onto position to, the versions tell when the entry is out of date
+		struct Collapse
+		{
+			float cost{};
+			uint32_t from{};
+			uint32_t to{};
+			uint32_t fromVersion{};
+			uint32_t toVersion{};
+
+			bool operator>(const Collapse& other) const { return cost > other.cost; }
+		};
+
+		//The attributes the plane of the triangle has at position, extrapolated linearly when it lies outside of the triangle
+		Vertex ExtrapolateVertex(const Vertex& v0, const Vertex& v1, const Vertex& v2, const Vector3& position)
+		{
+			Vertex result{ v0 };
+			result.position = position;
+
+			const Vector3 edge1{ v1.position - v0.position };
+			const Vector3 edge2{ v2.position - v0.position };
+			const Vector3 offset{ position - v0.position };
+			const float d11{ Vector3::Dot(edge1, edge1) };
+			const float d12{ Vector3::Dot(edge1, edge2) };
+			const float d22{ Vector3::Dot(edge2, edge2) };
+			const float denominator{ d11 * d22 - d12 * d12 };
+			if (denominator <= 1e-12f * d11 * d22) return result;
+
+			const float d1{ Vector3::Dot(offset, edge1) };
+			const float d2{ Vector3::Dot(offset, edge2) };
+			const float w1{ (d22 * d1 - d12 * d2) / denominator };
+			const float w2{ (d11 * d2 - d12 * d1) / denominator };
+			const float w0{ 1.f - w1 - w2 };
+
+			const auto normalized = [](const Vector3& v) { return v.SqrMagnitude() > 0.f ? v.Normalized() : v; };
+			result.uv = v0.uv * w0 + v1.uv * w1 + v2.uv * w2;
+			result.normal = normalized(v0.normal * w0 + v1.normal * w1 + v2.normal * w2);
+			result.tangent = normalized(v0.tangent * w0 + v1.tangent * w1 + v2.tangent * w2);
+			return result;
+		}
+
+		class EdgeCollapser final
+		{
+		public:
+			EdgeCollapser(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) :
+				m_Vertices{ vertices },
+				m_Indices{ indices },
+				m_IsTriangleAlive(indices.size() / 3, uint8_t{ true }),
+				m_AliveTriangleCount{ static_cast<uint32_t>(indices.size() / 3) }
+			{
+				WeldPositions();
+				InitializeQuadrics();
+				for (uint32_t triangle{}; triangle < m_IsTriangleAlive.size(); ++triangle)
+				{
+					for (uint32_t corner{}; corner < 3; ++corner)
+					{
+						const uint32_t from{ GetPosition(triangle, corner) };
+						const uint32_t to{ GetPosition(triangle, (corner + 1) % 3) };
+						PushCollapse(from, to);
+						PushCollapse(to, from);
+					}
+				}
+			}
+
+			uint32_t GetAliveTriangleCount() const { return m_AliveTriangleCount; }
+
+			//Collapses the cheapest edges until at most targetTriangleCount triangles are left, false when it ran out of edges first
+			bool CollapseTo(uint32_t targetTriangleCount)
+			{
+				while (m_AliveTriangleCount > targetTriangleCount && !m_Collapses.empty())
+				{
+					const Collapse collapse{ m_Collapses.top() };
+					m_Collapses.pop();
+
+					if (!m_IsPositionAlive[collapse.from] || !m_IsPositionAlive[collapse.to]) continue;
+					if (m_Versions[collapse.from] != collapse.fromVersion || m_Versions[collapse.to] != collapse.toVersion) continue;
+					if (!IsCollapseValid(collapse.from, collapse.to)) continue;
+
+					ApplyCollapse(collapse);
+				}
+				return m_AliveTriangleCount <= targetTriangleCount;
+			}
+
+			//The remaining triangles with only the vertices they use
+			SimplifiedMesh GetMesh() const
+			{
+				SimplifiedMesh mesh{};
+				mesh.error = m_Error;
+				mesh.indices.reserve(static_cast<size_t>(m_AliveTriangleCount) * 3);
+
+				std::vector<uint32_t> remap(m_Vertices.size(), m_InvalidIndex);
+				for (uint32_t triangle{}; triangle < m_IsTriangleAlive.size(); ++triangle)
+				{
+					if (!m_IsTriangleAlive[triangle]) continue;
+					for (uint32_t corner{}; corner < 3; ++corner)
+					{
+						const uint32_t vertex{ m_Indices[triangle * 3 + corner] };
+						if (remap[vertex] == m_InvalidIndex)
+						{
+							remap[vertex] = static_cast<uint32_t>(mesh.vertices.size());
+							mesh.vertices.push_back(m_Vertices[vertex]);
+						}
+						mesh.indices.push_back(remap[vertex]);
+					}
+				}
+				return mesh;
+			}
+
+		private:
+			static constexpr uint32_t m_InvalidIndex{ 0xFFFFFFFF };
+
+			uint32_t GetPosition(uint32_t triangle, uint32_t corner) const { return m_VertexPositions[m_Indices[triangle * 3 + corner]]; }
+
+			bool HasPosition(uint32_t triangle, uint32_t position) const
+			{
+				return GetPosition(triangle, 0) == position || GetPosition(triangle, 1) == position || GetPosition(triangle, 2) == position;
+			}
+
+			void WeldPositions()
+			{
+				std::unordered_map<std::string_view, uint32_t> positionIds{};
+				positionIds.reserve(m_Vertices.size());
+				m_VertexPositions.resize(m_Vertices.size());
+				for (uint32_t vertex{}; vertex < m_Vertices.size(); ++vertex)
+				{
+					//The keys point into the copied vertices, which do not move while the map is alive
+					const std::string_view key{ reinterpret_cast<const char*>(&m_Vertices[vertex].position), sizeof(Vector3) };
+					const auto [it, isNew] { positionIds.try_emplace(key, static_cast<uint32_t>(m_Positions.size())) };
+					if (isNew)
+					{
+						m_Positions.push_back(m_Vertices[vertex].position);
+						m_PositionVertices.emplace_back();
+					}
+					m_VertexPositions[vertex] = it->second;
+					m_PositionVertices[it->second].push_back(vertex);
+				}
+
+				m_PositionTriangles.resize(m_Positions.size());
+				for (uint32_t triangle{}; triangle < m_IsTriangleAlive.size(); ++triangle)
+				{
+					for (uint32_t corner{}; corner < 3; ++corner) m_PositionTriangles[GetPosition(triangle, corner)].push_back(triangle);
+				}
+				m_IsPositionAlive.assign(m_Positions.size(), uint8_t{ true });
+				m_Versions.assign(m_Positions.size(), 0);
+			}
+
+			void InitializeQuadrics()
+			{
+				m_Quadrics.resize(m_Positions.size());
+
+				//Edges with a single triangle are open, counted by their welded positions
+				std::unordered_map<uint64_t, uint32_t> edgeTriangleCounts{};
+				edgeTriangleCounts.reserve(m_Indices.size());
+				const auto getEdgeKey = [](uint32_t a, uint32_t b) { return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b); };
+				for (uint32_t triangle{}; triangle < m_IsTriangleAlive.size(); ++triangle)
+				{
+					for (uint32_t corner{}; corner < 3; ++corner) ++edgeTriangleCounts[getEdgeKey(GetPosition(triangle, corner), GetPosition(triangle, (corner + 1) % 3))];
+				}
+
+				for (uint32_t triangle{}; triangle < m_IsTriangleAlive.size(); ++triangle)
+				{
+					const std::array<uint32_t, 3> positions{ GetPosition(triangle, 0), GetPosition(triangle, 1), GetPosition(triangle, 2) };
+					const Vector3 normal{ Vector3::Cross(m_Positions[positions[1]] - m_Positions[positions[0]], m_Positions[positions[2]] - m_Positions[positions[0]]) };
+					if (normal.SqrMagnitude() == 0.f) continue;
+
+					const Vector3 unitNormal{ normal.Normalized() };
+					const Quadric plane{ Quadric::FromPlane(unitNormal, -Vector3::Dot(unitNormal, m_Positions[positions[0]]), 1.0) };
+					for (const uint32_t position : positions) m_Quadrics[position] += plane;
+
+					for (uint32_t corner{}; corner < 3; ++corner)
+					{
+						const uint32_t start{ positions[corner] };
+						const uint32_t end{ positions[(corner + 1) % 3] };
+						if (edgeTriangleCounts[getEdgeKey(start, end)] != 1) continue;
+
+						//Perpendicular to the triangle through the open edge
+						const Vector3 edgeNormal{ Vector3::Cross(m_Positions[end] - m_Positions[start], unitNormal) };
+						if (edgeNormal.SqrMagnitude() == 0.f) continue;
+						const Vector3 unitEdgeNormal{ edgeNormal.Normalized() };
+						const Quadric border{ Quadric::FromPlane(unitEdgeNormal, -Vector3::Dot(unitEdgeNormal, m_Positions[start]), m_BorderWeight) };
+						m_Quadrics[start] += border;
+						m_Quadrics[end] += border;
+					}
+				}
+			}
+
+			void PushCollapse(uint32_t from, uint32_t to)
+			{
+				Quadric quadric{ m_Quadrics[from] };
+				quadric += m_Quadrics[to];
+				const float cost{ static_cast<float>(std::max(quadric.Evaluate(m_Positions[to]), 0.0)) };
+				m_Collapses.push({ cost, from, to, m_Versions[from], m_Versions[to] });
+			}
+
+			bool IsCollapseValid(uint32_t from, uint32_t to) const
+			{
+				//The third corners of the triangles on the edge, and every other neighbour of from
+				std::vector<uint32_t> edgeNeighbours{};
+				std::vector<uint32_t> fromNeighbours{};
+				for (const uint32_t triangle : m_PositionTriangles[from])
+				{
+					if (!m_IsTriangleAlive[triangle]) continue;
+
+					const bool isOnEdge{ HasPosition(triangle, to) };
+					for (uint32_t corner{}; corner < 3; ++corner)
+					{
+						const uint32_t position{ GetPosition(triangle, corner) };
+						if (position == from || position == to) continue;
+						(isOnEdge ? edgeNeighbours : fromNeighbours).push_back(position);
+					}
+					if (isOnEdge) continue;
+
+					//The triangle keeps its shape when it does not turn much
+					const std::array<uint32_t, 3> positions{ GetPosition(triangle, 0), GetPosition(triangle, 1), GetPosition(triangle, 2) };
+					std::array<Vector3, 3> points{ m_Positions[positions[0]], m_Positions[positions[1]], m_Positions[positions[2]] };
+					const Vector3 normalBefore{ Vector3::Cross(points[1] - points[0], points[2] - points[0]) };
+					for (uint32_t corner{}; corner < 3; ++corner)
+					{
+						if (positions[corner] == from) points[corner] = m_Positions[to];
+					}
+					const Vector3 normalAfter{ Vector3::Cross(points[1] - points[0], points[2] - points[0]) };
+					if (Vector3::Dot(normalBefore, normalAfter) <= m_MinNormalDot * normalBefore.Magnitude() * normalAfter.Magnitude()) return false;
+				}
+				if (edgeNeighbours.empty()) return false;
+
+				//Link condition: a neighbour both positions share outside of the edge would end up with two triangles on one edge
+				for (const uint32_t triangle : m_PositionTriangles[to])
+				{
+					if (!m_IsTriangleAlive[triangle] || HasPosition(triangle, from)) continue;
+					for (uint32_t corner{}; corner < 3; ++corner)
+					{
+						const uint32_t position{ GetPosition(triangle, corner) };
+						if (position == to || std::find(edgeNeighbours.begin(), edgeNeighbours.end(), position) != edgeNeighbours.end()) continue;
+						if (std::find(fromNeighbours.begin(), fromNeighbours.end(), position) != fromNeighbours.end()) return false;
+					}
+				}
+				return true;
+			}
+
+			void ApplyCollapse(const Collapse& collapse)
+			{
+				const uint32_t from{ collapse.from };
+				const uint32_t to{ collapse.to };
+
+				//Triangles on the edge disappear, the others keep their vertices which move onto to
+				std::vector<uint32_t> keptTriangles{};
+				for (const uint32_t triangle : m_PositionTriangles[from])
+				{
+					if (!m_IsTriangleAlive[triangle]) continue;
+					if (HasPosition(triangle, to))
+					{
+						m_IsTriangleAlive[triangle] = false;
+						--m_AliveTriangleCount;
+						continue;
+					}
+					keptTriangles.push_back(triangle);
+				}
+
+				//Every vertex takes its attributes from one of the triangles it keeps, before any of them moves
+				std::vector<Vertex> movedVertices{};
+				movedVertices.reserve(m_PositionVertices[from].size());
+				for (const uint32_t vertex : m_PositionVertices[from])
+				{
+					Vertex moved{ m_Vertices[vertex] };
+					moved.position = m_Positions[to];
+					for (const uint32_t triangle : keptTriangles)
+					{
+						const uint32_t* pCorners{ &m_Indices[triangle * 3] };
+						const auto corner{ std::find(pCorners, pCorners + 3, vertex) };
+						if (corner == pCorners + 3) continue;
+
+						const uint32_t cornerIdx{ static_cast<uint32_t>(corner - pCorners) };
+						moved = ExtrapolateVertex(m_Vertices[vertex], m_Vertices[pCorners[(cornerIdx + 1) % 3]], m_Vertices[pCorners[(cornerIdx + 2) % 3]], m_Positions[to]);
+						break;
+					}
+					movedVertices.push_back(moved);
+				}
+				for (size_t movedIdx{}; movedIdx < movedVertices.size(); ++movedIdx)
+				{
+					const uint32_t vertex{ m_PositionVertices[from][movedIdx] };
+					m_Vertices[vertex] = movedVertices[movedIdx];
+					m_VertexPositions[vertex] = to;
+					m_PositionVertices[to].push_back(vertex);
+				}
+
+				std::vector<uint32_t>& toTriangles{ m_PositionTriangles[to] };
+				std::erase_if(toTriangles, [this](uint32_t triangle) { return !m_IsTriangleAlive[triangle]; });
+				toTriangles.insert(toTriangles.end(), keptTriangles.begin(), keptTriangles.end());
+
+				m_Quadrics[to] += m_Quadrics[from];
+				m_IsPositionAlive[from] = false;
+				m_PositionVertices[from].clear();
+				m_PositionTriangles[from].clear();
+				++m_Versions[to];
+				m_Error = std::max(m_Error, std::sqrt(collapse.cost));
+
+				//Every edge of to changed cost
+				for (const uint32_t triangle : toTriangles)
+				{
+					for (uint32_t corner{}; corner < 3; ++corner)
+					{
+						const uint32_t position{ GetPosition(triangle, corner) };
+						if (position == to) continue;
+						PushCollapse(to, position);
+						PushCollapse(position, to);
+					}
+				}
+			}
+
+			std::vector<Vertex> m_Vertices{};
+			std::vector<uint32_t> m_Indices{};
+			std::vector<uint8_t> m_IsTriangleAlive{};
+			uint32_t m_AliveTriangleCount{};
+
+			//Welded positions, every vertex refers to one of them
+			std::vector<Vector3> m_Positions{};
+			std::vector<uint32_t> m_VertexPositions{};
+			std::vector<std::vector<uint32_t>> m_PositionVertices{};
+			//Can still hold triangles that died since, they are skipped
+			std::vector<std::vector<uint32_t>> m_PositionTriangles{};
+			std::vector<uint8_t> m_IsPositionAlive{};
+			std::vector<Quadric> m_Quadrics{};
+			//Bumped when the quadric or the triangles of a position change
+			std::vector<uint32_t> m_Versions{};
+
+			std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> m_Collapses{};
+			float m_Error{};
+		};
+	}
+
+	std::vector<SimplifiedMesh> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, std::span<const uint32_t> targetTriangleCounts)
+	{
+		const TraceZone zone{ "Simplify mesh" };
+
+		std::vector<SimplifiedMesh> meshes{};
+		EdgeCollapser collapser{ vertices, indices };
+		for (const uint32_t targetTriangleCount : targetTriangleCounts)
+		{
+			if (!collapser.CollapseTo(targetTriangleCount)) break;
+			meshes.push_back(collapser.GetMesh());
+		}
+		return meshes;
+	}
+}
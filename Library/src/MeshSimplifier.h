@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//A simplified version of an indexed triangle list
+	struct SimplifiedMesh
+	{
+		std::vector<Vertex> vertices{};
+		std::vector<uint32_t> indices{};
+		//Upper bound on the distance between the simplified and the original surface, in the units of the positions
+		float error{};
+	};
+
+	//Quadric error metric simplification (Garland and Heckbert) with half edge collapses, every vertex moves onto a neighbour
+	//Vertices at the same position collapse together, so seams of the normals and uvs do not stop the simplification
+	//A moved vertex takes the attributes the triangles it keeps have at its new position
+	//Returns one mesh per target triangle count, in the order of the targets which have to decrease
+	//Stops early when no edge can collapse anymore without flipping a triangle, so fewer meshes than targets can come back
+	std::vector<SimplifiedMesh> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, std::span<const uint32_t> targetTriangleCounts);
+}
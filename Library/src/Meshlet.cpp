@@ -0,0 +1,193 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <string_view>
+#include <unordered_map>
+
+#include "Trace.h"
+
+namespace dae
+{
+	namespace
+	{
+		constexpr uint32_t m_InvalidIndex{ std::numeric_limits<uint32_t>::max() };
+		//A meshlet is closed when its best neighbour faces further away from its average normal, about 25 degrees
+		//Wider cones hardly ever cull, faceted meshes therefore get meshlets well below the maximum size
+		constexpr float m_MeshletNormalThreshold{ 0.9f };
+		//Below this the normal cone is wider than about 85 degrees and can hardly ever cull
+		constexpr float m_MinConeDot{ 0.1f };
+
+		//Unit normal pointing out of the mesh, zero for a triangle without area
+		//Left handed, the cross product of the edges points into the mesh
+		Vector3 GetOutwardNormal(const std::vector<Vertex>& vertices, const uint32_t* pTriangle)
+		{
+			const Vector3& p0{ vertices[pTriangle[0]].position };
+			const Vector3 normal{ Vector3::Cross(vertices[pTriangle[2]].position - p0, vertices[pTriangle[1]].position - p0) };
+			const float length{ normal.Magnitude() };
+			return length > 0.f ? normal / length : Vector3{};
+		}
+
+		void ComputeMeshletBounds(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, Meshlet& meshlet)
+		{
+			//Sphere around the center of the bounding box, a little larger than the smallest sphere but cheap and stable
+			Vector3 boundsMin{ vertices[meshlet.vertexOffset].position };
+			Vector3 boundsMax{ boundsMin };
+			for (uint32_t vertex{ meshlet.vertexOffset }; vertex < meshlet.vertexOffset + meshlet.vertexCount; ++vertex)
+			{
+				boundsMin = Vector3::Min(boundsMin, vertices[vertex].position);
+				boundsMax = Vector3::Max(boundsMax, vertices[vertex].position);
+			}
+
+			meshlet.center = (boundsMin + boundsMax) * 0.5f;
+			for (uint32_t vertex{ meshlet.vertexOffset }; vertex < meshlet.vertexOffset + meshlet.vertexCount; ++vertex)
+			{
+				meshlet.radius = std::max(meshlet.radius, (vertices[vertex].position - meshlet.center).Magnitude());
+			}
+
+			Vector3 normalSum{};
+			for (uint32_t triangle{}; triangle < meshlet.triangleCount; ++triangle)
+			{
+				normalSum += GetOutwardNormal(vertices, &indices[meshlet.indexOffset + triangle * 3]);
+			}
+
+			const float normalLength{ normalSum.Magnitude() };
+			if (normalLength == 0.f) return;
+			meshlet.coneAxis = normalSum / normalLength;
+
+			//The widest angle between the axis and a normal, triangles without area face nowhere and are skipped
+			float minDot{ 1.f };
+			for (uint32_t triangle{}; triangle < meshlet.triangleCount; ++triangle)
+			{
+				const Vector3 normal{ GetOutwardNormal(vertices, &indices[meshlet.indexOffset + triangle * 3]) };
+				if (normal.x != 0.f || normal.y != 0.f || normal.z != 0.f) minDot = std::min(minDot, Vector3::Dot(meshlet.coneAxis, normal));
+			}
+			meshlet.coneCutoff = minDot <= m_MinConeDot ? 1.f : std::sqrt(1.f - minDot * minDot);
+		}
+	}
+
+	std::vector<Meshlet> BuildMeshlets(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		const TraceZone zone{ "Build meshlets" };
+
+		const uint32_t triangleCount{ static_cast<uint32_t>(indices.size() / 3) };
+		std::vector<Vector3> normals(triangleCount);
+		for (uint32_t triangle{}; triangle < triangleCount; ++triangle)
+		{
+			normals[triangle] = GetOutwardNormal(vertices, &indices[triangle * 3]);
+		}
+
+		//Triangles are neighbours when they share a position, vertices with other attributes still connect them
+		std::vector<uint32_t> positionIds(vertices.size());
+		{
+			std::unordered_map<std::string_view, uint32_t> positionIndices{};
+			positionIndices.reserve(vertices.size());
+			for (size_t vertex{}; vertex < vertices.size(); ++vertex)
+			{
+				const std::string_view key{ reinterpret_cast<const char*>(&vertices[vertex].position), sizeof(Vector3) };
+				positionIds[vertex] = positionIndices.try_emplace(key, static_cast<uint32_t>(positionIndices.size())).first->second;
+			}
+		}
+
+		std::vector<uint32_t> adjacencyOffsets(vertices.size() + 1);
+		for (const uint32_t index : indices) ++adjacencyOffsets[positionIds[index] + 1];
+		std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+		std::vector<uint32_t> adjacentTriangles(indices.size());
+		{
+			std::vector<uint32_t> fill{ adjacencyOffsets.begin(), adjacencyOffsets.end() - 1 };
+			for (uint32_t index{}; index < indices.size(); ++index) adjacentTriangles[fill[positionIds[indices[index]]]++] = index / 3;
+		}
+
+		//Grow every meshlet from its first triangle over its neighbours, always taking the one that faces most like the meshlet
+		//Seeds follow the triangle order, so the meshlets come out roughly in the overdraw order of the mesh optimizer
+		std::vector<Meshlet> meshlets{};
+		std::vector<uint32_t> meshletIndices{};
+		meshletIndices.reserve(indices.size());
+		std::vector<uint8_t> isAssigned(triangleCount);
+		std::vector<uint32_t> candidates{};
+		uint32_t seed{};
+		while (true)
+		{
+			while (seed < triangleCount && isAssigned[seed]) ++seed;
+			if (seed == triangleCount) break;
+
+			Meshlet& meshlet{ meshlets.emplace_back(Meshlet{ .indexOffset{ static_cast<uint32_t>(meshletIndices.size()) } }) };
+			Vector3 normalSum{};
+			candidates.assign(1, seed);
+
+			while (meshlet.triangleCount < m_MeshletMaxTriangles && !candidates.empty())
+			{
+				const Vector3 averageNormal{ normalSum.Normalized() };
+				size_t bestCandidate{};
+				float bestDot{ -2.f };
+				for (size_t candidate{}; candidate < candidates.size(); ++candidate)
+				{
+					const float dot{ meshlet.triangleCount == 0 ? 1.f : Vector3::Dot(averageNormal, normals[candidates[candidate]]) };
+					if (dot > bestDot)
+					{
+						bestDot = dot;
+						bestCandidate = candidate;
+					}
+				}
+				if (bestDot < m_MeshletNormalThreshold) break;
+
+				const uint32_t triangle{ candidates[bestCandidate] };
+				candidates[bestCandidate] = candidates.back();
+				candidates.pop_back();
+
+				isAssigned[triangle] = true;
+				meshletIndices.insert(meshletIndices.end(), indices.begin() + triangle * 3, indices.begin() + triangle * 3 + 3);
+				++meshlet.triangleCount;
+				normalSum += normals[triangle];
+
+				for (uint32_t corner{}; corner < 3; ++corner)
+				{
+					const uint32_t positionId{ positionIds[indices[triangle * 3 + corner]] };
+					for (uint32_t adjacent{ adjacencyOffsets[positionId] }; adjacent < adjacencyOffsets[positionId + 1]; ++adjacent)
+					{
+						const uint32_t neighbour{ adjacentTriangles[adjacent] };
+						if (isAssigned[neighbour] || std::find(candidates.begin(), candidates.end(), neighbour) != candidates.end()) continue;
+						candidates.push_back(neighbour);
+					}
+				}
+			}
+		}
+		indices = std::move(meshletIndices);
+
+		//Give every meshlet its own vertex range, in the order its triangles first use them
+		std::vector<Vertex> meshletVertices{};
+		meshletVertices.reserve(vertices.size());
+		std::vector<uint32_t> remap(vertices.size(), m_InvalidIndex);
+		for (Meshlet& meshlet : meshlets)
+		{
+			meshlet.vertexOffset = static_cast<uint32_t>(meshletVertices.size());
+			for (uint32_t index{ meshlet.indexOffset }; index < meshlet.indexOffset + meshlet.triangleCount * 3; ++index)
+			{
+				uint32_t& newIndex{ remap[indices[index]] };
+				if (newIndex == m_InvalidIndex || newIndex < meshlet.vertexOffset)
+				{
+					newIndex = static_cast<uint32_t>(meshletVertices.size());
+					meshletVertices.push_back(vertices[indices[index]]);
+				}
+				indices[index] = newIndex;
+			}
+			meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size()) - meshlet.vertexOffset;
+		}
+		vertices = std::move(meshletVertices);
+
+		for (Meshlet& meshlet : meshlets)
+		{
+			ComputeMeshletBounds(vertices, indices, meshlet);
+		}
+		return meshlets;
+	}
+
+	bool IsMeshletBackFacing(const Meshlet& meshlet, const Vector3& cameraPosition)
+	{
+		//Every point of the sphere is seen within 90 degrees minus the cone angle of the axis, so every triangle is seen from behind
+		const Vector3 toCenter{ meshlet.center - cameraPosition };
+		return Vector3::Dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * toCenter.Magnitude() + meshlet.radius;
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	constexpr uint32_t m_MeshletMaxTriangles{ 128 };
+
+	//Splits an indexed triangle list into meshlets of neighbouring triangles that face about the same way
+	//The triangles are regrouped per meshlet, and the vertices rewritten so every meshlet owns a contiguous range
+	//A vertex that two meshlets share is duplicated
+	std::vector<Meshlet> BuildMeshlets(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+	//True when every triangle of the meshlet faces away from the camera, cameraPosition is in object space
+	//Only valid for object to world transforms that do not mirror, those flip which side of a triangle is the front
+	bool IsMeshletBackFacing(const Meshlet& meshlet, const Vector3& cameraPosition);
+}
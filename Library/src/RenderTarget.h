@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+
+namespace dae
+{
+	//32 bit pixels with 8 bits per channel, named from the most to the least significant byte of the pixel
+	//On little endian machines ABGR8888 is R, G, B, A in memory, which is what most image writers expect
+	enum class PixelFormat
+	{
+		XRGB8888,
+		ARGB8888,
+		XBGR8888,
+		ABGR8888
+	};
+
+	//Where every channel of a PixelFormat lives in the pixel, formats without alpha leave the unused byte zero
+	struct PixelLayout
+	{
+		uint32_t redShift{};
+		uint32_t greenShift{};
+		uint32_t blueShift{};
+		uint32_t alphaMask{};
+
+		uint32_t Pack(uint8_t r, uint8_t g, uint8_t b) const
+		{
+			return static_cast<uint32_t>(r) << redShift | static_cast<uint32_t>(g) << greenShift | static_cast<uint32_t>(b) << blueShift | alphaMask;
+		}
+	};
+
+	constexpr PixelLayout GetPixelLayout(PixelFormat format)
+	{
+		switch (format)
+		{
+		case PixelFormat::XRGB8888: return { 16, 8, 0, 0 };
+		case PixelFormat::ARGB8888: return { 16, 8, 0, 0xFF000000 };
+		case PixelFormat::XBGR8888: return { 0, 8, 16, 0 };
+		case PixelFormat::ABGR8888: return { 0, 8, 16, 0xFF000000 };
+		}
+		return {};
+	}
+
+	//Memory the renderer presents its frames into, owned by the caller
+	//Can be a window surface, a mapped image or a plain heap buffer, the renderer does not care
+	struct RenderTarget
+	{
+		int width{};
+		int height{};
+		PixelFormat format{ PixelFormat::XRGB8888 };
+		void* pPixels{};
+		//Bytes between the start of two rows, at least width * 4 and a multiple of 4
+		int pitch{};
+	};
+}
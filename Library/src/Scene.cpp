@@ -0,0 +1,194 @@
+#include "Scene.h"
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+#include "AssetManager.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+namespace dae
+{
+	namespace
+	{
+		using Clock = std::chrono::steady_clock;
+
+		float GetMilliseconds(Clock::time_point start)
+		{
+			return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+		}
+
+		//The whole text has to be the number
+		bool ParseFloat(const std::string& text, float& value)
+		{
+			const char* pEnd{ text.data() + text.size() };
+			const auto [pLast, error] { std::from_chars(text.data(), pEnd, value) };
+			return error == std::errc{} && pLast == pEnd;
+		}
+
+		//Names of one kind of entry, in the order they were declared
+		class NameTable final
+		{
+		public:
+			bool Add(const std::string& name)
+			{
+				return m_Indices.emplace(name, static_cast<uint32_t>(m_Indices.size())).second;
+			}
+
+			bool Find(const std::string& name, uint32_t& index) const
+			{
+				const auto it{ m_Indices.find(name) };
+				if (it == m_Indices.end()) return false;
+
+				index = it->second;
+				return true;
+			}
+
+		private:
+			std::unordered_map<std::string, uint32_t> m_Indices{};
+		};
+	}
+
+	bool ParseScene(const std::string& path, SceneDescription& scene)
+	{
+		const TraceZone zone{ "Parse scene" };
+
+		std::ifstream file{ path };
+		if (!file)
+		{
+			std::cerr << "Could not open scene " << path << std::endl;
+			return false;
+		}
+
+		scene = {};
+		NameTable textureNames{};
+		NameTable meshNames{};
+		NameTable materialNames{};
+
+		std::string line{};
+		for (int lineNumber{ 1 }; std::getline(file, line); ++lineNumber)
+		{
+			line = line.substr(0, line.find('#'));
+			std::istringstream stream{ line };
+
+			std::string keyword{};
+			if (!(stream >> keyword)) continue;
+
+			bool isValid{};
+			if (keyword == "camera")
+			{
+				isValid = static_cast<bool>(stream >> scene.cameraOrigin.x >> scene.cameraOrigin.y >> scene.cameraOrigin.z >> scene.cameraFovAngle);
+			}
+			else if (keyword == "light")
+			{
+				isValid = static_cast<bool>(stream >> scene.lightDirection.x >> scene.lightDirection.y >> scene.lightDirection.z >> scene.lightIntensity);
+			}
+			else if (keyword == "texture" || keyword == "mesh")
+			{
+				SceneAsset asset{};
+				isValid = stream >> asset.name >> asset.path && (keyword == "texture" ? textureNames : meshNames).Add(asset.name);
+				(keyword == "texture" ? scene.textures : scene.meshes).push_back(std::move(asset));
+			}
+			else if (keyword == "material")
+			{
+				SceneMaterial material{};
+				std::string diffuse{}, normal{}, specular{}, glossiness{};
+				isValid = stream >> material.name >> diffuse >> normal >> specular >> glossiness
+					&& textureNames.Find(diffuse, material.diffuse) && textureNames.Find(normal, material.normal)
+					&& textureNames.Find(specular, material.specular) && textureNames.Find(glossiness, material.glossiness)
+					&& materialNames.Add(material.name);
+				scene.materials.push_back(std::move(material));
+			}
+			else if (keyword == "object")
+			{
+				SceneObject object{};
+				std::string mesh{}, material{};
+				Vector3 position{};
+				isValid = stream >> mesh >> material >> position.x >> position.y >> position.z
+					&& meshNames.Find(mesh, object.mesh) && materialNames.Find(material, object.material);
+
+				//The rotation and the scale are optional, but a rotation has all three angles and a scale needs the rotation
+				//Read as words, a number that fails to parse would otherwise just end the line
+				std::vector<std::string> optionals{};
+				for (std::string word{}; optionals.size() < 5 && stream >> word;) optionals.push_back(std::move(word));
+
+				Vector3 rotation{};
+				float scale{ 1.f };
+				isValid = isValid && (optionals.empty() || optionals.size() == 3 || optionals.size() == 4);
+				for (size_t optionalIdx{}; isValid && optionalIdx < optionals.size(); ++optionalIdx)
+				{
+					isValid = ParseFloat(optionals[optionalIdx], optionalIdx < 3 ? rotation[static_cast<int>(optionalIdx)] : scale);
+				}
+				object.worldMatrix = Matrix::CreateScale(scale, scale, scale) * Matrix::CreateRotation(rotation * TO_RADIANS) * Matrix::CreateTranslation(position);
+				scene.objects.push_back(object);
+			}
+
+			//Anything left on the line is a mistake as well
+			std::string rest{};
+			if (!isValid || stream >> rest)
+			{
+				std::cerr << path << "(" << lineNumber << "): invalid line " << line << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool LoadSceneAssets(const SceneDescription& scene, AssetManager& assetManager, ThreadPool& threadPool, LoadedScene& loaded)
+	{
+		const TraceZone zone{ "Load scene assets" };
+		const Clock::time_point start{ Clock::now() };
+
+		const int textureCount{ static_cast<int>(scene.textures.size()) };
+		const int assetCount{ textureCount + static_cast<int>(scene.meshes.size()) };
+		loaded.textures.clear();
+		loaded.textures.resize(scene.textures.size());
+		loaded.meshes.clear();
+		loaded.meshes.resize(scene.meshes.size());
+		loaded.loadTimes.assign(assetCount, {});
+
+		//Textures first, the jobs are handed out in order and decoding a texture takes longer than reading a cached mesh
+		std::atomic<bool> isLoaded{ true };
+		threadPool.ParallelFor(assetCount, [&](int assetIdx, uint32_t)
+		{
+			const Clock::time_point assetStart{ Clock::now() };
+			const bool isTexture{ assetIdx < textureCount };
+			const SceneAsset& asset{ isTexture ? scene.textures[assetIdx] : scene.meshes[assetIdx - textureCount] };
+
+			bool isAssetLoaded{};
+			if (isTexture)
+			{
+				loaded.textures[assetIdx] = assetManager.LoadTexture(asset.path);
+				isAssetLoaded = loaded.textures[assetIdx] != nullptr;
+			}
+			else
+			{
+				loaded.meshes[assetIdx - textureCount] = assetManager.LoadMesh(asset.path);
+				isAssetLoaded = loaded.meshes[assetIdx - textureCount] != nullptr;
+			}
+
+			if (!isAssetLoaded) isLoaded = false;
+			loaded.loadTimes[assetIdx] = { asset.path, GetMilliseconds(assetStart) };
+		});
+
+		loaded.totalMilliseconds = GetMilliseconds(start);
+		return isLoaded;
+	}
+
+	void PrintAssetLoadTimes(const LoadedScene& loaded)
+	{
+		float sumMilliseconds{};
+		for (const AssetLoadTime& loadTime : loaded.loadTimes)
+		{
+			std::cerr << "  " << std::fixed << std::setprecision(2) << std::setw(8) << loadTime.milliseconds << " ms  " << loadTime.path << "\n";
+			sumMilliseconds += loadTime.milliseconds;
+		}
+		std::cerr << "Loaded " << loaded.loadTimes.size() << " assets in " << loaded.totalMilliseconds << " ms, " << sumMilliseconds << " ms one after the other" << std::defaultfloat << std::endl;
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Maths.h"
+
+namespace dae
+{
+	class AssetManager;
+	class Texture;
+	class ThreadPool;
+	struct Mesh;
+
+	struct SceneAsset
+	{
+		std::string name{};
+		std::string path{};
+	};
+
+	//Indices into the textures of the scene
+	struct SceneMaterial
+	{
+		std::string name{};
+		uint32_t diffuse{};
+		uint32_t normal{};
+		uint32_t specular{};
+		uint32_t glossiness{};
+	};
+
+	//A mesh placed in the world with a material, indices into the meshes and materials of the scene
+	struct SceneObject
+	{
+		uint32_t mesh{};
+		uint32_t material{};
+		Matrix worldMatrix{};
+	};
+
+	//What a scene file lists, without loading any of it
+	struct SceneDescription
+	{
+		Vector3 cameraOrigin{};
+		//Vertical, in degrees
+		float cameraFovAngle{ 60.f };
+
+		//The direction the light travels in
+		Vector3 lightDirection{ .577f, -.577f, .577f };
+		float lightIntensity{ 7.f };
+
+		std::vector<SceneAsset> textures{};
+		std::vector<SceneAsset> meshes{};
+		std::vector<SceneMaterial> materials{};
+		std::vector<SceneObject> objects{};
+	};
+
+	//Text file with one entry per line, # starts a comment and names refer to entries above them
+	//  camera X Y Z FOV
+	//  light X Y Z INTENSITY
+	//  texture NAME PATH
+	//  material NAME DIFFUSE NORMAL SPECULAR GLOSSINESS
+	//  mesh NAME PATH
+	//  object MESH MATERIAL X Y Z [PITCH YAW ROLL [SCALE]]
+	//Angles are in degrees, paths are relative to the working directory
+	//Returns false and prints the line to std::cerr when the file can not be read or a line is malformed
+	bool ParseScene(const std::string& path, SceneDescription& scene);
+
+	struct AssetLoadTime
+	{
+		std::string path{};
+		float milliseconds{};
+	};
+
+	//Handles to the assets of a scene in the order of its description
+	struct LoadedScene
+	{
+		std::vector<std::shared_ptr<const Texture>> textures{};
+		std::vector<std::shared_ptr<const Mesh>> meshes{};
+
+		//One per texture and mesh, measured inside its job
+		std::vector<AssetLoadTime> loadTimes{};
+		float totalMilliseconds{};
+	};
+
+	//Loads every texture and mesh as its own job on the pool, so loading takes as long as the slowest asset and not the sum of them
+	//A mesh parses on the single thread of its job, as the other threads are busy with the other assets
+	//Assets that are already resident in the manager are handed out again, their load time is that of the lookup
+	//Returns false when any asset failed to load
+	bool LoadSceneAssets(const SceneDescription& scene, AssetManager& assetManager, ThreadPool& threadPool, LoadedScene& loaded);
+	//To std::cerr, so the output of the benchmark on std::cout stays clean
+	void PrintAssetLoadTimes(const LoadedScene& loaded);
+}
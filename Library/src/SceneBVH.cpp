@@ -0,0 +1,130 @@
+#include "SceneBVH.h"
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+
+namespace dae
+{
+	void SceneBVH::Build(std::span<const BoundingBox> objectBounds)
+	{
+		const uint32_t objectCount{ static_cast<uint32_t>(objectBounds.size()) };
+		m_SlotObjects.resize(objectCount);
+		std::iota(m_SlotObjects.begin(), m_SlotObjects.end(), 0u);
+		m_ObjectLeaves.assign(objectCount, m_InvalidNode);
+
+		//A binary tree with leaves of at least half the maximum has fewer than this many nodes
+		m_Nodes.clear();
+		m_Parents.clear();
+		m_Nodes.reserve(objectCount / (m_MaxLeafObjects / 2) * 2 + 1);
+		m_Parents.reserve(m_Nodes.capacity());
+		if (objectCount > 0) BuildNode(objectBounds, 0, objectCount, m_InvalidNode);
+
+		m_ObjectBounds.resize(objectCount);
+		m_ObjectSlots.resize(objectCount);
+		for (uint32_t slot{}; slot < objectCount; ++slot)
+		{
+			m_ObjectBounds[slot] = objectBounds[m_SlotObjects[slot]];
+			m_ObjectSlots[m_SlotObjects[slot]] = slot;
+		}
+
+		for (uint32_t nodeIdx{ static_cast<uint32_t>(m_Nodes.size()) }; nodeIdx-- > 0;)
+		{
+			RefitNode(nodeIdx);
+		}
+		m_IsNodeDirty.assign(m_Nodes.size(), uint8_t{});
+		m_DirtyNodes.clear();
+	}
+
+	uint32_t SceneBVH::BuildNode(std::span<const BoundingBox> objectBounds, uint32_t begin, uint32_t end, uint32_t parent)
+	{
+		const uint32_t nodeIdx{ static_cast<uint32_t>(m_Nodes.size()) };
+		m_Nodes.emplace_back();
+		m_Parents.push_back(parent);
+
+		if (end - begin <= m_MaxLeafObjects)
+		{
+			m_Nodes[nodeIdx].first = begin;
+			m_Nodes[nodeIdx].objectCount = end - begin;
+			for (uint32_t slot{ begin }; slot < end; ++slot) m_ObjectLeaves[m_SlotObjects[slot]] = nodeIdx;
+			return nodeIdx;
+		}
+
+		//Split along the longest axis of the centers, not of the boxes, so large objects do not decide the axis alone
+		const Vector3 firstCenter{ objectBounds[m_SlotObjects[begin]].GetCenter() };
+		BoundingBox centerBounds{ firstCenter, firstCenter };
+		for (uint32_t slot{ begin + 1 }; slot < end; ++slot)
+		{
+			const Vector3 center{ objectBounds[m_SlotObjects[slot]].GetCenter() };
+			centerBounds.Grow({ center, center });
+		}
+		const Vector3 size{ centerBounds.max - centerBounds.min };
+		const int axis{ size.x >= size.y && size.x >= size.z ? 0 : size.y >= size.z ? 1 : 2 };
+
+		//The median keeps the tree balanced, so its depth is logarithmic whatever the distribution of the objects
+		const uint32_t middle{ begin + (end - begin) / 2 };
+		std::nth_element(m_SlotObjects.begin() + begin, m_SlotObjects.begin() + middle, m_SlotObjects.begin() + end,
+			[objectBounds, axis](uint32_t left, uint32_t right)
+			{
+				return objectBounds[left].GetCenter()[axis] < objectBounds[right].GetCenter()[axis];
+			});
+
+		BuildNode(objectBounds, begin, middle, nodeIdx);
+		m_Nodes[nodeIdx].first = BuildNode(objectBounds, middle, end, nodeIdx);
+		return nodeIdx;
+	}
+
+	void SceneBVH::UpdateObject(uint32_t object, const BoundingBox& bounds)
+	{
+		m_ObjectBounds[m_ObjectSlots[object]] = bounds;
+
+		//Stops at a node that is already marked, the nodes above it are marked as well
+		for (uint32_t nodeIdx{ m_ObjectLeaves[object] }; nodeIdx != m_InvalidNode && !m_IsNodeDirty[nodeIdx]; nodeIdx = m_Parents[nodeIdx])
+		{
+			m_IsNodeDirty[nodeIdx] = true;
+			m_DirtyNodes.push_back(nodeIdx);
+		}
+	}
+
+	void SceneBVH::Refit()
+	{
+		//Children come after their parent, so the highest index first refits every child before its parent
+		//When a large part of the tree moved, walking all nodes backwards is cheaper than sorting the marked ones
+		if (m_DirtyNodes.size() * m_SortedRefitRatio < m_Nodes.size())
+		{
+			std::sort(m_DirtyNodes.begin(), m_DirtyNodes.end(), std::greater<>{});
+			for (const uint32_t nodeIdx : m_DirtyNodes)
+			{
+				RefitNode(nodeIdx);
+				m_IsNodeDirty[nodeIdx] = false;
+			}
+		}
+		else
+		{
+			for (uint32_t nodeIdx{ static_cast<uint32_t>(m_Nodes.size()) }; nodeIdx-- > 0;)
+			{
+				if (!m_IsNodeDirty[nodeIdx]) continue;
+				RefitNode(nodeIdx);
+				m_IsNodeDirty[nodeIdx] = false;
+			}
+		}
+		m_DirtyNodes.clear();
+	}
+
+	void SceneBVH::RefitNode(uint32_t nodeIdx)
+	{
+		Node& node{ m_Nodes[nodeIdx] };
+		if (node.objectCount == 0)
+		{
+			node.bounds = m_Nodes[nodeIdx + 1].bounds;
+			node.bounds.Grow(m_Nodes[node.first].bounds);
+			return;
+		}
+
+		node.bounds = m_ObjectBounds[node.first];
+		for (uint32_t slot{ node.first + 1 }; slot < node.first + node.objectCount; ++slot)
+		{
+			node.bounds.Grow(m_ObjectBounds[slot]);
+		}
+	}
+}
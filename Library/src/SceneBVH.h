@@ -0,0 +1,132 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "DataTypes.h"
+#include "Frustum.h"
+
+namespace dae
+{
+	//Bounding volume hierarchy over the world bounds of the objects of a scene
+	//Objects are referred to by the index of their bounds in Build
+	//Moving objects keep their place in the tree, only the boxes above them are refit
+	class SceneBVH final
+	{
+	public:
+		//Objects per leaf, a leaf tests its objects one by one instead of splitting further
+		static constexpr uint32_t m_MaxLeafObjects{ 4 };
+
+		//Splits the objects at the median of their centers along the longest axis, until a leaf holds few enough
+		void Build(std::span<const BoundingBox> objectBounds);
+
+		//Stores the new bounds and marks the nodes above the object, Refit updates them
+		//The tree keeps the grouping of Build, after objects moved far it tests more boxes and should be built again
+		void UpdateObject(uint32_t object, const BoundingBox& bounds);
+		//Recomputes the marked nodes children first, the cost grows with the moved objects and not with the scene
+		void Refit();
+
+		//Calls visit(object) for every object whose bounds are not outside of the frustum
+		//A node inside of a plane is not tested against that plane again below it, a node inside of all planes visits its objects without tests
+		//Returns the number of box tests, which grows with the visible objects and the depth of the tree
+		template<typename TVisit>
+		uint32_t Query(const Frustum& frustum, TVisit&& visit) const;
+
+		uint32_t GetObjectCount() const { return static_cast<uint32_t>(m_ObjectBounds.size()); }
+		uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_Nodes.size()); }
+		const BoundingBox& GetObjectBounds(uint32_t object) const { return m_ObjectBounds[m_ObjectSlots[object]]; }
+		//Bounds of the whole scene, empty when there are no objects
+		BoundingBox GetBounds() const { return m_Nodes.empty() ? BoundingBox{} : m_Nodes.front().bounds; }
+
+	private:
+		static constexpr uint32_t m_InvalidNode{ 0xFFFFFFFF };
+		//Deeper than a median split of any object count that fits in memory can get
+		static constexpr uint32_t m_MaxDepth{ 64 };
+		static constexpr uint8_t m_AllPlanes{ 0b111111 };
+		//Refit sorts the marked nodes while fewer than one in this many is marked
+		static constexpr size_t m_SortedRefitRatio{ 16 };
+
+		//Nodes are stored depth first, the left child directly follows its parent, so every child comes after its parent
+		struct Node
+		{
+			BoundingBox bounds{};
+			//Index of the right child, or of the first slot of its objects for a leaf
+			uint32_t first{};
+			//Zero for an inner node
+			uint32_t objectCount{};
+		};
+
+		uint32_t BuildNode(std::span<const BoundingBox> objectBounds, uint32_t begin, uint32_t end, uint32_t parent);
+		void RefitNode(uint32_t node);
+
+		std::vector<Node> m_Nodes{};
+		std::vector<uint32_t> m_Parents{};
+		//The objects are stored in slots in leaf order, so every leaf reads a contiguous range of bounds
+		std::vector<uint32_t> m_SlotObjects{};
+		std::vector<BoundingBox> m_ObjectBounds{};
+		//Per object, its slot and the leaf holding it
+		std::vector<uint32_t> m_ObjectSlots{};
+		std::vector<uint32_t> m_ObjectLeaves{};
+
+		std::vector<uint8_t> m_IsNodeDirty{};
+		std::vector<uint32_t> m_DirtyNodes{};
+	};
+
+	//-------------------------------------------------------------------------------
+	//Template implementations
+
+	template<typename TVisit>
+	uint32_t SceneBVH::Query(const Frustum& frustum, TVisit&& visit) const
+	{
+		if (m_Nodes.empty()) return 0;
+
+		uint32_t boxTests{};
+		//The mask has a bit per frustum plane the box still has to be tested against
+		//Returns false when the box is outside, and clears the bits of the planes the box is inside of
+		const auto testBox = [&frustum, &boxTests](const BoundingBox& box, uint8_t& planeMask)
+		{
+			++boxTests;
+			const Vector3 center{ box.GetCenter() };
+			const Vector3 extents{ box.GetExtents() };
+			for (uint32_t planeIdx{}; planeIdx < frustum.planes.size(); ++planeIdx)
+			{
+				if (!(planeMask & (1 << planeIdx))) continue;
+
+				const Vector4& plane{ frustum.planes[planeIdx] };
+				const float reach{ std::abs(plane.x) * extents.x + std::abs(plane.y) * extents.y + std::abs(plane.z) * extents.z };
+				const float distance{ Vector3::Dot(plane.GetXYZ(), center) + plane.w };
+				if (distance < -reach) return false;
+				if (distance >= reach) planeMask &= ~(1 << planeIdx);
+			}
+			return true;
+		};
+
+		std::array<std::pair<uint32_t, uint8_t>, m_MaxDepth> stack{};
+		uint32_t stackSize{};
+		stack[stackSize++] = { 0, m_AllPlanes };
+		while (stackSize > 0)
+		{
+			auto [nodeIdx, planeMask] { stack[--stackSize] };
+			const Node& node{ m_Nodes[nodeIdx] };
+			if (planeMask != 0 && !testBox(node.bounds, planeMask)) continue;
+
+			if (node.objectCount == 0)
+			{
+				//Left last, so it is visited first and the objects come out in leaf order
+				stack[stackSize++] = { node.first, planeMask };
+				stack[stackSize++] = { nodeIdx + 1, planeMask };
+				continue;
+			}
+
+			for (uint32_t slot{ node.first }; slot < node.first + node.objectCount; ++slot)
+			{
+				uint8_t objectPlaneMask{ planeMask };
+				if (objectPlaneMask == 0 || testBox(m_ObjectBounds[slot], objectPlaneMask)) visit(m_SlotObjects[slot]);
+			}
+		}
+		return boxTests;
+	}
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <concepts>
+#include <type_traits>
+
+#include "Maths.h"
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Varyings are plain structs made out of floats (float, Vector2, Vector3, ...)
+	//The rasterizer interpolates every float of the struct, so a shader only pays for the varyings it declares
+	template<typename T>
+	concept ShaderVaryings =
+		std::is_trivially_copyable_v<T> &&
+		std::is_standard_layout_v<T> &&
+		sizeof(T) % sizeof(float) == 0 &&
+		alignof(T) == alignof(float);
+
+	//Per draw data that is handed to the vertex shader
+	struct DrawConstants
+	{
+		Matrix worldViewProjectionMatrix{};
+		Matrix worldMatrix{};
+		//The parameters of the instance for DrawInstanced, zero for Draw
+		Vector4 instanceParameters{};
+	};
+
+	//A vertex shader declares its Varyings type and returns the clip space position of the vertex
+	//The renderer culls meshes, instances and meshlets with their object space bounds before the vertex stage,
+	//which is only correct when Transform returns vertex.position * constants.worldViewProjectionMatrix
+	//A shader that moves the vertices any other way, for example displaced by the instance parameters,
+	//declares static constexpr bool m_UsesWorldViewProjection{ false } and its draws are only clipped
+	template<typename T>
+	concept VertexShader =
+		ShaderVaryings<typename T::Varyings> &&
+		requires(const T& shader, const DrawConstants& constants, const Vertex& vertex, typename T::Varyings& varyings)
+		{
+			{ shader.Transform(constants, vertex, varyings) } -> std::same_as<Vector4>;
+		};
+
+	//True unless the vertex shader opts out of the culling with the bounds, see VertexShader
+	template<typename T>
+	inline constexpr bool UsesWorldViewProjection{ true };
+
+	template<typename T>
+		requires requires { { T::m_UsesWorldViewProjection } -> std::convertible_to<bool>; }
+	inline constexpr bool UsesWorldViewProjection<T>{ T::m_UsesWorldViewProjection };
+
+	//Screen space derivatives of the varyings, the difference with the neighbouring pixel of the 2x2 quad
+	template<ShaderVaryings TVaryings>
+	struct QuadDerivatives
+	{
+		TVaryings ddx{};
+		TVaryings ddy{};
+	};
+
+	//A pixel shader turns the interpolated varyings of its vertex shader into a color
+	template<typename T, typename TVaryings>
+	concept PixelShaderWithoutDerivatives =
+		ShaderVaryings<TVaryings> &&
+		requires(const T& shader, const TVaryings& varyings)
+		{
+			{ shader.Shade(varyings) } -> std::same_as<ColorRGB>;
+		};
+
+	//Pixel shaders that take derivatives get helper lanes interpolated for them, so only ask for them when needed
+	template<typename T, typename TVaryings>
+	concept PixelShaderWithDerivatives =
+		ShaderVaryings<TVaryings> &&
+		requires(const T& shader, const TVaryings& varyings, const QuadDerivatives<TVaryings>& derivatives)
+		{
+			{ shader.Shade(varyings, derivatives) } -> std::same_as<ColorRGB>;
+		};
+
+	template<typename T, typename TVaryings>
+	concept PixelShader = PixelShaderWithoutDerivatives<T, TVaryings> || PixelShaderWithDerivatives<T, TVaryings>;
+
+	//Interpolated varyings of a batch of fragments, stored as one array per float of the varyings (SoA)
+	//Lanes past count hold data of an earlier batch and are never written to the back buffer
+	template<ShaderVaryings TVaryings, int BatchSize>
+	struct FragmentBatch
+	{
+		static constexpr size_t componentCount{ sizeof(TVaryings) / sizeof(float) };
+		using Components = std::array<std::array<float, BatchSize>, componentCount>;
+
+		//Index of the first float of a member, used as ComponentIndex(offsetof(Varyings, member))
+		static constexpr size_t ComponentIndex(size_t memberOffset) { return memberOffset / sizeof(float); }
+
+		int count{};
+		Components varyings{};
+
+		//Only filled in when the scalar Shade of the pixel shader takes derivatives
+		Components ddx{};
+		Components ddy{};
+	};
+
+	template<int BatchSize>
+	struct ColorBatch
+	{
+		std::array<float, BatchSize> r{};
+		std::array<float, BatchSize> g{};
+		std::array<float, BatchSize> b{};
+	};
+
+	//Pixel shaders can provide a vectorized ShadeBatch next to Shade, the rasterizer then shades in batches
+	template<typename T, typename TVaryings, int BatchSize>
+	concept BatchPixelShader =
+		PixelShader<T, TVaryings> &&
+		requires(const T& shader, const FragmentBatch<TVaryings, BatchSize>& batch, ColorBatch<BatchSize>& colors)
+		{
+			{ shader.ShadeBatch(batch, colors) } -> std::same_as<void>;
+		};
+
+	//Output of the vertex stage
+	template<ShaderVaryings TVaryings>
+	struct Vertex_Out
+	{
+		Vector4 position{};
+		TVaryings varyings{};
+	};
+
+	//Weighted sum of the varyings of a triangle, the weights should already be perspective corrected
+	template<ShaderVaryings TVaryings>
+	TVaryings InterpolateVaryings(const TVaryings& varyings0, const TVaryings& varyings1, const TVaryings& varyings2, float weight0, float weight1, float weight2)
+	{
+		using FloatArray = std::array<float, sizeof(TVaryings) / sizeof(float)>;
+
+		const FloatArray values0{ std::bit_cast<FloatArray>(varyings0) };
+		const FloatArray values1{ std::bit_cast<FloatArray>(varyings1) };
+		const FloatArray values2{ std::bit_cast<FloatArray>(varyings2) };
+
+		FloatArray result;
+		for (size_t i{}; i < result.size(); ++i)
+		{
+			result[i] = values0[i] * weight0 + values1[i] * weight1 + values2[i] * weight2;
+		}
+
+		return std::bit_cast<TVaryings>(result);
+	}
+
+	template<ShaderVaryings TVaryings>
+	TVaryings SubtractVaryings(const TVaryings& varyings0, const TVaryings& varyings1)
+	{
+		return InterpolateVaryings(varyings0, varyings1, varyings1, 1.f, -1.f, 0.f);
+	}
+}
@@ -0,0 +1,221 @@
+#include "Specular.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SPECULAR_SSE 1
+#else
+#define SPECULAR_SSE 0
+#endif
+
+namespace dae
+{
+	//Polynomial fits on Chebyshev nodes
+	//log2(1 + m) for m in [0, 1), max error 1.5e-5
+	constexpr float LOG2_C0{ 1.439093e-05f };
+	constexpr float LOG2_C1{ 1.44159208f };
+	constexpr float LOG2_C2{ -0.707253434f };
+	constexpr float LOG2_C3{ 0.411561482f };
+	constexpr float LOG2_C4{ -0.189832447f };
+	constexpr float LOG2_C5{ 0.0439286278f };
+
+	//exp2(f) for f in [0, 1), max relative error 3.9e-6
+	constexpr float EXP2_C0{ 1.0000036f };
+	constexpr float EXP2_C1{ 0.692969551f };
+	constexpr float EXP2_C2{ 0.241621323f };
+	constexpr float EXP2_C3{ 0.0517177355f };
+	constexpr float EXP2_C4{ 0.0136839829f };
+
+	//Keeps the result a normal float, anything below is 0 for specular purposes
+	constexpr float MIN_EXP2_INPUT{ -126.f };
+
+	float FastPow(float base, float exponent)
+	{
+		if (base <= 0.f) return exponent == 0.f ? 1.f : 0.f;
+
+		//log2(base) = exponent bits + log2(mantissa)
+		const uint32_t baseBits{ std::bit_cast<uint32_t>(base) };
+		const float baseExponent{ static_cast<float>(static_cast<int>(baseBits >> 23) - 127) };
+		const float mantissa{ std::bit_cast<float>((baseBits & 0x007FFFFF) | 0x3F800000) - 1.f };
+		const float log2Base{ baseExponent + mantissa * (LOG2_C1 + mantissa * (LOG2_C2 + mantissa * (LOG2_C3 + mantissa * (LOG2_C4 + mantissa * LOG2_C5)))) + LOG2_C0 };
+
+		//exp2(x) = 2^floor(x) * exp2(fraction)
+		const float x{ std::max(exponent * log2Base, MIN_EXP2_INPUT) };
+		const float whole{ std::floor(x) };
+		const float fraction{ x - whole };
+		const float exp2Fraction{ EXP2_C0 + fraction * (EXP2_C1 + fraction * (EXP2_C2 + fraction * (EXP2_C3 + fraction * EXP2_C4))) };
+		const uint32_t scaleBits{ static_cast<uint32_t>(static_cast<int>(whole) + 127) << 23 };
+
+		return exp2Fraction * std::bit_cast<float>(scaleBits);
+	}
+
+	void FastPow4(const float* pBase, const float* pExponent, float* pResult)
+	{
+#if SPECULAR_SSE
+		const __m128 base{ _mm_loadu_ps(pBase) };
+		const __m128 exponent{ _mm_loadu_ps(pExponent) };
+		const __m128 one{ _mm_set1_ps(1.f) };
+
+		//log2(base)
+		const __m128i baseBits{ _mm_castps_si128(base) };
+		const __m128 baseExponent{ _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(baseBits, 23), _mm_set1_epi32(127))) };
+		const __m128 mantissa{ _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(baseBits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000))), one) };
+
+		__m128 log2Mantissa{ _mm_set1_ps(LOG2_C5) };
+		log2Mantissa = _mm_add_ps(_mm_mul_ps(log2Mantissa, mantissa), _mm_set1_ps(LOG2_C4));
+		log2Mantissa = _mm_add_ps(_mm_mul_ps(log2Mantissa, mantissa), _mm_set1_ps(LOG2_C3));
+		log2Mantissa = _mm_add_ps(_mm_mul_ps(log2Mantissa, mantissa), _mm_set1_ps(LOG2_C2));
+		log2Mantissa = _mm_add_ps(_mm_mul_ps(log2Mantissa, mantissa), _mm_set1_ps(LOG2_C1));
+		log2Mantissa = _mm_add_ps(_mm_mul_ps(log2Mantissa, mantissa), _mm_set1_ps(LOG2_C0));
+		const __m128 log2Base{ _mm_add_ps(baseExponent, log2Mantissa) };
+
+		//exp2(exponent * log2(base)), floor through truncation with a correction for negative values
+		const __m128 x{ _mm_max_ps(_mm_mul_ps(exponent, log2Base), _mm_set1_ps(MIN_EXP2_INPUT)) };
+		const __m128i truncated{ _mm_cvttps_epi32(x) };
+		const __m128 truncatedFloat{ _mm_cvtepi32_ps(truncated) };
+		const __m128 needsCorrection{ _mm_cmpgt_ps(truncatedFloat, x) };
+		const __m128 whole{ _mm_sub_ps(truncatedFloat, _mm_and_ps(needsCorrection, one)) };
+		const __m128 fraction{ _mm_sub_ps(x, whole) };
+
+		__m128 exp2Fraction{ _mm_set1_ps(EXP2_C4) };
+		exp2Fraction = _mm_add_ps(_mm_mul_ps(exp2Fraction, fraction), _mm_set1_ps(EXP2_C3));
+		exp2Fraction = _mm_add_ps(_mm_mul_ps(exp2Fraction, fraction), _mm_set1_ps(EXP2_C2));
+		exp2Fraction = _mm_add_ps(_mm_mul_ps(exp2Fraction, fraction), _mm_set1_ps(EXP2_C1));
+		exp2Fraction = _mm_add_ps(_mm_mul_ps(exp2Fraction, fraction), _mm_set1_ps(EXP2_C0));
+
+		const __m128i scaleBits{ _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(whole), _mm_set1_epi32(127)), 23) };
+		__m128 result{ _mm_mul_ps(exp2Fraction, _mm_castsi128_ps(scaleBits)) };
+
+		//base <= 0 gives 0, except for a 0 exponent which gives 1
+		const __m128 zero{ _mm_setzero_ps() };
+		const __m128 isBaseZero{ _mm_cmple_ps(base, zero) };
+		const __m128 isExponentZero{ _mm_cmpeq_ps(exponent, zero) };
+		const __m128 zeroBaseResult{ _mm_and_ps(isExponentZero, one) };
+		result = _mm_or_ps(_mm_andnot_ps(isBaseZero, result), _mm_and_ps(isBaseZero, zeroBaseResult));
+
+		_mm_storeu_ps(pResult, result);
+#else
+		for (int i{}; i < 4; ++i)
+		{
+			pResult[i] = FastPow(pBase[i], pExponent[i]);
+		}
+#endif
+	}
+
+	SpecularEvaluator::SpecularEvaluator(float maxExponent, SpecularMode mode) :
+		m_Mode{ mode },
+		m_MaxExponent{ maxExponent }
+	{
+		assert(maxExponent > 0.f);
+
+		m_Table.resize(static_cast<size_t>(m_DotResolution) * m_ExponentResolution);
+
+		for (int exponentIdx{}; exponentIdx < m_ExponentResolution; ++exponentIdx)
+		{
+			const float exponent{ m_MaxExponent * static_cast<float>(exponentIdx) / static_cast<float>(m_ExponentResolution - 1) };
+
+			for (int dotIdx{}; dotIdx < m_DotResolution; ++dotIdx)
+			{
+				const float reflectedViewDot{ static_cast<float>(dotIdx) / static_cast<float>(m_DotResolution - 1) };
+				m_Table[exponentIdx * m_DotResolution + dotIdx] = std::pow(reflectedViewDot, exponent);
+			}
+		}
+	}
+
+	float SpecularEvaluator::Evaluate(float reflectedViewDot, float exponent) const
+	{
+		switch (m_Mode)
+		{
+		case SpecularMode::LookupTable:
+			return SampleTable(reflectedViewDot, exponent);
+		case SpecularMode::FastApproximation:
+			return FastPow(reflectedViewDot, exponent);
+		case SpecularMode::Exact:
+		default:
+			return std::pow(reflectedViewDot, exponent);
+		}
+	}
+
+	void SpecularEvaluator::Evaluate(const float* pReflectedViewDot, const float* pExponent, float* pResult, int count) const
+	{
+		int i{};
+		if (m_Mode == SpecularMode::FastApproximation)
+		{
+			for (; i + 4 <= count; i += 4)
+			{
+				FastPow4(pReflectedViewDot + i, pExponent + i, pResult + i);
+			}
+		}
+
+		for (; i < count; ++i)
+		{
+			pResult[i] = Evaluate(pReflectedViewDot[i], pExponent[i]);
+		}
+	}
+
+	float SpecularEvaluator::SampleTable(float reflectedViewDot, float exponent) const
+	{
+		//Bilinear filtered lookup
+		const float dotCoordinate{ std::clamp(reflectedViewDot, 0.f, 1.f) * static_cast<float>(m_DotResolution - 1) };
+		const float exponentCoordinate{ std::clamp(exponent / m_MaxExponent, 0.f, 1.f) * static_cast<float>(m_ExponentResolution - 1) };
+
+		const int dotIdx{ std::min(static_cast<int>(dotCoordinate), m_DotResolution - 2) };
+		const int exponentIdx{ std::min(static_cast<int>(exponentCoordinate), m_ExponentResolution - 2) };
+
+		const float dotFactor{ dotCoordinate - static_cast<float>(dotIdx) };
+		const float exponentFactor{ exponentCoordinate - static_cast<float>(exponentIdx) };
+
+		const float* pRow0{ &m_Table[exponentIdx * m_DotResolution + dotIdx] };
+		const float* pRow1{ pRow0 + m_DotResolution };
+
+		const float value0{ pRow0[0] + (pRow0[1] - pRow0[0]) * dotFactor };
+		const float value1{ pRow1[0] + (pRow1[1] - pRow1[0]) * dotFactor };
+
+		return value0 + (value1 - value0) * exponentFactor;
+	}
+
+	SpecularEvaluator::ErrorReport SpecularEvaluator::MeasureError(SpecularMode mode, uint32_t samplesPerAxis) const
+	{
+		assert(samplesPerAxis > 1);
+
+		ErrorReport report{};
+		report.mode = mode;
+
+		SpecularEvaluator evaluator{ *this };
+		evaluator.SetMode(mode);
+
+		double totalError{};
+		for (uint32_t exponentIdx{}; exponentIdx < samplesPerAxis; ++exponentIdx)
+		{
+			const float exponent{ m_MaxExponent * static_cast<float>(exponentIdx) / static_cast<float>(samplesPerAxis - 1) };
+
+			for (uint32_t dotIdx{}; dotIdx < samplesPerAxis; ++dotIdx)
+			{
+				const float reflectedViewDot{ static_cast<float>(dotIdx) / static_cast<float>(samplesPerAxis - 1) };
+
+				const float error{ std::abs(evaluator.Evaluate(reflectedViewDot, exponent) - std::pow(reflectedViewDot, exponent)) };
+				report.maxAbsoluteError = std::max(report.maxAbsoluteError, error);
+				totalError += error;
+				++report.sampleCount;
+			}
+		}
+
+		report.meanAbsoluteError = static_cast<float>(totalError / report.sampleCount);
+		return report;
+	}
+
+	const char* SpecularEvaluator::GetModeName(SpecularMode mode)
+	{
+		switch (mode)
+		{
+		case SpecularMode::Exact: return "Exact";
+		case SpecularMode::LookupTable: return "LookupTable";
+		case SpecularMode::FastApproximation: return "FastApproximation";
+		}
+		return "Unknown";
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace dae
+{
+	enum class SpecularMode
+	{
+		Exact,
+		LookupTable,
+		FastApproximation
+	};
+
+	//pow(base, exponent) as exp2(exponent * log2(base)) with polynomial log2/exp2
+	//Absolute error stays below 3e-4 for base in [0, 1] and exponent in [0, 25]
+	float FastPow(float base, float exponent);
+
+	//4 wide version of FastPow, processes 4 floats from each array
+	void FastPow4(const float* pBase, const float* pExponent, float* pResult);
+
+	//Evaluates the phong lobe pow(reflectedViewDot, exponent) with a runtime selectable method
+	class SpecularEvaluator final
+	{
+	public:
+		struct ErrorReport
+		{
+			SpecularMode mode{};
+			float maxAbsoluteError{};
+			float meanAbsoluteError{};
+			uint32_t sampleCount{};
+		};
+
+		SpecularEvaluator(float maxExponent, SpecularMode mode = SpecularMode::Exact);
+
+		float Evaluate(float reflectedViewDot, float exponent) const;
+
+		//Evaluates count lobes, count does not need to be a multiple of 4
+		void Evaluate(const float* pReflectedViewDot, const float* pExponent, float* pResult, int count) const;
+
+		SpecularMode GetMode() const { return m_Mode; }
+		void SetMode(SpecularMode mode) { m_Mode = mode; }
+		void CycleMode() { m_Mode = static_cast<SpecularMode>((static_cast<int>(m_Mode) + 1) % 3); }
+		float GetMaxExponent() const { return m_MaxExponent; }
+
+		//Compares a mode against std::pow on a regular grid over [0, 1] x [0, maxExponent]
+		ErrorReport MeasureError(SpecularMode mode, uint32_t samplesPerAxis = 512) const;
+
+		static const char* GetModeName(SpecularMode mode);
+
+	private:
+		float SampleTable(float reflectedViewDot, float exponent) const;
+
+		static constexpr int m_DotResolution{ 256 };
+		static constexpr int m_ExponentResolution{ 64 };
+
+		SpecularMode m_Mode{ SpecularMode::Exact };
+		float m_MaxExponent{};
+
+		//Row per exponent, column per dot
+		std::vector<float> m_Table{};
+	};
+}
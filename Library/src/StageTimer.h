@@ -0,0 +1,93 @@
+#pragma once
+#include <array>
+#include <chrono>
+
+namespace dae
+{
+	enum class RenderStage
+	{
+		Clear,
+		Vertex,
+		Clip,
+		Raster,
+		Shade,
+		Present
+	};
+
+	inline const char* GetRenderStageName(RenderStage stage)
+	{
+		switch (stage)
+		{
+		case RenderStage::Clear: return "clear";
+		case RenderStage::Vertex: return "vertex";
+		case RenderStage::Clip: return "clip";
+		case RenderStage::Raster: return "raster";
+		case RenderStage::Shade: return "shade";
+		case RenderStage::Present: return "present";
+		}
+		return "unknown";
+	}
+
+	//Seconds spent per stage, every thread fills its own so they are aligned to a cache line
+	struct alignas(64) StageTimes
+	{
+		static constexpr int m_StageCount{ 6 };
+
+		std::array<double, m_StageCount> seconds{};
+
+		double& operator[](RenderStage stage) { return seconds[static_cast<int>(stage)]; }
+		double operator[](RenderStage stage) const { return seconds[static_cast<int>(stage)]; }
+
+		StageTimes& operator+=(const StageTimes& other)
+		{
+			for (int stage{}; stage < m_StageCount; ++stage)
+			{
+				seconds[stage] += other.seconds[stage];
+			}
+			return *this;
+		}
+	};
+
+	//Adds the time until it goes out of scope to a stage, does nothing without StageTimes
+	//A nested timer can hand its time over from the enclosing stage, e.g. shading inside the raster loop
+	class ScopedStageTimer final
+	{
+	public:
+		ScopedStageTimer(StageTimes* pTimes, RenderStage stage) :
+			ScopedStageTimer(pTimes, stage, stage)
+		{}
+
+		ScopedStageTimer(StageTimes* pTimes, RenderStage stage, RenderStage enclosingStage) :
+			m_pTimes{ pTimes },
+			m_Stage{ stage },
+			m_EnclosingStage{ enclosingStage }
+		{
+			if (m_pTimes) m_Start = Clock::now();
+		}
+
+		~ScopedStageTimer()
+		{
+			if (!m_pTimes) return;
+
+			const double seconds{ std::chrono::duration<double>(Clock::now() - m_Start).count() };
+			(*m_pTimes)[m_Stage] += seconds;
+			if (m_EnclosingStage != m_Stage)
+			{
+				(*m_pTimes)[m_EnclosingStage] -= seconds;
+			}
+		}
+
+		ScopedStageTimer(const ScopedStageTimer&) = delete;
+		ScopedStageTimer(ScopedStageTimer&&) noexcept = delete;
+		ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+		ScopedStageTimer& operator=(ScopedStageTimer&&) noexcept = delete;
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		StageTimes* m_pTimes{};
+		RenderStage m_Stage{};
+		RenderStage m_EnclosingStage{};
+		Clock::time_point m_Start{};
+	};
+}
@@ -1,16 +1,27 @@
 #include "Texture.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 
+#include "FrameStats.h"
+#include "Trace.h"
 #include "Vector2.h"
 #include <SDL_image.h>
 
 namespace dae
 {
+	namespace
+	{
+		//Per thread, so worker threads can sample the same texture without sharing a counter
+		thread_local uint64_t t_SampleCount{};
+	}
+
 	Texture::Texture(SDL_Surface* pSurface) :
 		m_pSurface{ pSurface },
 		m_pSurfacePixels{ static_cast<uint32_t*>(pSurface->pixels) }
 	{
+		GenerateMipMaps();
 	}
 
 	Texture::~Texture()
@@ -24,6 +35,7 @@ namespace dae
 
 	Texture* Texture::LoadFromFile(const std::string& path)
 	{
+		const TraceZone zone{ "Load texture" };
 		SDL_Surface* pSurface = IMG_Load(path.c_str());
 
 
@@ -36,30 +48,113 @@ namespace dae
 		return new Texture(pSurface);
 	}
 
+	size_t Texture::GetMemorySize() const
+	{
+		return sizeof(Texture) + static_cast<size_t>(m_pSurface->pitch) * m_pSurface->h + m_MipPixels.size() * sizeof(uint32_t) + m_MipLevels.size() * sizeof(MipLevel);
+	}
+
 	ColorRGB Texture::Sample(const Vector2& uv) const
 	{
+		return SampleLevel(uv, 0);
+	}
+
+	ColorRGB Texture::Sample(const Vector2& uv, const Vector2& uvDdx, const Vector2& uvDdy) const
+	{
+		// Footprint of the pixel in texels
+		const float textureWidth{ static_cast<float>(m_MipLevels[0].width) };
+		const float textureHeight{ static_cast<float>(m_MipLevels[0].height) };
+		const Vector2 texelDdx{ uvDdx.x * textureWidth, uvDdx.y * textureHeight };
+		const Vector2 texelDdy{ uvDdy.x * textureWidth, uvDdy.y * textureHeight };
+		const float footprint{ std::max(texelDdx.SqrMagnitude(), texelDdy.SqrMagnitude()) };
+
+		// A footprint of one texel or less uses the full resolution, log2(sqrt(x)) = 0.5 * log2(x)
+		if (footprint <= 1.f) return SampleLevel(uv, 0);
+
+		const float lod{ 0.5f * std::log2(footprint) };
+		return SampleLevel(uv, static_cast<int>(lod + 0.5f));
+	}
+
+	uint64_t Texture::TakeSampleCount()
+	{
+		const uint64_t sampleCount{ t_SampleCount };
+		t_SampleCount = 0;
+		return sampleCount;
+	}
+
+	ColorRGB Texture::SampleLevel(const Vector2& uv, int level) const
+	{
+		if constexpr (FrameStats::m_IsEnabled) ++t_SampleCount;
+
 		//assert if u or v of uv are out of range [0,1]
 		assert(uv.x >= 0.f && uv.x <= 1.f && uv.y >= 0.f && uv.y <= 1.f && "uv out of range [0,1]");
 
-		
+		const MipLevel& mipLevel{ m_MipLevels[std::clamp(level, 0, GetMipLevelCount() - 1)] };
+		const uint32_t* pPixels{ mipLevel.offset == 0 ? m_pSurfacePixels : m_MipPixels.data() + mipLevel.offset };
+
 		Uint8 r{};
 		Uint8 g{};
 		Uint8 b{};
 
-		// Assuming m_pSurface->w and m_pSurface->h don't change
-		const int textureWidth = m_pSurface->w;
-		const int textureHeight = m_pSurface->h;
-		
-		// Round to the nearest integer for pixel coordinates		
-		const int xCord = static_cast<int>(std::lround(static_cast<float>(textureWidth) * uv.x + 0.5f));
-		const int yCord = static_cast<int>(std::lround(static_cast<float>(textureHeight) * uv.y + 0.5f));
+		// Nearest texel, uv 1 maps to the last texel
+		const int xCord{ std::min(static_cast<int>(static_cast<float>(mipLevel.width) * uv.x), mipLevel.width - 1) };
+		const int yCord{ std::min(static_cast<int>(static_cast<float>(mipLevel.height) * uv.y), mipLevel.height - 1) };
 
 		// Get the pixel index
-		const auto surfacePixelIndex = xCord + yCord * textureWidth;
-		const Uint32 pixelIndex{ m_pSurfacePixels[surfacePixelIndex] };
+		const Uint32 pixelIndex{ pPixels[xCord + yCord * mipLevel.width] };
 
 		SDL_GetRGB(pixelIndex, m_pSurface->format, &r, &g, &b);
 
 		return {r / 255.f, g / 255.f, b / 255.f};
 	}
+
+	void Texture::GenerateMipMaps()
+	{
+		m_MipLevels.push_back({ m_pSurface->w, m_pSurface->h, 0 });
+
+		// Count the texels of the smaller levels, offset 0 is reserved for the surface
+		size_t mipPixelCount{ 1 };
+		for (int width{ m_pSurface->w }, height{ m_pSurface->h }; width > 1 || height > 1;)
+		{
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+			m_MipLevels.push_back({ width, height, mipPixelCount });
+			mipPixelCount += static_cast<size_t>(width) * height;
+		}
+		m_MipPixels.resize(mipPixelCount);
+
+		// Every level is a 2x2 box filter of the previous one
+		for (size_t level{ 1 }; level < m_MipLevels.size(); ++level)
+		{
+			const MipLevel& source{ m_MipLevels[level - 1] };
+			const MipLevel& destination{ m_MipLevels[level] };
+			const uint32_t* pSource{ level == 1 ? m_pSurfacePixels : m_MipPixels.data() + source.offset };
+			uint32_t* pDestination{ m_MipPixels.data() + destination.offset };
+
+			for (int y{}; y < destination.height; ++y)
+			{
+				for (int x{}; x < destination.width; ++x)
+				{
+					uint32_t r{}, g{}, b{}, a{};
+					for (int sample{}; sample < 4; ++sample)
+					{
+						const int sourceX{ std::min(x * 2 + (sample & 1), source.width - 1) };
+						const int sourceY{ std::min(y * 2 + (sample >> 1), source.height - 1) };
+
+						Uint8 sampleR{}, sampleG{}, sampleB{}, sampleA{};
+						SDL_GetRGBA(pSource[sourceX + sourceY * source.width], m_pSurface->format, &sampleR, &sampleG, &sampleB, &sampleA);
+						r += sampleR;
+						g += sampleG;
+						b += sampleB;
+						a += sampleA;
+					}
+
+					pDestination[x + y * destination.width] = SDL_MapRGBA(m_pSurface->format,
+						static_cast<Uint8>((r + 2) / 4),
+						static_cast<Uint8>((g + 2) / 4),
+						static_cast<Uint8>((b + 2) / 4),
+						static_cast<Uint8>((a + 2) / 4));
+				}
+			}
+		}
+	}
 }
\ No newline at end of file
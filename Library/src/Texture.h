@@ -1,6 +1,7 @@
 #pragma once
 #include <SDL_surface.h>
 #include <string>
+#include <vector>
 #include "ColorRGB.h"
 
 namespace dae
@@ -15,10 +16,34 @@ namespace dae
 		static Texture* LoadFromFile(const std::string& path);
 		ColorRGB Sample(const Vector2& uv) const;
 
+		//Picks the mip level from the screen space derivatives of the uv
+		ColorRGB Sample(const Vector2& uv, const Vector2& uvDdx, const Vector2& uvDdy) const;
+		ColorRGB SampleLevel(const Vector2& uv, int level) const;
+
+		int GetMipLevelCount() const { return static_cast<int>(m_MipLevels.size()); }
+		//Bytes of the surface and the mip levels
+		size_t GetMemorySize() const;
+
+		//Samples taken by the calling thread since the last call, for the frame statistics
+		static uint64_t TakeSampleCount();
+
 	private:
 		Texture(SDL_Surface* pSurface);
 
+		void GenerateMipMaps();
+
+		struct MipLevel
+		{
+			int width{};
+			int height{};
+			//Offset in m_MipPixels, level 0 lives in the surface
+			size_t offset{};
+		};
+
 		SDL_Surface* m_pSurface{ nullptr };
 		uint32_t* m_pSurfacePixels{ nullptr };
+
+		std::vector<MipLevel> m_MipLevels{};
+		std::vector<uint32_t> m_MipPixels{};
 	};
-}
\ No newline at end of file
+}
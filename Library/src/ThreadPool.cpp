@@ -0,0 +1,103 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <string>
+
+#include "Trace.h"
+
+namespace dae
+{
+	ThreadPool::ThreadPool(uint32_t nrThreads)
+	{
+		if (nrThreads == 0)
+		{
+			nrThreads = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		m_Workers.reserve(nrThreads - 1);
+		for (uint32_t threadIdx{ 1 }; threadIdx < nrThreads; ++threadIdx)
+		{
+			m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, threadIdx);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			const std::lock_guard lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_WorkAvailable.notify_all();
+
+		for (std::thread& worker : m_Workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::ParallelFor(int count, const std::function<void(int index, uint32_t threadIdx)>& job)
+	{
+		if (count <= 0) return;
+
+		//Not worth waking the workers for
+		if (m_Workers.empty() || count == 1)
+		{
+			for (int index{}; index < count; ++index)
+			{
+				job(index, 0);
+			}
+			return;
+		}
+
+		{
+			const std::lock_guard lock{ m_Mutex };
+			m_pJob = &job;
+			m_JobCount = count;
+			m_NextIndex = 0;
+			m_NrBusyWorkers = static_cast<uint32_t>(m_Workers.size());
+			++m_Generation;
+		}
+		m_WorkAvailable.notify_all();
+
+		RunJobs(0);
+
+		const TraceZone zone{ "Wait for workers" };
+		std::unique_lock lock{ m_Mutex };
+		m_WorkDone.wait(lock, [this] { return m_NrBusyWorkers == 0; });
+		m_pJob = nullptr;
+	}
+
+	void ThreadPool::WorkerLoop(uint32_t threadIdx)
+	{
+		Tracer::SetThreadName("Worker " + std::to_string(threadIdx));
+
+		uint32_t generation{};
+
+		while (true)
+		{
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_WorkAvailable.wait(lock, [this, generation] { return m_IsStopping || m_Generation != generation; });
+
+				if (m_IsStopping) return;
+				generation = m_Generation;
+			}
+
+			RunJobs(threadIdx);
+
+			{
+				const std::lock_guard lock{ m_Mutex };
+				--m_NrBusyWorkers;
+			}
+			m_WorkDone.notify_one();
+		}
+	}
+
+	void ThreadPool::RunJobs(uint32_t threadIdx)
+	{
+		for (int index{ m_NextIndex.fetch_add(1) }; index < m_JobCount; index = m_NextIndex.fetch_add(1))
+		{
+			(*m_pJob)(index, threadIdx);
+		}
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	class ThreadPool final
+	{
+	public:
+		//0 uses one thread per hardware thread, the thread that calls ParallelFor counts as one of them
+		explicit ThreadPool(uint32_t nrThreads = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		//Runs job(index, threadIdx) for every index in [0, count) and blocks until all of them are done
+		//Indices are handed out one at a time through an atomic counter, so uneven jobs balance out
+		//threadIdx is in [0, GetThreadCount()), 0 is the calling thread
+		void ParallelFor(int count, const std::function<void(int index, uint32_t threadIdx)>& job);
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()) + 1; }
+
+	private:
+		void WorkerLoop(uint32_t threadIdx);
+		void RunJobs(uint32_t threadIdx);
+
+		std::vector<std::thread> m_Workers{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WorkAvailable{};
+		std::condition_variable m_WorkDone{};
+
+		const std::function<void(int, uint32_t)>* m_pJob{};
+		int m_JobCount{};
+		std::atomic<int> m_NextIndex{};
+
+		//Bumped for every ParallelFor so sleeping workers know there is new work
+		uint32_t m_Generation{};
+		uint32_t m_NrBusyWorkers{};
+		bool m_IsStopping{};
+	};
+}
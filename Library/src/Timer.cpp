@@ -44,6 +44,13 @@ void Timer::Update()
 		return;
 	}
 
+	if (m_FixedElapsedTime > 0.0f)
+	{
+		m_ElapsedTime = m_FixedElapsedTime;
+		m_TotalTime += m_FixedElapsedTime;
+		return;
+	}
+
 	const uint64_t currentTime = SDL_GetPerformanceCounter();
 	m_CurrentTime = currentTime;
 
@@ -72,6 +79,12 @@ void Timer::Update()
 	}
 }
 
+void Timer::SetFixedElapsed(float elapsedSec)
+{
+	m_FixedElapsedTime = elapsedSec;
+	m_TotalTime = 0.0f;
+}
+
 void Timer::Stop()
 {
 	if (!m_IsStopped)
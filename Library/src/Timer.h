@@ -21,6 +21,10 @@ namespace dae
 		void Update();
 		void Stop();
 
+		//Every Update advances the timer by exactly this many seconds instead of reading the clock
+		//Makes anything driven by the timer reproducible, 0 goes back to the clock
+		void SetFixedElapsed(float elapsedSec);
+
 		uint32_t GetFPS() const { return m_FPS; };
 		float GetdFPS() const { return m_dFPS; };
 		float GetElapsed() const { return m_ElapsedTime; };
@@ -46,5 +50,6 @@ namespace dae
 
 		bool m_IsStopped = true;
 		bool m_ForceElapsedUpperBound = false;
+		float m_FixedElapsedTime = 0.0f;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace dae
+{
+	namespace
+	{
+		struct TraceEvent
+		{
+			const char* name{};
+			int64_t start{};
+			int64_t end{};
+			int64_t argument{};
+		};
+
+		//Only the owning thread writes, it publishes every event by bumping head
+		struct ThreadBuffer
+		{
+			static constexpr uint64_t m_Capacity{ 1 << 16 };
+
+			//Allocated on the first zone, so threads that never record stay small
+			std::vector<TraceEvent> events{};
+			std::atomic<uint64_t> head{};
+			//Events before this one were cleared
+			uint64_t firstEvent{};
+
+			uint32_t id{};
+			std::string name{};
+		};
+
+		struct TraceState
+		{
+			std::atomic<bool> isEnabled{};
+
+			//Only taken when a thread records for the first time and when writing
+			std::mutex mutex{};
+			std::vector<std::unique_ptr<ThreadBuffer>> buffers{};
+
+			int captureFramesLeft{};
+			std::string capturePath{};
+		};
+
+		TraceState& GetState()
+		{
+			static TraceState state{};
+			return state;
+		}
+
+		thread_local ThreadBuffer* t_pBuffer{};
+
+		ThreadBuffer& GetThreadBuffer()
+		{
+			if (!t_pBuffer)
+			{
+				TraceState& state{ GetState() };
+				const std::lock_guard lock{ state.mutex };
+
+				auto& pBuffer{ state.buffers.emplace_back(std::make_unique<ThreadBuffer>()) };
+				pBuffer->id = static_cast<uint32_t>(state.buffers.size() - 1);
+				pBuffer->name = "Thread " + std::to_string(pBuffer->id);
+				t_pBuffer = pBuffer.get();
+			}
+			return *t_pBuffer;
+		}
+
+		void WriteEscaped(std::ostream& stream, const std::string& text)
+		{
+			for (const char character : text)
+			{
+				if (character == '"' || character == '\\') stream << '\\';
+				stream << character;
+			}
+		}
+	}
+
+	void Tracer::SetEnabled(bool isEnabled)
+	{
+		GetState().isEnabled.store(isEnabled, std::memory_order_relaxed);
+	}
+
+	bool Tracer::IsEnabled()
+	{
+		return GetState().isEnabled.load(std::memory_order_relaxed);
+	}
+
+	void Tracer::SetThreadName(const std::string& name)
+	{
+		ThreadBuffer& buffer{ GetThreadBuffer() };
+
+		const std::lock_guard lock{ GetState().mutex };
+		buffer.name = name;
+	}
+
+	void Tracer::CaptureFrames(int frameCount, const std::string& path)
+	{
+		Clear();
+
+		TraceState& state{ GetState() };
+		state.captureFramesLeft = frameCount;
+		state.capturePath = path;
+		SetEnabled(frameCount > 0);
+	}
+
+	void Tracer::MarkFrame()
+	{
+		TraceState& state{ GetState() };
+		if (state.captureFramesLeft <= 0 || --state.captureFramesLeft > 0) return;
+
+		SetEnabled(false);
+		if (WriteChromeTrace(state.capturePath))
+		{
+			std::cerr << "Trace written to " << state.capturePath << std::endl;
+		}
+		else
+		{
+			std::cerr << "Could not write trace " << state.capturePath << std::endl;
+		}
+	}
+
+	void Tracer::Record(const char* name, int64_t start, int64_t end, int64_t argument)
+	{
+		ThreadBuffer& buffer{ GetThreadBuffer() };
+		if (buffer.events.empty())
+		{
+			buffer.events.resize(ThreadBuffer::m_Capacity);
+		}
+
+		const uint64_t head{ buffer.head.load(std::memory_order_relaxed) };
+		buffer.events[head & (ThreadBuffer::m_Capacity - 1)] = { name, start, end, argument };
+		buffer.head.store(head + 1, std::memory_order_release);
+	}
+
+	void Tracer::Clear()
+	{
+		TraceState& state{ GetState() };
+		const std::lock_guard lock{ state.mutex };
+
+		for (const auto& pBuffer : state.buffers)
+		{
+			pBuffer->firstEvent = pBuffer->head.load(std::memory_order_acquire);
+		}
+	}
+
+	bool Tracer::WriteChromeTrace(const std::string& path)
+	{
+		TraceState& state{ GetState() };
+		const std::lock_guard lock{ state.mutex };
+
+		std::ofstream file{ path };
+		if (!file) return false;
+		file << std::fixed << std::setprecision(3);
+
+		//Timestamps start at the oldest zone that is still in a buffer
+		int64_t firstTimestamp{ INT64_MAX };
+		for (const auto& pBuffer : state.buffers)
+		{
+			const uint64_t head{ pBuffer->head.load(std::memory_order_acquire) };
+			const uint64_t first{ std::max(pBuffer->firstEvent, head > ThreadBuffer::m_Capacity ? head - ThreadBuffer::m_Capacity : 0) };
+			for (uint64_t event{ first }; event < head; ++event)
+			{
+				firstTimestamp = std::min(firstTimestamp, pBuffer->events[event & (ThreadBuffer::m_Capacity - 1)].start);
+			}
+		}
+
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool isFirst{ true };
+		const auto beginEvent = [&]()
+		{
+			if (!isFirst) file << ",\n";
+			isFirst = false;
+		};
+
+		for (const auto& pBuffer : state.buffers)
+		{
+			beginEvent();
+			file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << pBuffer->id << ",\"args\":{\"name\":\"";
+			WriteEscaped(file, pBuffer->name);
+			file << "\"}}";
+
+			const uint64_t head{ pBuffer->head.load(std::memory_order_acquire) };
+			const uint64_t first{ std::max(pBuffer->firstEvent, head > ThreadBuffer::m_Capacity ? head - ThreadBuffer::m_Capacity : 0) };
+			for (uint64_t eventIdx{ first }; eventIdx < head; ++eventIdx)
+			{
+				const TraceEvent& event{ pBuffer->events[eventIdx & (ThreadBuffer::m_Capacity - 1)] };
+
+				//Complete events in microseconds
+				beginEvent();
+				file << "{\"name\":\"";
+				WriteEscaped(file, event.name);
+				file << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << pBuffer->id
+					<< ",\"ts\":" << static_cast<double>(event.start - firstTimestamp) / 1000.0
+					<< ",\"dur\":" << static_cast<double>(event.end - event.start) / 1000.0;
+				if (event.argument >= 0)
+				{
+					file << ",\"args\":{\"index\":" << event.argument << '}';
+				}
+				file << '}';
+			}
+		}
+
+		file << "\n]}\n";
+		return static_cast<bool>(file);
+	}
+}
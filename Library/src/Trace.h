@@ -0,0 +1,62 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace dae
+{
+	//Timeline of named zones per thread, written as Chrome trace event JSON for chrome://tracing or ui.perfetto.dev
+	//Every thread records into its own ring buffer without locks, the oldest zones are overwritten when it is full
+	//Zone names are not copied, so they have to be string literals
+	class Tracer final
+	{
+	public:
+		static void SetEnabled(bool isEnabled);
+		static bool IsEnabled();
+
+		//Shows up as the name of the calling thread in the timeline
+		static void SetThreadName(const std::string& name);
+
+		//Records the next frameCount frames and writes them to path, frames end at MarkFrame
+		//Whether the file was written is printed to std::cerr, std::cout can hold the benchmark report
+		static void CaptureFrames(int frameCount, const std::string& path);
+		static void MarkFrame();
+
+		//Writes the zones that are still in the ring buffers, call it while no zones are being recorded
+		static bool WriteChromeTrace(const std::string& path);
+		static void Clear();
+
+		static int64_t GetTimestamp() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+		static void Record(const char* name, int64_t start, int64_t end, int64_t argument);
+	};
+
+	//Records the time until it goes out of scope, costs a single check while tracing is off
+	//The optional argument shows up in the zone details, e.g. the index of a tile
+	class TraceZone final
+	{
+	public:
+		explicit TraceZone(const char* name, int64_t argument = -1) :
+			m_Name{ name },
+			m_Argument{ argument },
+			m_IsRecording{ Tracer::IsEnabled() }
+		{
+			if (m_IsRecording) m_Start = Tracer::GetTimestamp();
+		}
+
+		~TraceZone()
+		{
+			if (m_IsRecording) Tracer::Record(m_Name, m_Start, Tracer::GetTimestamp(), m_Argument);
+		}
+
+		TraceZone(const TraceZone&) = delete;
+		TraceZone(TraceZone&&) noexcept = delete;
+		TraceZone& operator=(const TraceZone&) = delete;
+		TraceZone& operator=(TraceZone&&) noexcept = delete;
+
+	private:
+		const char* m_Name{};
+		int64_t m_Argument{};
+		int64_t m_Start{};
+		bool m_IsRecording{};
+	};
+}
@@ -0,0 +1,319 @@
+#include "Utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+namespace dae::Utils
+{
+	namespace
+	{
+		//More chunks than threads, so a chunk with long face lines does not hold up the rest
+		constexpr uint32_t m_ChunksPerThread{ 4 };
+
+		//One corner of a face as 1-based indices into the whole file, 0 when the corner leaves it out
+		struct FaceCorner
+		{
+			uint32_t position{};
+			uint32_t uv{};
+			uint32_t normal{};
+		};
+
+		//Everything one chunk of lines declares, in file order
+		struct ObjChunk
+		{
+			std::vector<Vector3> positions{};
+			std::vector<Vector2> uvs{};
+			std::vector<Vector3> normals{};
+			//Three per face
+			std::vector<FaceCorner> corners{};
+
+			//First vertex of the chunk in the output
+			size_t firstVertex{};
+			bool isValid{ true };
+		};
+
+		//Reads the values of a single line, every read skips the spaces in front of the value
+		class LineReader final
+		{
+		public:
+			LineReader(const char* pBegin, const char* pEnd) :
+				m_pCurrent{ pBegin },
+				m_pEnd{ pEnd }
+			{}
+
+			std::string_view ReadKeyword()
+			{
+				SkipSpaces();
+				const char* pBegin{ m_pCurrent };
+				while (m_pCurrent < m_pEnd && !IsSpace(*m_pCurrent)) ++m_pCurrent;
+				return { pBegin, static_cast<size_t>(m_pCurrent - pBegin) };
+			}
+
+			template<typename T>
+			bool Read(T& value)
+			{
+				SkipSpaces();
+				const auto [pNext, error] { std::from_chars(m_pCurrent, m_pEnd, value) };
+				m_pCurrent = pNext;
+				return error == std::errc{};
+			}
+
+			//position, position/uv, position//normal or position/uv/normal
+			bool ReadCorner(FaceCorner& corner)
+			{
+				if (!Read(corner.position)) return false;
+
+				if (!Skip('/')) return true;
+				if (m_pCurrent < m_pEnd && *m_pCurrent != '/' && !ReadIndex(corner.uv)) return false;
+
+				if (!Skip('/')) return true;
+				return ReadIndex(corner.normal);
+			}
+
+		private:
+			static bool IsSpace(char character) { return character == ' ' || character == '\t' || character == '\r'; }
+
+			void SkipSpaces()
+			{
+				while (m_pCurrent < m_pEnd && IsSpace(*m_pCurrent)) ++m_pCurrent;
+			}
+
+			bool Skip(char character)
+			{
+				if (m_pCurrent >= m_pEnd || *m_pCurrent != character) return false;
+				++m_pCurrent;
+				return true;
+			}
+
+			//An index right after a slash, without spaces in between
+			bool ReadIndex(uint32_t& index)
+			{
+				const auto [pNext, error] { std::from_chars(m_pCurrent, m_pEnd, index) };
+				m_pCurrent = pNext;
+				return error == std::errc{};
+			}
+
+			const char* m_pCurrent{};
+			const char* m_pEnd{};
+		};
+
+		void ParseChunk(std::string_view text, ObjChunk& chunk)
+		{
+			const char* pLine{ text.data() };
+			const char* const pEnd{ text.data() + text.size() };
+
+			while (pLine < pEnd && chunk.isValid)
+			{
+				const char* pLineEnd{ static_cast<const char*>(std::memchr(pLine, '\n', static_cast<size_t>(pEnd - pLine))) };
+				if (!pLineEnd) pLineEnd = pEnd;
+
+				LineReader reader{ pLine, pLineEnd };
+				const std::string_view keyword{ reader.ReadKeyword() };
+
+				//Anything after the values the parser needs is ignored, like a w coordinate
+				if (keyword == "v")
+				{
+					Vector3 position{};
+					chunk.isValid = reader.Read(position.x) && reader.Read(position.y) && reader.Read(position.z);
+					chunk.positions.push_back(position);
+				}
+				else if (keyword == "vt")
+				{
+					float u{};
+					float v{};
+					chunk.isValid = reader.Read(u) && reader.Read(v);
+					chunk.uvs.emplace_back(u, 1 - v);
+				}
+				else if (keyword == "vn")
+				{
+					Vector3 normal{};
+					chunk.isValid = reader.Read(normal.x) && reader.Read(normal.y) && reader.Read(normal.z);
+					chunk.normals.push_back(normal);
+				}
+				else if (keyword == "f")
+				{
+					//Only triangles, the corners after the third one are ignored
+					for (int corner{}; corner < 3 && chunk.isValid; ++corner)
+					{
+						chunk.isValid = reader.ReadCorner(chunk.corners.emplace_back());
+					}
+				}
+
+				pLine = pLineEnd + 1;
+			}
+		}
+
+		//Splits the text in front of a line break, so every chunk holds whole lines
+		std::vector<std::string_view> SplitIntoChunks(std::string_view text, uint32_t maxChunkCount, size_t minChunkSize)
+		{
+			const size_t chunkCount{ std::clamp(text.size() / std::max(minChunkSize, size_t{ 1 }), size_t{ 1 }, static_cast<size_t>(maxChunkCount)) };
+
+			std::vector<std::string_view> chunks{};
+			size_t begin{};
+			for (size_t chunkIdx{ 1 }; chunkIdx <= chunkCount && begin < text.size(); ++chunkIdx)
+			{
+				size_t end{ text.size() };
+				if (chunkIdx < chunkCount)
+				{
+					end = text.find('\n', std::max(begin, text.size() * chunkIdx / chunkCount));
+					end = end == std::string_view::npos ? text.size() : end + 1;
+				}
+
+				chunks.push_back(text.substr(begin, end - begin));
+				begin = end;
+			}
+			return chunks;
+		}
+
+		//Builds the vertices of the faces of one chunk and finishes their tangents
+		//Faces never share vertices, so every chunk writes its own range of the output
+		bool BuildChunkVertices(const ObjChunk& chunk, const std::vector<Vector3>& positions, const std::vector<Vector2>& UVs, const std::vector<Vector3>& normals,
+			std::vector<Vertex>& vertices, bool flipAxisAndWinding)
+		{
+			for (size_t face{}; face < chunk.corners.size() / 3; ++face)
+			{
+				//Like the stream parser did, a corner without uv or normal keeps the one of the previous corner of the face
+				Vertex vertex{};
+				uint32_t tempIndices[3];
+				for (size_t iFace = 0; iFace < 3; iFace++)
+				{
+					// OBJ format uses 1-based arrays
+					const FaceCorner& corner{ chunk.corners[face * 3 + iFace] };
+					if (corner.position == 0 || corner.position > positions.size()) return false;
+					vertex.position = positions[corner.position - 1];
+
+					if (corner.uv != 0)
+					{
+						if (corner.uv > UVs.size()) return false;
+						vertex.uv = UVs[corner.uv - 1];
+					}
+
+					if (corner.normal != 0)
+					{
+						if (corner.normal > normals.size()) return false;
+						vertex.normal = normals[corner.normal - 1];
+					}
+
+					tempIndices[iFace] = static_cast<uint32_t>(chunk.firstVertex + face * 3 + iFace);
+					vertices[tempIndices[iFace]] = vertex;
+				}
+
+				const uint32_t index0 = tempIndices[0];
+				const uint32_t index1 = flipAxisAndWinding ? tempIndices[2] : tempIndices[1];
+				const uint32_t index2 = flipAxisAndWinding ? tempIndices[1] : tempIndices[2];
+
+				//Cheap Tangent Calculations
+				const Vector3& p0 = vertices[index0].position;
+				const Vector3& p1 = vertices[index1].position;
+				const Vector3& p2 = vertices[index2].position;
+				const Vector2& uv0 = vertices[index0].uv;
+				const Vector2& uv1 = vertices[index1].uv;
+				const Vector2& uv2 = vertices[index2].uv;
+
+				const Vector3 edge0 = p1 - p0;
+				const Vector3 edge1 = p2 - p0;
+				const Vector2 diffX = Vector2(uv1.x - uv0.x, uv2.x - uv0.x);
+				const Vector2 diffY = Vector2(uv1.y - uv0.y, uv2.y - uv0.y);
+				float r = 1.f / Vector2::Cross(diffX, diffY);
+
+				const Vector3 tangent = (edge0 * diffY.y - edge1 * diffY.x) * r;
+
+				//Fix the tangents per vertex, every vertex only belongs to this face
+				for (const uint32_t index : tempIndices)
+				{
+					//Added to the zero tangent like the accumulating version did, so -0 becomes 0
+					Vertex& v{ vertices[index] };
+					v.tangent += tangent;
+					v.tangent = Vector3::Reject(v.tangent, v.normal).Normalized();
+
+					if (flipAxisAndWinding)
+					{
+						v.position.z *= -1.f;
+						v.normal.z *= -1.f;
+						v.tangent.z *= -1.f;
+					}
+				}
+			}
+			return true;
+		}
+	}
+
+	bool ParseOBJ(const std::string& filename, std::vector<Vertex>& vertices, bool flipAxisAndWinding, ThreadPool* pThreadPool, size_t minChunkSize)
+	{
+#ifdef DISABLE_OBJ
+		assert(false && "OBJ PARSER not enabled! Check the comments in Utils::ParseOBJ");
+		return false;
+#else
+		const TraceZone zone{ "Parse OBJ" };
+
+		vertices.clear();
+
+		const MappedFile file{ filename };
+		if (!file.IsOpen())
+			return false;
+
+		const uint32_t threadCount{ pThreadPool ? pThreadPool->GetThreadCount() : 1 };
+		const std::vector<std::string_view> texts{ SplitIntoChunks(file.GetView(), threadCount * m_ChunksPerThread, minChunkSize) };
+		std::vector<ObjChunk> chunks(texts.size());
+
+		const auto forEachChunk = [&](const std::function<void(int index, uint32_t threadIdx)>& job)
+		{
+			if (pThreadPool)
+			{
+				pThreadPool->ParallelFor(static_cast<int>(chunks.size()), job);
+				return;
+			}
+			for (int chunkIdx{}; chunkIdx < static_cast<int>(chunks.size()); ++chunkIdx) job(chunkIdx, 0);
+		};
+
+		forEachChunk([&](int chunkIdx, uint32_t)
+		{
+			const TraceZone chunkZone{ "Parse OBJ chunk", chunkIdx };
+			ParseChunk(texts[chunkIdx], chunks[chunkIdx]);
+		});
+
+		//Stitch the chunks together, indices count over the whole file so the attributes are appended in order
+		std::vector<Vector3> positions{};
+		std::vector<Vector2> UVs{};
+		std::vector<Vector3> normals{};
+		size_t vertexCount{};
+		for (ObjChunk& chunk : chunks)
+		{
+			if (!chunk.isValid) return false;
+
+			positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+			UVs.insert(UVs.end(), chunk.uvs.begin(), chunk.uvs.end());
+			normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+
+			chunk.firstVertex = vertexCount;
+			vertexCount += chunk.corners.size();
+		}
+
+		vertices.resize(vertexCount);
+		std::atomic<bool> isValid{ true };
+		forEachChunk([&](int chunkIdx, uint32_t)
+		{
+			const TraceZone chunkZone{ "Build OBJ vertices", chunkIdx };
+			if (!BuildChunkVertices(chunks[chunkIdx], positions, UVs, normals, vertices, flipAxisAndWinding))
+			{
+				isValid.store(false, std::memory_order_relaxed);
+			}
+		});
+
+		if (!isValid)
+		{
+			vertices.clear();
+			return false;
+		}
+		return true;
+#endif
+	}
+}
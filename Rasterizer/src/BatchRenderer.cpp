@@ -0,0 +1,435 @@
+#include "BatchRenderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+
+#include "MathHelpers.h"
+#include "Renderer.h"
+#include "Timer.h"
+#include "Trace.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Reads "value<separator>value<separator>..." and fails on anything else
+		template<typename... Values>
+		bool ParseSeparated(const std::string& text, const char* separators, Values&... values)
+		{
+			std::istringstream stream{ text };
+			int valueIdx{};
+			bool isValid{ true };
+
+			const auto parseValue = [&](auto& value)
+			{
+				if (valueIdx > 0)
+				{
+					char separator{};
+					isValid = isValid && stream >> separator && separator == separators[valueIdx - 1];
+				}
+				isValid = isValid && stream >> value;
+				++valueIdx;
+			};
+			(parseValue(values), ...);
+
+			return isValid && (stream >> std::ws).eof();
+		}
+
+		bool ParseDepthFormat(std::string_view text, DepthFormat& format)
+		{
+			for (int formatIdx{}; formatIdx < 4; ++formatIdx)
+			{
+				if (text == GetDepthFormatName(static_cast<DepthFormat>(formatIdx)))
+				{
+					format = static_cast<DepthFormat>(formatIdx);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool ParseImageFileFormat(std::string_view text, ImageFileFormat& format)
+		{
+			if (text == "bmp") format = ImageFileFormat::BMP;
+			else if (text == "ppm") format = ImageFileFormat::PPM;
+			else if (text == "png") format = ImageFileFormat::PNG;
+			else if (text == "qoi") format = ImageFileFormat::QOI;
+			else return false;
+			return true;
+		}
+
+		//Before the renderer is created, so loading the assets is part of the trace
+		void StartTrace(const BatchSettings& settings)
+		{
+			if (settings.tracePath.empty()) return;
+			Tracer::CaptureFrames(settings.traceFrameCount, settings.tracePath);
+		}
+
+		void ApplyRenderState(Renderer& renderer, const BatchSettings& settings)
+		{
+			renderer.SetMSAA(settings.useMSAA);
+			renderer.SetDeferredTiles(settings.useDeferredTiles);
+			renderer.SetDepthFormat(settings.depthFormat);
+			renderer.SetLods(settings.useLods);
+		}
+
+		void ApplyCameraPath(Renderer& renderer, const BatchSettings& settings, float time)
+		{
+			if (settings.cameraKeyframes.empty()) return;
+
+			const CameraKeyframe pose{ SampleCameraPath(settings.cameraKeyframes, time) };
+			renderer.SetCameraPose(pose.origin, pose.yaw * TO_RADIANS, pose.pitch * TO_RADIANS);
+		}
+
+		//Nearest rank percentile of sorted values
+		double GetPercentile(const std::vector<double>& sortedValues, double percentile)
+		{
+			const size_t rank{ static_cast<size_t>(std::ceil(percentile / 100.0 * static_cast<double>(sortedValues.size()))) };
+			return sortedValues[std::clamp(rank, size_t{ 1 }, sortedValues.size()) - 1];
+		}
+	}
+
+	void PrintBatchUsage()
+	{
+		std::cout <<
+			"Usage: Rasterizer --batch|--benchmark [options]\n"
+			"  --scene FILE                  Scene file, default Resources/vehicle.scene\n"
+			"  --size WIDTHxHEIGHT           Resolution, default 640x480\n"
+			"  --frames COUNT                Number of frames, default 1\n"
+			"  --timestep SECONDS            Scene time between frames, default 1/30\n"
+			"  --rotation DEGREES            Mesh rotation per second around the up axis, default 0\n"
+			"  --camera TIME:X,Y,Z:YAW,PITCH Camera keyframe, angles in degrees, can be repeated\n"
+			"  --format bmp|ppm|png|qoi      Image format, default png\n"
+			"  --output DIRECTORY            Output directory, default Frames\n"
+			"  --msaa                        Render with 4x MSAA\n"
+			"  --immediate                   Render without the tile based deferred mode\n"
+			"  --no-lod                      Always draw the full meshes\n"
+			"  --depth FORMAT                Float32, Unorm16, Unorm24 or ReversedFloat32\n"
+			"  --warmup COUNT                Benchmark frames that are not measured, default 20\n"
+			"  --report FILE                 Benchmark JSON report, default stdout\n"
+			"  --trace FILE                  Chrome trace of the first frames\n"
+			"  --trace-frames COUNT          Frames in the trace, default 10\n";
+	}
+
+	bool ParseBatchSettings(int argc, char* args[], BatchSettings& settings)
+	{
+		for (int argIdx{ 1 }; argIdx < argc; ++argIdx)
+		{
+			const std::string_view option{ args[argIdx] };
+			if (option == "--batch" || option == "--benchmark") continue;
+
+			//Flags without a value
+			if (option == "--msaa")
+			{
+				settings.useMSAA = true;
+				continue;
+			}
+			if (option == "--immediate")
+			{
+				settings.useDeferredTiles = false;
+				continue;
+			}
+			if (option == "--no-lod")
+			{
+				settings.useLods = false;
+				continue;
+			}
+
+			if (argIdx + 1 >= argc)
+			{
+				std::cout << "Missing value for " << option << std::endl;
+				return false;
+			}
+			const std::string value{ args[++argIdx] };
+
+			bool isValid{};
+			if (option == "--scene")
+			{
+				settings.scenePath = value;
+				isValid = !value.empty();
+			}
+			else if (option == "--size")
+			{
+				isValid = ParseSeparated(value, "x", settings.width, settings.height) && settings.width > 0 && settings.height > 0;
+			}
+			else if (option == "--frames")
+			{
+				isValid = ParseSeparated(value, "", settings.frameCount) && settings.frameCount > 0;
+			}
+			else if (option == "--timestep")
+			{
+				isValid = ParseSeparated(value, "", settings.timestep) && settings.timestep > 0.f;
+			}
+			else if (option == "--rotation")
+			{
+				isValid = ParseSeparated(value, "", settings.rotationSpeed);
+			}
+			else if (option == "--camera")
+			{
+				CameraKeyframe keyframe{};
+				isValid = ParseSeparated(value, ":,,:,", keyframe.time, keyframe.origin.x, keyframe.origin.y, keyframe.origin.z, keyframe.yaw, keyframe.pitch);
+				settings.cameraKeyframes.push_back(keyframe);
+			}
+			else if (option == "--format")
+			{
+				isValid = ParseImageFileFormat(value, settings.imageFormat);
+			}
+			else if (option == "--output")
+			{
+				settings.outputDirectory = value;
+				isValid = !value.empty();
+			}
+			else if (option == "--depth")
+			{
+				isValid = ParseDepthFormat(value, settings.depthFormat);
+			}
+			else if (option == "--warmup")
+			{
+				isValid = ParseSeparated(value, "", settings.warmupFrameCount) && settings.warmupFrameCount >= 0;
+			}
+			else if (option == "--report")
+			{
+				settings.reportPath = value;
+				isValid = !value.empty();
+			}
+			else if (option == "--trace")
+			{
+				settings.tracePath = value;
+				isValid = !value.empty();
+			}
+			else if (option == "--trace-frames")
+			{
+				isValid = ParseSeparated(value, "", settings.traceFrameCount) && settings.traceFrameCount > 0;
+			}
+			else
+			{
+				std::cout << "Unknown option " << option << std::endl;
+				return false;
+			}
+
+			if (!isValid)
+			{
+				std::cout << "Invalid value " << value << " for " << option << std::endl;
+				return false;
+			}
+		}
+
+		std::ranges::stable_sort(settings.cameraKeyframes, {}, &CameraKeyframe::time);
+		return true;
+	}
+
+	CameraKeyframe SampleCameraPath(const std::vector<CameraKeyframe>& keyframes, float time)
+	{
+		if (keyframes.empty()) return {};
+
+		const auto next{ std::ranges::upper_bound(keyframes, time, {}, &CameraKeyframe::time) };
+		if (next == keyframes.begin()) return keyframes.front();
+		if (next == keyframes.end()) return keyframes.back();
+
+		const CameraKeyframe& from{ *(next - 1) };
+		const CameraKeyframe& to{ *next };
+		const float factor{ (time - from.time) / (to.time - from.time) };
+
+		CameraKeyframe result{};
+		result.time = time;
+		result.origin = from.origin + (to.origin - from.origin) * factor;
+		result.yaw = Lerpf(from.yaw, to.yaw, factor);
+		result.pitch = Lerpf(from.pitch, to.pitch, factor);
+		return result;
+	}
+
+	int RunBatch(const BatchSettings& settings)
+	{
+		std::error_code error{};
+		std::filesystem::create_directories(settings.outputDirectory, error);
+		if (error)
+		{
+			std::cout << "Could not create " << settings.outputDirectory << ": " << error.message() << std::endl;
+			return 1;
+		}
+
+		std::vector<uint32_t> pixels(static_cast<size_t>(settings.width) * settings.height);
+		const RenderTarget renderTarget{ settings.width, settings.height, PixelFormat::XRGB8888, pixels.data(), settings.width * static_cast<int>(sizeof(uint32_t)) };
+		StartTrace(settings);
+		Renderer renderer{ renderTarget, settings.scenePath };
+		if (!renderer.IsSceneLoaded())
+		{
+			std::cout << "Could not load the scene " << settings.scenePath << std::endl;
+			return 1;
+		}
+		ApplyRenderState(renderer, settings);
+
+		using Clock = std::chrono::steady_clock;
+		Clock::duration renderDuration{};
+		const Clock::time_point batchStart{ Clock::now() };
+
+		for (int frame{}; frame < settings.frameCount; ++frame)
+		{
+			//Scene time comes from the frame index, so the sequence is the same however long a frame takes
+			const float time{ static_cast<float>(frame) * settings.timestep };
+
+			ApplyCameraPath(renderer, settings, time);
+
+			const Clock::time_point renderStart{ Clock::now() };
+			renderer.Render();
+			renderDuration += Clock::now() - renderStart;
+
+			std::ostringstream fileName;
+			fileName << "frame_" << std::setfill('0') << std::setw(5) << frame << GetImageFileExtension(settings.imageFormat);
+			const std::filesystem::path path{ std::filesystem::path{ settings.outputDirectory } / fileName.str() };
+			if (!SaveImage(renderTarget, path.string(), settings.imageFormat))
+			{
+				std::cout << "Could not write " << path.string() << std::endl;
+				return 1;
+			}
+
+			renderer.RotateMeshes(settings.rotationSpeed * TO_RADIANS * settings.timestep);
+		}
+
+		const double renderSeconds{ std::chrono::duration<double>(renderDuration).count() };
+		const double totalSeconds{ std::chrono::duration<double>(Clock::now() - batchStart).count() };
+		const double frames{ static_cast<double>(settings.frameCount) };
+		const double framePixels{ static_cast<double>(settings.width) * settings.height };
+
+		std::cout << "Rendered " << settings.frameCount << " frames of " << settings.width << 'x' << settings.height << " to " << settings.outputDirectory << '\n'
+			<< "Render: " << renderSeconds << " s, " << frames / renderSeconds << " frames/s, " << frames * framePixels / renderSeconds / 1e6 << " Mpixels/s\n"
+			<< "Total with encoding: " << totalSeconds << " s, " << frames / totalSeconds << " frames/s, " << frames * framePixels / totalSeconds / 1e6 << " Mpixels/s" << std::endl;
+
+		return 0;
+	}
+
+	int RunBenchmark(const BatchSettings& settings)
+	{
+		std::vector<uint32_t> pixels(static_cast<size_t>(settings.width) * settings.height);
+		const RenderTarget renderTarget{ settings.width, settings.height, PixelFormat::XRGB8888, pixels.data(), settings.width * static_cast<int>(sizeof(uint32_t)) };
+		StartTrace(settings);
+		Renderer renderer{ renderTarget, settings.scenePath };
+		if (!renderer.IsSceneLoaded())
+		{
+			std::cout << "Could not load the scene " << settings.scenePath << std::endl;
+			return 1;
+		}
+		ApplyRenderState(renderer, settings);
+		renderer.SetStageTiming(true);
+
+		//The fixed step makes the scene of frame n the same on every run, whatever the frame times are
+		Timer timer{};
+		timer.SetFixedElapsed(settings.timestep);
+		timer.Start();
+
+		using Clock = std::chrono::steady_clock;
+		std::vector<double> frameTimes{};
+		frameTimes.reserve(settings.frameCount);
+		StageTimes stageTimes{};
+		FrameStats frameStats{};
+
+		const int totalFrameCount{ settings.warmupFrameCount + settings.frameCount };
+		for (int frame{}; frame < totalFrameCount; ++frame)
+		{
+			ApplyCameraPath(renderer, settings, timer.GetTotal());
+
+			const Clock::time_point frameStart{ Clock::now() };
+			renderer.Render();
+			const double frameTime{ std::chrono::duration<double>(Clock::now() - frameStart).count() };
+
+			if (frame >= settings.warmupFrameCount)
+			{
+				frameTimes.push_back(frameTime);
+				stageTimes += renderer.GetStageTimes();
+				frameStats += renderer.GetFrameStats();
+			}
+
+			timer.Update();
+			renderer.RotateMeshes(settings.rotationSpeed * TO_RADIANS * timer.GetElapsed());
+		}
+
+		std::vector<double> sortedFrameTimes{ frameTimes };
+		std::ranges::sort(sortedFrameTimes);
+		const double frames{ static_cast<double>(settings.frameCount) };
+		double totalTime{};
+		for (const double frameTime : frameTimes) totalTime += frameTime;
+
+		std::ostringstream report;
+		report << std::fixed << std::setprecision(4)
+			<< "{\n"
+			<< "  \"width\": " << settings.width << ",\n"
+			<< "  \"height\": " << settings.height << ",\n"
+			<< "  \"warmupFrames\": " << settings.warmupFrameCount << ",\n"
+			<< "  \"measuredFrames\": " << settings.frameCount << ",\n"
+			<< "  \"timestep\": " << settings.timestep << ",\n"
+			<< "  \"threads\": " << renderer.GetThreadCount() << ",\n"
+			<< "  \"deferredTiles\": " << (renderer.IsUsingDeferredTiles() ? "true" : "false") << ",\n"
+			<< "  \"sampleCount\": " << renderer.GetSampleCount() << ",\n"
+			<< "  \"depthFormat\": \"" << GetDepthFormatName(renderer.GetDepthFormat()) << "\",\n"
+			<< "  \"frameTimeMs\": {\n"
+			<< "    \"min\": " << sortedFrameTimes.front() * 1000.0 << ",\n"
+			<< "    \"mean\": " << totalTime / frames * 1000.0 << ",\n"
+			<< "    \"p50\": " << GetPercentile(sortedFrameTimes, 50.0) * 1000.0 << ",\n"
+			<< "    \"p95\": " << GetPercentile(sortedFrameTimes, 95.0) * 1000.0 << ",\n"
+			<< "    \"p99\": " << GetPercentile(sortedFrameTimes, 99.0) * 1000.0 << ",\n"
+			<< "    \"max\": " << sortedFrameTimes.back() * 1000.0 << "\n"
+			<< "  },\n"
+			<< "  \"framesPerSecond\": " << frames / totalTime << ",\n"
+			<< "  \"stageTimeMs\": {\n";
+
+		//Mean per frame, summed over all threads
+		for (int stage{}; stage < StageTimes::m_StageCount; ++stage)
+		{
+			report << "    \"" << GetRenderStageName(static_cast<RenderStage>(stage)) << "\": " << stageTimes.seconds[stage] / frames * 1000.0
+				<< (stage + 1 < StageTimes::m_StageCount ? ",\n" : "\n");
+		}
+		report << "  }";
+
+		//Mean per frame, left out when the counters are compiled out
+		if constexpr (FrameStats::m_IsEnabled)
+		{
+			const auto perFrame = [frames](uint64_t count) { return static_cast<double>(count) / frames; };
+			report << ",\n"
+				<< "  \"stats\": {\n"
+				<< "    \"meshesSubmitted\": " << perFrame(frameStats.meshesSubmitted) << ",\n"
+				<< "    \"meshesFrustumCulled\": " << perFrame(frameStats.meshesFrustumCulled) << ",\n"
+				<< "    \"sceneBoxesTested\": " << perFrame(frameStats.sceneBoxesTested) << ",\n"
+				<< "    \"trianglesLodRemoved\": " << perFrame(frameStats.trianglesLodRemoved) << ",\n"
+				<< "    \"verticesTransformed\": " << perFrame(frameStats.verticesTransformed) << ",\n"
+				<< "    \"trianglesSubmitted\": " << perFrame(frameStats.trianglesSubmitted) << ",\n"
+				<< "    \"meshletsFrustumCulled\": " << perFrame(frameStats.meshletsFrustumCulled) << ",\n"
+				<< "    \"meshletsBackFaceCulled\": " << perFrame(frameStats.meshletsBackFaceCulled) << ",\n"
+				<< "    \"trianglesMeshletCulled\": " << perFrame(frameStats.trianglesMeshletCulled) << ",\n"
+				<< "    \"trianglesFrustumCulled\": " << perFrame(frameStats.trianglesFrustumCulled) << ",\n"
+				<< "    \"trianglesBackFaceCulled\": " << perFrame(frameStats.trianglesBackFaceCulled) << ",\n"
+				<< "    \"trianglesSmallCulled\": " << perFrame(frameStats.trianglesSmallCulled) << ",\n"
+				<< "    \"trianglesClipped\": " << perFrame(frameStats.trianglesClipped) << ",\n"
+				<< "    \"trianglesRasterized\": " << perFrame(frameStats.trianglesRasterized) << ",\n"
+				<< "    \"pixelsTested\": " << perFrame(frameStats.pixelsTested) << ",\n"
+				<< "    \"pixelsDepthPassed\": " << perFrame(frameStats.pixelsDepthPassed) << ",\n"
+				<< "    \"pixelsShaded\": " << perFrame(frameStats.pixelsShaded) << ",\n"
+				<< "    \"pixelsCovered\": " << perFrame(frameStats.pixelsCovered) << ",\n"
+				<< "    \"textureSamples\": " << perFrame(frameStats.textureSamples) << ",\n"
+				<< "    \"overdrawRatio\": " << frameStats.GetOverdrawRatio() << "\n"
+				<< "  }";
+		}
+		report << "\n}\n";
+
+		if (settings.reportPath.empty())
+		{
+			std::cout << report.str();
+			return 0;
+		}
+
+		std::ofstream file{ settings.reportPath };
+		file << report.str();
+		if (!file)
+		{
+			std::cout << "Could not write " << settings.reportPath << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "DepthFormat.h"
+#include "ImageWriter.h"
+#include "Vector3.h"
+
+namespace dae
+{
+	//Camera pose at a point in time, the camera moves linearly between keyframes
+	struct CameraKeyframe
+	{
+		float time{};
+		Vector3 origin{};
+		//In degrees
+		float yaw{};
+		float pitch{};
+	};
+
+	//Renders an image sequence without a window, as fast as the renderer allows
+	struct BatchSettings
+	{
+		std::string scenePath{ "Resources/vehicle.scene" };
+		int width{ 640 };
+		int height{ 480 };
+		int frameCount{ 1 };
+		//Seconds of scene time between two frames, independent of how long a frame takes to render
+		float timestep{ 1.f / 30.f };
+		//Degrees per second around the world up axis
+		float rotationSpeed{};
+		//Without keyframes the camera keeps its default pose
+		std::vector<CameraKeyframe> cameraKeyframes{};
+		ImageFileFormat imageFormat{ ImageFileFormat::PNG };
+		std::string outputDirectory{ "Frames" };
+
+		bool useMSAA{};
+		bool useDeferredTiles{ true };
+		bool useLods{ true };
+		DepthFormat depthFormat{ DepthFormat::Float32 };
+
+		//Benchmark only, frameCount frames are measured after the warm-up frames
+		int warmupFrameCount{ 20 };
+		//The JSON report goes to stdout when empty
+		std::string reportPath{};
+
+		//Chrome trace of the first frames, including loading the assets
+		std::string tracePath{};
+		int traceFrameCount{ 10 };
+	};
+
+	//Returns false when an argument is unknown or malformed
+	bool ParseBatchSettings(int argc, char* args[], BatchSettings& settings);
+	void PrintBatchUsage();
+
+	CameraKeyframe SampleCameraPath(const std::vector<CameraKeyframe>& keyframes, float time);
+
+	//Returns the process exit code
+	int RunBatch(const BatchSettings& settings);
+
+	//Renders the same scripted sequence as RunBatch without writing images
+	//and reports frame time percentiles, a per stage breakdown and the pipeline counters as JSON
+	int RunBenchmark(const BatchSettings& settings);
+}
@@ -0,0 +1,496 @@
+#include "MicroBenchmarks.h"
+
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#include "Benchmark.h"
+#include "Instancing.h"
+#include "MeshCache.h"
+#include "Renderer.h"
+#include "SceneBVH.h"
+#include "Texture.h"
+#include "Utils.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Inputs are cycled through arrays of this size, so the compiler can not fold the kernel into a constant
+		constexpr int m_InputCount{ 1024 };
+
+		//Objects of the culling cases, spread over a square in front of and behind the camera
+		constexpr int m_CullObjectCount{ 50000 };
+		constexpr float m_CullSceneSize{ 2000.f };
+
+		//Copies of the vehicle in the instanced frame, a grid of this many per side
+		constexpr int m_VehicleGridSize{ 4 };
+
+		constexpr int m_TargetWidth{ 640 };
+		constexpr int m_TargetHeight{ 480 };
+
+		//Flat color, so the triangle cases measure setup, coverage and depth and not the material
+		struct FlatPixelShader
+		{
+			ColorRGB Shade(const BuiltInVaryings&) const { return ColorRGB{ 1.f, 1.f, 1.f }; }
+		};
+
+		//Everything the cases share, loaded once before the first case runs
+		struct Fixture
+		{
+			std::mt19937 random{ 1234 };
+
+			std::vector<Matrix> matrices{};
+			std::vector<Vector3> vectors{};
+			std::vector<Vector4> points{};
+			std::vector<Vector2> uvs{};
+
+			std::vector<BoundingBox> objectBounds{};
+			SceneBVH sceneBVH{};
+			Frustum frustum{};
+			//The same boxes as objectBounds, as instances of a unit cube
+			std::vector<MeshInstance> cullInstances{};
+			InstancedMesh vehicles{};
+
+			std::unique_ptr<Texture> pDiffuseTexture{};
+			std::unique_ptr<Texture> pGlossinessTexture{};
+			std::unique_ptr<Texture> pNormalTexture{};
+			std::unique_ptr<Texture> pSpecularTexture{};
+			SpecularEvaluator specularEvaluator{ 25.f };
+			ThreadPool threadPool{};
+
+			std::vector<uint32_t> pixels{};
+			std::unique_ptr<Renderer> pRenderer{};
+
+			float RandomFloat(float min, float max) { return std::uniform_real_distribution<float>{ min, max }(random); }
+			Vector3 RandomVector3() { return { RandomFloat(-1.f, 1.f), RandomFloat(-1.f, 1.f), RandomFloat(-1.f, 1.f) }; }
+		};
+
+		bool LoadFixture(Fixture& fixture)
+		{
+			for (int inputIdx{}; inputIdx < m_InputCount; ++inputIdx)
+			{
+				fixture.matrices.push_back(Matrix::CreateRotation(fixture.RandomVector3() * PI) * Matrix::CreateTranslation(fixture.RandomVector3() * 10.f));
+				fixture.vectors.push_back(fixture.RandomVector3());
+				fixture.points.push_back({ fixture.RandomVector3() * 10.f, 1.f });
+				fixture.uvs.push_back({ fixture.RandomFloat(0.f, 1.f), fixture.RandomFloat(0.f, 1.f) });
+			}
+
+			for (int objectIdx{}; objectIdx < m_CullObjectCount; ++objectIdx)
+			{
+				const Vector3 center{ fixture.RandomFloat(-1.f, 1.f) * m_CullSceneSize / 2.f, fixture.RandomFloat(-10.f, 10.f), fixture.RandomFloat(-1.f, 1.f) * m_CullSceneSize / 2.f };
+				const Vector3 extents{ fixture.RandomFloat(0.5f, 5.f), fixture.RandomFloat(0.5f, 5.f), fixture.RandomFloat(0.5f, 5.f) };
+				fixture.objectBounds.push_back({ center - extents, center + extents });
+				fixture.cullInstances.push_back({ Matrix::CreateScale(extents) * Matrix::CreateTranslation(center) });
+			}
+			fixture.sceneBVH.Build(fixture.objectBounds);
+			fixture.frustum = Frustum::FromMatrix(Matrix::CreatePerspectiveFovLH(std::tan(30.f * TO_RADIANS), 4.f / 3.f, 0.1f, 1000.f));
+
+			IndexedMesh vehicle{};
+			if (!LoadOBJ("Resources/vehicle.obj", vehicle)) return false;
+			fixture.vehicles.pMesh = std::make_shared<const Mesh>(CreateMesh(std::move(vehicle)));
+			for (int x{}; x < m_VehicleGridSize; ++x)
+			{
+				for (int y{}; y < m_VehicleGridSize; ++y)
+				{
+					const Vector3 position{ (static_cast<float>(x) - (m_VehicleGridSize - 1) / 2.f) * 20.f, (static_cast<float>(y) - (m_VehicleGridSize - 1) / 2.f) * 12.f, 50.f };
+					fixture.vehicles.instances.push_back({ Matrix::CreateRotationY(static_cast<float>(x + y)) * Matrix::CreateTranslation(position) });
+				}
+			}
+
+			fixture.pDiffuseTexture.reset(Texture::LoadFromFile("Resources/vehicle_diffuse.png"));
+			fixture.pGlossinessTexture.reset(Texture::LoadFromFile("Resources/vehicle_gloss.png"));
+			fixture.pNormalTexture.reset(Texture::LoadFromFile("Resources/vehicle_normal.png"));
+			fixture.pSpecularTexture.reset(Texture::LoadFromFile("Resources/vehicle_specular.png"));
+			if (!fixture.pDiffuseTexture || !fixture.pGlossinessTexture || !fixture.pNormalTexture || !fixture.pSpecularTexture) return false;
+
+			fixture.pixels.resize(static_cast<size_t>(m_TargetWidth) * m_TargetHeight);
+			const RenderTarget renderTarget{ m_TargetWidth, m_TargetHeight, PixelFormat::XRGB8888, fixture.pixels.data(), m_TargetWidth * static_cast<int>(sizeof(uint32_t)) };
+			fixture.pRenderer = std::make_unique<Renderer>(renderTarget);
+			return fixture.pRenderer->IsSceneLoaded();
+		}
+
+		//A right triangle facing the default camera, the legs are sizeInPixels long on screen
+		Mesh CreateScreenTriangle(int sizeInPixels)
+		{
+			//The camera is 50 units in front of the origin with a vertical field of view of 60 degrees
+			const float unitsPerPixel{ 2.f * std::tan(30.f * TO_RADIANS) * 50.f / static_cast<float>(m_TargetHeight) };
+			const float size{ static_cast<float>(sizeInPixels) * unitsPerPixel };
+
+			std::vector<Vertex> vertices(3);
+			vertices[0].position = { -size / 2.f, -size / 2.f, 0.f };
+			vertices[1].position = { size / 2.f, -size / 2.f, 0.f };
+			vertices[2].position = { -size / 2.f, size / 2.f, 0.f };
+			vertices[1].uv = { 1.f, 0.f };
+			vertices[2].uv = { 0.f, 1.f };
+			for (Vertex& vertex : vertices)
+			{
+				vertex.normal = { 0.f, 0.f, -1.f };
+				vertex.tangent = { 1.f, 0.f, 0.f };
+			}
+			return Mesh{ vertices };
+		}
+
+		BuiltInPixelShader CreatePixelShader(const Fixture& fixture, ShadeMode shadeMode)
+		{
+			BuiltInPixelShader pixelShader{};
+			pixelShader.pDiffuseTexture = fixture.pDiffuseTexture.get();
+			pixelShader.pGlossinessTexture = fixture.pGlossinessTexture.get();
+			pixelShader.pNormalTexture = fixture.pNormalTexture.get();
+			pixelShader.pSpecularTexture = fixture.pSpecularTexture.get();
+			pixelShader.pSpecularEvaluator = &fixture.specularEvaluator;
+			pixelShader.shadeMode = shadeMode;
+			pixelShader.directionLight = { .577f, -.577f, .577f };
+			pixelShader.lightIntensity = 7.f;
+			pixelShader.glossiness = 25.f;
+			pixelShader.ambientLight = 0.025f;
+			return pixelShader;
+		}
+
+		template<int BatchSize>
+		FragmentBatch<BuiltInVaryings, BatchSize> CreateFragmentBatch(Fixture& fixture)
+		{
+			using Batch = FragmentBatch<BuiltInVaryings, BatchSize>;
+			constexpr size_t uvIdx{ Batch::ComponentIndex(offsetof(BuiltInVaryings, uv)) };
+
+			Batch batch{};
+			batch.count = BatchSize;
+			for (auto& component : batch.varyings)
+			{
+				for (float& lane : component) lane = fixture.RandomFloat(-1.f, 1.f);
+			}
+			for (int lane{}; lane < BatchSize; ++lane)
+			{
+				batch.varyings[uvIdx][lane] = fixture.RandomFloat(0.f, 1.f);
+				batch.varyings[uvIdx + 1][lane] = fixture.RandomFloat(0.f, 1.f);
+
+				//About a texel per pixel
+				batch.ddx[uvIdx][lane] = 1.f / 2048.f;
+				batch.ddy[uvIdx + 1][lane] = 1.f / 2048.f;
+			}
+			return batch;
+		}
+
+		std::vector<BenchmarkCase> CreateCases(Fixture& fixture)
+		{
+			std::vector<BenchmarkCase> cases{};
+
+			cases.push_back({ "Matrix/Multiply", [&fixture](BenchmarkState& state)
+			{
+				int inputIdx{};
+				while (state.KeepRunning())
+				{
+					DoNotOptimize(fixture.matrices[inputIdx] * fixture.matrices[(inputIdx + 1) % m_InputCount]);
+					inputIdx = (inputIdx + 1) % m_InputCount;
+				}
+				state.SetItemsPerIteration(1);
+			} });
+
+			cases.push_back({ "Matrix/TransformPoint", [&fixture](BenchmarkState& state)
+			{
+				const Matrix& matrix{ fixture.matrices.front() };
+				while (state.KeepRunning())
+				{
+					for (const Vector4& point : fixture.points)
+					{
+						DoNotOptimize(matrix.TransformPoint(point));
+					}
+				}
+				state.SetItemsPerIteration(m_InputCount);
+			} });
+
+			cases.push_back({ "Matrix/Inverse", [&fixture](BenchmarkState& state)
+			{
+				int inputIdx{};
+				while (state.KeepRunning())
+				{
+					DoNotOptimize(Matrix::Inverse(fixture.matrices[inputIdx]));
+					inputIdx = (inputIdx + 1) % m_InputCount;
+				}
+				state.SetItemsPerIteration(1);
+			} });
+
+			cases.push_back({ "Vector3/Normalized", [&fixture](BenchmarkState& state)
+			{
+				while (state.KeepRunning())
+				{
+					for (const Vector3& vector : fixture.vectors)
+					{
+						DoNotOptimize(vector.Normalized());
+					}
+				}
+				state.SetItemsPerIteration(m_InputCount);
+			} });
+
+			//Magnified hits the full resolution level, minified a smaller mip level that stays in the cache
+			for (const auto& [name, footprint] : { std::pair{ "Texture/Sample/Magnified", 0.25f }, std::pair{ "Texture/Sample/Minified", 8.f } })
+			{
+				cases.push_back({ name, [&fixture, footprint](BenchmarkState& state)
+				{
+					const Vector2 uvDdx{ footprint / 2048.f, 0.f };
+					const Vector2 uvDdy{ 0.f, footprint / 2048.f };
+					while (state.KeepRunning())
+					{
+						for (const Vector2& uv : fixture.uvs)
+						{
+							DoNotOptimize(fixture.pDiffuseTexture->Sample(uv, uvDdx, uvDdy));
+						}
+					}
+					state.SetItemsPerIteration(m_InputCount);
+				} });
+			}
+
+			//One triangle per frame in the immediate mode, the items are the covered pixels
+			for (const auto& [name, size] : { std::pair{ "RenderTriangle/Small", 8 }, std::pair{ "RenderTriangle/Medium", 64 }, std::pair{ "RenderTriangle/Large", 400 } })
+			{
+				cases.push_back({ name, [&fixture, size](BenchmarkState& state)
+				{
+					Renderer& renderer{ *fixture.pRenderer };
+					renderer.SetDeferredTiles(false);
+
+					const Mesh mesh{ CreateScreenTriangle(size) };
+					const BuiltInVertexShader vertexShader{};
+					const FlatPixelShader pixelShader{};
+					while (state.KeepRunning())
+					{
+						renderer.BeginFrame();
+						renderer.Draw(mesh, vertexShader, pixelShader);
+					}
+					renderer.EndFrame();
+
+					renderer.SetDeferredTiles(true);
+					state.SetItemsPerIteration(static_cast<uint64_t>(size) * size / 2);
+				} });
+			}
+
+			//The batch kernel the renderer shades queued fragments with
+			for (const auto& [name, shadeMode] : { std::pair{ "Shade/ObservedArea", ShadeMode::ObservedArea }, std::pair{ "Shade/Diffuse", ShadeMode::Diffuse },
+				std::pair{ "Shade/Specular", ShadeMode::Specular }, std::pair{ "Shade/Combined", ShadeMode::Combined } })
+			{
+				cases.push_back({ name, [&fixture, shadeMode](BenchmarkState& state)
+				{
+					constexpr int batchSize{ 16 };
+					const BuiltInPixelShader pixelShader{ CreatePixelShader(fixture, shadeMode) };
+					const FragmentBatch<BuiltInVaryings, batchSize> batch{ CreateFragmentBatch<batchSize>(fixture) };
+
+					ColorBatch<batchSize> colors{};
+					while (state.KeepRunning())
+					{
+						pixelShader.ShadeBatch(batch, colors);
+						DoNotOptimize(colors);
+					}
+					state.SetItemsPerIteration(batchSize);
+				} });
+			}
+
+			//Items are the vertices of the triangle list
+			for (const auto& [name, pThreadPool] : { std::pair{ "ParseOBJ/Vehicle", static_cast<ThreadPool*>(nullptr) }, std::pair{ "ParseOBJ/Vehicle/Parallel", &fixture.threadPool } })
+			{
+				cases.push_back({ name, [pThreadPool](BenchmarkState& state)
+				{
+					std::vector<Vertex> vertices{};
+					while (state.KeepRunning())
+					{
+						Utils::ParseOBJ("Resources/vehicle.obj", vertices, true, pThreadPool);
+						DoNotOptimize(vertices.data());
+					}
+					state.SetItemsPerIteration(vertices.size());
+				} });
+			}
+
+			//Hashes the OBJ and copies the mesh out of its cache file, the cache is written on the first load
+			cases.push_back({ "LoadOBJ/Vehicle/Cached", [](BenchmarkState& state)
+			{
+				IndexedMesh mesh{};
+				while (state.KeepRunning())
+				{
+					LoadOBJ("Resources/vehicle.obj", mesh);
+					DoNotOptimize(mesh.vertices.data());
+				}
+				state.SetItemsPerIteration(mesh.indices.size());
+			} });
+
+			//Frustum culling of the scene objects, the items are the objects of the scene
+			cases.push_back({ "Cull/Linear", [&fixture](BenchmarkState& state)
+			{
+				while (state.KeepRunning())
+				{
+					uint32_t visibleCount{};
+					for (const BoundingBox& bounds : fixture.objectBounds)
+					{
+						if (!fixture.frustum.IsBoxOutside(bounds.GetCenter(), bounds.GetExtents())) ++visibleCount;
+					}
+					DoNotOptimize(visibleCount);
+				}
+				state.SetItemsPerIteration(m_CullObjectCount);
+			} });
+
+			cases.push_back({ "Cull/SceneBVH", [&fixture](BenchmarkState& state)
+			{
+				while (state.KeepRunning())
+				{
+					uint32_t visibleCount{};
+					fixture.sceneBVH.Query(fixture.frustum, [&visibleCount](uint32_t) { ++visibleCount; });
+					DoNotOptimize(visibleCount);
+				}
+				state.SetItemsPerIteration(m_CullObjectCount);
+			} });
+
+			cases.push_back({ "Cull/Instances", [&fixture](BenchmarkState& state)
+			{
+				//The sphere around a cube of half size 1
+				const BoundingSphere unitCubeSphere{ {}, std::sqrt(3.f) };
+				std::vector<uint32_t> visibleInstances{};
+				visibleInstances.reserve(m_CullObjectCount);
+				while (state.KeepRunning())
+				{
+					visibleInstances.clear();
+					FindVisibleInstances(fixture.frustum, unitCubeSphere, fixture.cullInstances, visibleInstances);
+					DoNotOptimize(visibleInstances.data());
+				}
+				state.SetItemsPerIteration(m_CullObjectCount);
+			} });
+
+			//Every object is marked as moved, as the rotating meshes are each frame
+			cases.push_back({ "Cull/SceneBVH/Refit", [&fixture](BenchmarkState& state)
+			{
+				SceneBVH& sceneBVH{ fixture.sceneBVH };
+				while (state.KeepRunning())
+				{
+					for (uint32_t object{}; object < sceneBVH.GetObjectCount(); ++object)
+					{
+						sceneBVH.UpdateObject(object, sceneBVH.GetObjectBounds(object));
+					}
+					sceneBVH.Refit();
+				}
+				state.SetItemsPerIteration(m_CullObjectCount);
+			} });
+
+			//An empty frame, every tile is untouched and gets the background color at present
+			cases.push_back({ "Frame/ClearAndPresent", [&fixture](BenchmarkState& state)
+			{
+				Renderer& renderer{ *fixture.pRenderer };
+				while (state.KeepRunning())
+				{
+					renderer.BeginFrame();
+					renderer.EndFrame();
+				}
+				state.SetItemsPerIteration(static_cast<uint64_t>(m_TargetWidth) * m_TargetHeight);
+			} });
+
+			cases.push_back({ "Frame/Vehicle", [&fixture](BenchmarkState& state)
+			{
+				Renderer& renderer{ *fixture.pRenderer };
+				while (state.KeepRunning())
+				{
+					renderer.Render();
+				}
+				state.SetItemsPerIteration(static_cast<uint64_t>(m_TargetWidth) * m_TargetHeight);
+			} });
+
+			//The vehicle drawn once per grid cell from one shared mesh
+			cases.push_back({ "Frame/Vehicle/Instanced", [&fixture](BenchmarkState& state)
+			{
+				Renderer& renderer{ *fixture.pRenderer };
+				const BuiltInVertexShader vertexShader{};
+				const BuiltInPixelShader pixelShader{ CreatePixelShader(fixture, ShadeMode::Combined) };
+				while (state.KeepRunning())
+				{
+					renderer.BeginFrame();
+					renderer.DrawInstanced(*fixture.vehicles.pMesh, fixture.vehicles.instances, vertexShader, pixelShader);
+					renderer.EndFrame();
+				}
+				state.SetItemsPerIteration(static_cast<uint64_t>(m_TargetWidth) * m_TargetHeight);
+			} });
+
+			return cases;
+		}
+
+		bool ParseMicroBenchmarkSettings(int argc, char* args[], BenchmarkSettings& settings)
+		{
+			for (int argIdx{ 1 }; argIdx < argc; ++argIdx)
+			{
+				const std::string_view option{ args[argIdx] };
+				if (option == "--microbench") continue;
+
+				if (argIdx + 1 >= argc)
+				{
+					std::cout << "Missing value for " << option << std::endl;
+					return false;
+				}
+				const std::string value{ args[++argIdx] };
+				std::istringstream stream{ value };
+
+				bool isValid{};
+				if (option == "--filter")
+				{
+					settings.filter = value;
+					isValid = true;
+				}
+				else if (option == "--min-time")
+				{
+					isValid = stream >> settings.minSeconds && settings.minSeconds > 0.0;
+				}
+				else if (option == "--repetitions")
+				{
+					isValid = stream >> settings.repetitions && settings.repetitions > 0;
+				}
+				else if (option == "--report")
+				{
+					settings.reportPath = value;
+					isValid = !value.empty();
+				}
+				else
+				{
+					std::cout << "Unknown option " << option << std::endl;
+					return false;
+				}
+
+				if (!isValid)
+				{
+					std::cout << "Invalid value " << value << " for " << option << std::endl;
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+
+	void PrintMicroBenchmarkUsage()
+	{
+		std::cout <<
+			"Usage: Rasterizer --microbench [options]\n"
+			"  --filter TEXT                 Only run the cases with TEXT in their name\n"
+			"  --min-time SECONDS            Minimum time of a repetition, default 0.2\n"
+			"  --repetitions COUNT           Repetitions per case, the fastest is reported, default 5\n"
+			"  --report FILE                 JSON results to compare runs with\n";
+	}
+
+	int RunMicroBenchmarks(int argc, char* args[])
+	{
+		BenchmarkSettings settings{};
+		if (!ParseMicroBenchmarkSettings(argc, args, settings))
+		{
+			PrintMicroBenchmarkUsage();
+			return 1;
+		}
+
+		Fixture fixture{};
+		if (!LoadFixture(fixture))
+		{
+			std::cout << "Could not load the textures, the vehicle or the default scene from Resources" << std::endl;
+			return 1;
+		}
+
+		const std::vector<BenchmarkResult> results{ RunBenchmarks(CreateCases(fixture), settings) };
+		if (!settings.reportPath.empty() && !WriteBenchmarkReport(results, settings.reportPath))
+		{
+			std::cout << "Could not write " << settings.reportPath << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+namespace dae
+{
+	//Times the math, texture, raster and shading kernels one by one, so an optimization can be measured in isolation
+	//Loads the vehicle assets from Resources, like the renderer does
+	//Returns the process exit code
+	int RunMicroBenchmarks(int argc, char* args[]);
+	void PrintMicroBenchmarkUsage();
+}
@@ -1,52 +1,117 @@
 //External includes
-#include "SDL.h"
-#include "SDL_surface.h"
+#include <bit>
 #include <iostream>
+#include <numeric>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RENDERER_SSE 1
+#else
+#define RENDERER_SSE 0
+#endif
 
 //Project includes
 #include "Renderer.h"
+#include "Frustum.h"
+#include "ImageWriter.h"
 #include "Maths.h"
+#include "MeshCache.h"
+#include "Meshlet.h"
+#include "Scene.h"
 #include "Texture.h"
-#include "Utils.h"
 
-#define TextureTiling 0
 
+using namespace dae;
 
+Renderer::Renderer(const RenderTarget& renderTarget, const std::string& scenePath)
+{
+	const TraceZone zone{ "Load assets" };
+	SetRenderTarget(renderTarget);
+	m_IsSceneLoaded = LoadScene(scenePath);
+	BuildSceneBVH();
+}
+Renderer::~Renderer()
+{
+	DeleteBuffers();
+}
 
+bool Renderer::LoadScene(const std::string& scenePath)
+{
+	//The camera is set up even without a scene, so an empty frame can still be rendered
+	SceneDescription scene{};
+	const bool isParsed{ scenePath.empty() || ParseScene(scenePath, scene) };
+	m_Camera.Initialize(m_AspectRatio, scene.cameraFovAngle, scene.cameraOrigin);
+	if (!isParsed) return false;
+	if (scenePath.empty()) return true;
+
+	m_DirectionLight = scene.lightDirection;
+	m_lightIntensity = scene.lightIntensity;
+
+	//Meshes come from their binary cache after the first start
+	LoadedScene loaded{};
+	const bool isLoaded{ LoadSceneAssets(scene, m_AssetManager, m_ThreadPool, loaded) };
+	PrintAssetLoadTimes(loaded);
+	m_AssetManager.PrintResidentAssets();
+	if (!isLoaded)
+	{
+		std::cerr << "Could not load the assets of " << scenePath << std::endl;
+		return false;
+	}
 
-using namespace dae;
+	m_Textures = std::move(loaded.textures);
+	for (const SceneMaterial& material : scene.materials)
+	{
+		m_Materials.push_back({ m_Textures[material.diffuse].get(), m_Textures[material.glossiness].get(), m_Textures[material.normal].get(), m_Textures[material.specular].get() });
+	}
+
+	for (const SceneObject& object : scene.objects)
+	{
+		m_Objects.push_back({ loaded.meshes[object.mesh], MeshInstance{ object.worldMatrix }, object.material });
+	}
+	return true;
+}
 
-Renderer::Renderer(SDL_Window* pWindow) :
-	m_pWindow(pWindow)
+void Renderer::SetRenderTarget(const RenderTarget& renderTarget)
 {
-	//Initialize
-	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
+	const bool isResized{ renderTarget.width != m_Width || renderTarget.height != m_Height };
 
-	//Create Buffers
-	m_pFrontBuffer = SDL_GetWindowSurface(pWindow);
-	m_pBackBuffer = SDL_CreateRGBSurface(0, m_Width, m_Height, 32, 0, 0, 0, 0);
-	m_pBackBufferPixels = static_cast<uint32_t*>(m_pBackBuffer->pixels);
+	m_RenderTarget = renderTarget;
+	m_PixelLayout = GetPixelLayout(renderTarget.format);
+	m_pTargetPixels = static_cast<uint32_t*>(renderTarget.pPixels);
+	m_TargetPitch = renderTarget.pitch / static_cast<int>(sizeof(uint32_t));
 
-	m_pDepthBufferPixels = new float[static_cast<int>(m_Width * m_Height)];
+	if (!isResized) return;
+
+	m_Width = renderTarget.width;
+	m_Height = renderTarget.height;
+	DeleteBuffers();
+	CreateBuffers();
 
-	//Initialize Camera
 	m_AspectRatio = static_cast<float>(m_Width) / static_cast<float>(m_Height);
-	m_Camera.Initialize(m_AspectRatio,60.f, { .0f,.0f,-50.f });
+	m_Camera.CalculateProjectionMatrix(m_AspectRatio);
+}
 
-	//Initialize the textures
-	m_pTexture = std::make_unique<Texture>(*Texture::LoadFromFile("Resources/vehicle_diffuse.png"));
-	m_pGlossinessTexture = std::make_unique<Texture>(*Texture::LoadFromFile("Resources/vehicle_gloss.png"));
-	m_pNormalTexture = std::make_unique<Texture>(*Texture::LoadFromFile("Resources/vehicle_normal.png"));
-	m_pSpecularTexture = std::make_unique<Texture>(*Texture::LoadFromFile("Resources/vehicle_specular.png"));
-	
-	//Load the model
-	std::vector<Vertex> vertices;
-	Utils::ParseOBJ("Resources/vehicle.obj", vertices);	
-	m_MeshesWorld.emplace_back(vertices, PrimitiveTopology::TriangleList);	
+void Renderer::CreateBuffers()
+{
+	m_NrBlocksX = (m_Width + m_BlockSize - 1) / m_BlockSize;
+	m_NrBlocksY = (m_Height + m_BlockSize - 1) / m_BlockSize;
+	const size_t nrBlockedSamples{ static_cast<size_t>(m_NrBlocksX * m_NrBlocksY * m_BlockPixels * m_MaxSampleCount) };
+	m_pColorBuffer = new uint32_t[nrBlockedSamples];
+	m_pDepthBuffer = new uint8_t[nrBlockedSamples * sizeof(float)];
+
+	m_NrTilesX = (m_Width + m_TileSize - 1) / m_TileSize;
+	m_NrTilesY = (m_Height + m_TileSize - 1) / m_TileSize;
+	m_ClearedTiles.assign(static_cast<size_t>(m_NrTilesX * m_NrTilesY), uint8_t{});
+	m_ThreadStageTimes.resize(m_ThreadPool.GetThreadCount());
+	m_ThreadFrameStats.resize(m_ThreadPool.GetThreadCount());
 }
-Renderer::~Renderer()
+
+void Renderer::DeleteBuffers()
 {
-	delete[] m_pDepthBufferPixels;
+	delete[] m_pColorBuffer;
+	delete[] m_pDepthBuffer;
+	m_pColorBuffer = nullptr;
+	m_pDepthBuffer = nullptr;
 }
 
 void Renderer::Update(Timer* pTimer)
@@ -55,500 +120,441 @@ void Renderer::Update(Timer* pTimer)
 
 	if(!m_Rotate) return;
 	
-	//Rotate the mesh at 1 Radians per second
-	for(auto& mesh  : m_MeshesWorld)
+	//Rotate the mesh at 90 degrees per second
+	RotateMeshes((PI / 2.f) * pTimer->GetElapsed());
+}
+
+void Renderer::RotateMeshes(float angle)
+{
+	//Around the up axis of every object, like Mesh::Rotate
+	const Matrix rotation{ Matrix::CreateRotation(Vector3{ 0.f, 1.f, 0.f } * angle) };
+	for (uint32_t objectIdx{}; objectIdx < m_Objects.size(); ++objectIdx)
 	{
-		const float rotationSpeed = (PI / 2.f) * pTimer->GetElapsed();
-		mesh.Rotate(rotationSpeed, {0.f, 1.f, 0.f});
+		Object& object{ m_Objects[objectIdx] };
+		object.instance.worldMatrix = rotation * object.instance.worldMatrix;
+		m_SceneBVH.UpdateObject(objectIdx, object.pMesh->bounds.Transformed(object.instance.worldMatrix));
 	}
+	m_SceneBVH.Refit();
 }
 
-void Renderer::Render()
+void Renderer::BuildSceneBVH()
 {
-	ClearBackground();
-	ResetDepthBuffer();
-	//Lock BackBuffer
-	SDL_LockSurface(m_pBackBuffer);
-
-
-	//for each mesh
-	for(const auto& mesh : m_MeshesWorld)
+	std::vector<BoundingBox> worldBounds{};
+	worldBounds.reserve(m_Objects.size());
+	for (const Object& object : m_Objects)
 	{
-		//Define Triangle in NDC Space		
-		const auto worldViewProjectionMatrix = mesh.worldMatrix * m_Camera.viewMatrix * m_Camera.projectionMatrix;
-		std::vector<Vertex_Out> vertices_ndc{};
-		VertexTransformationFunction(mesh.vertices, vertices_ndc, worldViewProjectionMatrix, mesh.worldMatrix);
+		worldBounds.push_back(object.pMesh->bounds.Transformed(object.instance.worldMatrix));
+	}
+	m_SceneBVH.Build(worldBounds);
+}
 
+void Renderer::Render()
+{
+	{
+		const TraceZone zone{ "Render" };
+		BeginFrame();
 
-		std::vector<Vertex_Out> clippedVertices_ndc = SutherlandHodgmanClipping(vertices_ndc);
+		//Every mesh uses the built in shaders with the textures of its material
+		const BuiltInVertexShader vertexShader{};
 
-		
-		std::vector<Vector2> vertices_screen{};
-		VertexTransformationToScreenSpace(clippedVertices_ndc, vertices_screen);
-		
+		//Only the meshes the hierarchy can not reject are drawn, Draw still tests their own bounds
+		uint32_t nrQueriedMeshes{};
+		const uint32_t nrBoxesTested{ m_SceneBVH.Query(m_Frustum, [&](uint32_t objectIdx)
+		{
+			++nrQueriedMeshes;
+			const Object& object{ m_Objects[objectIdx] };
+			Draw(*object.pMesh, object.instance, vertexShader, CreateBuiltInPixelShader(object.materialIdx));
+		}) };
 
-		for(uint32_t vertex{}; vertex < clippedVertices_ndc.size(); vertex += 3)
+		if constexpr (FrameStats::m_IsEnabled)
 		{
-			RenderTriangle(vertices_screen, clippedVertices_ndc, {vertex, vertex + 2, vertex + 1});
+			FrameStats& stats{ m_ThreadFrameStats[0] };
+			const uint32_t nrRejectedMeshes{ static_cast<uint32_t>(m_Objects.size()) - nrQueriedMeshes };
+			stats.meshesSubmitted += nrRejectedMeshes;
+			stats.meshesFrustumCulled += nrRejectedMeshes;
+			stats.sceneBoxesTested += nrBoxesTested;
 		}
+
+		EndFrame();
 	}
-	
 
-	//Update SDL Surface
-	SDL_UnlockSurface(m_pBackBuffer);
-	SDL_BlitSurface(m_pBackBuffer, nullptr, m_pFrontBuffer, nullptr);
-	SDL_UpdateWindowSurface(m_pWindow);
+	//After the zone of the frame is closed, so a capture that ends here contains it
+	Tracer::MarkFrame();
 }
 
-
-// function that transforms a vector of WORLD space vertices to a vector of NDC space vertices
-void Renderer::VertexTransformationFunction(const std::vector<Vertex>& vertices_in, std::vector<Vertex_Out>& vertices_out, const Matrix& worldViewProjectionMatrix, const Matrix& meshWorldMatrix)
+void Renderer::BeginFrame()
 {
-	vertices_out.resize(vertices_in.size());
+	std::fill(m_ThreadStageTimes.begin(), m_ThreadStageTimes.end(), StageTimes{});
+	std::fill(m_ThreadFrameStats.begin(), m_ThreadFrameStats.end(), FrameStats{});
+	if constexpr (FrameStats::m_IsEnabled) Texture::TakeSampleCount();
+	m_Frustum = m_Camera.GetFrustum();
 
-	for (size_t i{}; i < vertices_in.size(); ++i)
-	{		
-		// Transform with VIEW matrix (inverse ONB)
-		vertices_out[i].position = worldViewProjectionMatrix.TransformPoint({vertices_in[i].position, 1.0f});
+	++m_FrameIndex;
+	std::erase_if(m_LodStates, [this](const auto& lodState) { return lodState.second.lastFrame + 1 < m_FrameIndex; });
 
-		//Safe the vertex in world space (for specular shading)
-		vertices_out[i].viewDirection = vertices_out[i].position;
-
-
-		//Normals and are transformed with the world matrix
-		vertices_out[i].normal = meshWorldMatrix.TransformVector(vertices_in[i].normal);
-		vertices_out[i].tangent = meshWorldMatrix.TransformVector(vertices_in[i].tangent);
-
-
-		//UV is passed through
-		vertices_out[i].uv = vertices_in[i].uv;
-		
-		// Apply Perspective Divide to the vertices
-		vertices_out[i].position.x /= vertices_out[i].position.w;
-		vertices_out[i].position.y /= vertices_out[i].position.w;
-		vertices_out[i].position.z /= vertices_out[i].position.w;		
-	}
+	const TraceZone zone{ "Clear" };
+	const ScopedStageTimer timer{ GetThreadStageTimes(0), RenderStage::Clear };
+	ResetClearedTiles();
 }
 
-
-// function that transforms a vector of NDC space vertices to a vector of SCREEN space vertices
-void Renderer::VertexTransformationToScreenSpace(const std::vector<Vertex_Out>& vertices_in,
-	std::vector<Vector2>& vertex_out) const
+void Renderer::EndFrame()
 {
+	if (m_UseDeferredTiles)
+	{
+		RenderDeferredTiles();
+	}
+	else
+	{
+		ResolveColorBuffer();
+	}
 
-	vertex_out.reserve(vertices_in.size());
-	
-	const float fWidth{ static_cast<float>(m_Width) };
-	const float fHeight{ static_cast<float>(m_Height) };
-	
-	for (const Vertex_Out& ndcVertex : vertices_in)
+	if constexpr (FrameStats::m_IsEnabled)
 	{
-		vertex_out.emplace_back(
-			fWidth * ((ndcVertex.position.x + 1) / 2.0f),
-			fHeight * ((1.0f - ndcVertex.position.y) / 2.0f)
-		);
+		m_ThreadFrameStats[0].textureSamples += Texture::TakeSampleCount();
+
+		m_FrameStats = {};
+		for (const FrameStats& threadFrameStats : m_ThreadFrameStats)
+		{
+			m_FrameStats += threadFrameStats;
+		}
 	}
 }
 
-void Renderer::RenderTriangle(const std::vector<Vector2>& verticesScreenSpace,
-                              std::vector<Vertex_Out>& verticesNDC, const std::vector<uint32_t>& verticesIndexes) const
+BuiltInPixelShader Renderer::CreateBuiltInPixelShader(uint32_t materialIdx) const
 {
-	//RENDER LOGIC
-	//Calculate the current vertex index
-	//Get index of last vertex,
+	const Material& material{ m_Materials[materialIdx] };
+	BuiltInPixelShader pixelShader{};
+	pixelShader.pDiffuseTexture = material.pDiffuseTexture;
+	pixelShader.pGlossinessTexture = material.pGlossinessTexture;
+	pixelShader.pNormalTexture = material.pNormalTexture;
+	pixelShader.pSpecularTexture = material.pSpecularTexture;
+	pixelShader.pSpecularEvaluator = &m_SpecularEvaluator;
+	pixelShader.shadeMode = m_ShadeMode;
+	pixelShader.useNormalMap = m_UseNormalMap;
+	pixelShader.directionLight = m_DirectionLight;
+	pixelShader.lightIntensity = m_lightIntensity;
+	pixelShader.glossiness = m_Glossiness;
+	pixelShader.ambientLight = m_AmbientLight;
+	return pixelShader;
+}
 
-	const uint32_t vertexIndex0{ verticesIndexes[0] };
-	const uint32_t vertexIndex1{ verticesIndexes[1] };
-	const uint32_t vertexIndex2{ verticesIndexes[2] };
-	
-	//If A triangle has the same vertex, skip it
-	if (vertexIndex0 == vertexIndex1 || vertexIndex1 == vertexIndex2 || vertexIndex0 == vertexIndex2) return;
-		
-	// Get all the current vertices
-	const Vector2 v0{ verticesScreenSpace[vertexIndex0] };
-	const Vector2 v1{ verticesScreenSpace[vertexIndex1] };
-	const Vector2 v2{ verticesScreenSpace[vertexIndex2] };
-
-	// Calculate the edges of the current triangle
-	const Vector2 edge01{ v1 - v0 };
-	const Vector2 edge12{ v2 - v1 };
-	const Vector2 edge20{ v0 - v2 };
-
-	// Calculate the area of the current triangle
-	const float fullTriangleArea{ Vector2::Cross(edge01, edge12) };
-	
-	// Calculate the bounding box of this triangle
-	const Vector2 minBoundingBox{ Vector2::Min(v0, Vector2::Min(v1, v2)) };
-	const Vector2 maxBoundingBox{ Vector2::Max(v0, Vector2::Max(v1, v2)) };
+bool Renderer::IsMeshCulled(const Mesh& mesh, const Matrix& worldMatrix, bool isCullable) const
+{
+	FrameStats& stats{ m_ThreadFrameStats[0] };
+	if constexpr (FrameStats::m_IsEnabled) ++stats.meshesSubmitted;
 
-	// A margin that enlarges the bounding box, makes sure that some pixels do no get ignored
-	constexpr int margin{ 1 };
+	if (!isCullable || !m_Frustum.AreBoundsOutside(mesh.bounds, mesh.boundingSphere, worldMatrix)) return false;
 
-	// Calculate the start and end pixel bounds of this triangle
-	const int startX{ std::clamp(static_cast<int>(minBoundingBox.x - margin), 0, m_Width) };
-	const int startY{ std::clamp(static_cast<int>(minBoundingBox.y - margin), 0, m_Height) };
-	const int endX{ std::clamp(static_cast<int>(maxBoundingBox.x + margin), 0, m_Width) };
-	const int endY{ std::clamp(static_cast<int>(maxBoundingBox.y + margin), 0, m_Height) };
+	if constexpr (FrameStats::m_IsEnabled) ++stats.meshesFrustumCulled;
+	return true;
+}
 
+const Mesh& Renderer::SelectLod(const Mesh& mesh, const Matrix& worldMatrix, const void* pKey)
+{
+	if (!m_UseLods || mesh.lods.empty() || mesh.boundingSphere.radius <= 0.f) return mesh;
 
-	
-	// For each pixel
-	for (int px{startX}; px < endX; ++px)
+	//Radius of the bounding sphere on screen in pixels, the error of a level is a part of that radius
+	const float maxScale{ Frustum::GetMaxScale(worldMatrix) };
+	const float distance{ (worldMatrix.TransformPoint(mesh.boundingSphere.center) - m_Camera.origin).Magnitude() };
+	const float projectedRadius{ mesh.boundingSphere.radius * maxScale / (distance * m_Camera.fov) * 0.5f * static_cast<float>(m_Height) };
+	const auto getPixelError = [&mesh, projectedRadius](uint32_t level)
 	{
-		for (int py{startY}; py < endY; ++py)
-		{
+		return level == 0 ? 0.f : mesh.lods[level - 1].simplificationError / mesh.boundingSphere.radius * projectedRadius;
+	};
+
+	//Within the sphere the camera can be arbitrarily close to the surface
+	//The level of another mesh means nothing for this one and can be past its last level
+	LodState& state{ m_LodStates[pKey] };
+	if (state.pMesh != &mesh) state = { &mesh };
+	uint32_t level{ distance > mesh.boundingSphere.radius * maxScale ? std::min(state.level, static_cast<uint32_t>(mesh.lods.size())) : 0 };
+	while (level > 0 && getPixelError(level) > m_LodPixelError) --level;
+	while (level < mesh.lods.size() && getPixelError(level + 1) <= m_LodPixelError * m_LodHysteresis) ++level;
+	state = { &mesh, level, m_FrameIndex };
+
+	const Mesh& lod{ level == 0 ? mesh : mesh.lods[level - 1] };
+	if constexpr (FrameStats::m_IsEnabled) m_ThreadFrameStats[0].trianglesLodRemoved += mesh.GetTriangleCount() - lod.GetTriangleCount();
+	return lod;
+}
 
-			//Reset final color
-			ColorRGB finalColor{ 0, 0, 0 };
-		
-			// Calculate the pixel index and create a Vector2 of the current pixel
-			const int pixelIdx{ px + py * m_Width };
-			const Vector2 curPixel{ static_cast<float>(px), static_cast<float>(py) };
-
-			// Calculate the vector between the first vertex and the point
-			const Vector2 v0ToPoint{ curPixel - v0 };
-			const Vector2 v1ToPoint{ curPixel - v1 };
-			const Vector2 v2ToPoint{ curPixel - v2 };
-
-			// Calculate cross product from edge to start to point
-			const float edge01PointCross{ Vector2::Cross(edge01, v0ToPoint) };
-			const float edge12PointCross{ Vector2::Cross(edge12, v1ToPoint) };
-			const float edge20PointCross{ Vector2::Cross(edge20, v2ToPoint) };
-
-			// Check if pixel is inside triangle, if not continue to the next pixel
-			if (!(edge01PointCross > 0 && edge12PointCross > 0 && edge20PointCross > 0)) continue;
-
-			// Calculate the barycentric weights
-			const float weightV0{ edge12PointCross / fullTriangleArea };
-			const float weightV1{ edge20PointCross / fullTriangleArea };
-			const float weightV2{ edge01PointCross / fullTriangleArea };
-
-//-------------------------------------------------------------------------------
-			//Calculate the Z depth
-			const float depthV0{ (verticesNDC[vertexIndex0].position.z) };
-			const float depthV1{ (verticesNDC[vertexIndex1].position.z) };
-			const float depthV2{ (verticesNDC[vertexIndex2].position.z) };
-
-			// Calculate the depth at this pixel
-			const float interpolatedDepth
-			{
-				1.0f /
-					(weightV0  / depthV0 +
-					weightV1  / depthV1 +
-					weightV2 / depthV2)
-			};
+std::vector<uint32_t> Renderer::CullInstances(const Mesh& mesh, std::span<const MeshInstance> instances, bool isCullable) const
+{
+	std::vector<uint32_t> visibleInstances{};
+	if (isCullable)
+	{
+		visibleInstances.reserve(instances.size());
+		FindVisibleInstances(m_Frustum, mesh.boundingSphere, instances, visibleInstances);
+	}
+	else
+	{
+		visibleInstances.resize(instances.size());
+		std::iota(visibleInstances.begin(), visibleInstances.end(), 0u);
+	}
 
-			// If this pixel hit is further away then a previous pixel hit, continue to the next pixel
-			if (m_pDepthBufferPixels[pixelIdx] < interpolatedDepth) continue;
+	//Every instance counts as a mesh
+	if constexpr (FrameStats::m_IsEnabled)
+	{
+		FrameStats& stats{ m_ThreadFrameStats[0] };
+		stats.meshesSubmitted += instances.size();
+		stats.meshesFrustumCulled += instances.size() - visibleInstances.size();
+	}
+	return visibleInstances;
+}
 
-			// Save the new depth
-			m_pDepthBufferPixels[pixelIdx] = interpolatedDepth;
+std::vector<uint32_t> Renderer::CullMeshlets(const Mesh& mesh, const DrawConstants& constants, FrameStats& stats) const
+{
+	//Both tests run in object space, so the bounds of the meshlets are used as they are
+	const Frustum frustum{ Frustum::FromMatrix(constants.worldViewProjectionMatrix) };
+	const Vector3 cameraPosition{ Matrix::Inverse(constants.worldMatrix).TransformPoint(m_Camera.origin) };
 
-//-------------------------------------------------------------------------------
+	//A mirroring world matrix turns the back of a triangle into its front
+	const Matrix& world{ constants.worldMatrix };
+	const bool canCullBackFaces{ Vector3::Dot(Vector3::Cross(world.GetAxisX(), world.GetAxisY()), world.GetAxisZ()) > 0.f };
 
-			if(m_DisplayDepthBuffer)
+	std::vector<uint32_t> visibleMeshlets{};
+	visibleMeshlets.reserve(mesh.meshlets.size());
+	for (uint32_t meshletIdx{}; meshletIdx < mesh.meshlets.size(); ++meshletIdx)
+	{
+		const Meshlet& meshlet{ mesh.meshlets[meshletIdx] };
+		if (frustum.IsSphereOutside(meshlet.center, meshlet.radius))
+		{
+			if constexpr (FrameStats::m_IsEnabled)
 			{
-				//Display the depth buffer when needed
-				//Remap the interpolated depthColor to a range between 0 and 1
-				// Min and Max values of the original range
-				constexpr float minValue = 0.92f;
-				constexpr float maxValue = 1.f;
-
-				// Remap the value to the range [0, 1]
-				float remappedValue = (interpolatedDepth - minValue) / (maxValue - minValue);
-				remappedValue = std::clamp(remappedValue, 0.f, 1.f);
-				
-				finalColor =  ColorRGB{remappedValue, remappedValue, remappedValue};
-				finalColor.MaxToOne();
-				
-				
-				m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-					static_cast<uint8_t>(finalColor.r * 255),
-					static_cast<uint8_t>(finalColor.g * 255),
-					static_cast<uint8_t>(finalColor.b * 255));
-
-
-				//I only calculate the first pixel of every vertex...
-				continue;
+				++stats.meshletsFrustumCulled;
+				stats.trianglesMeshletCulled += meshlet.triangleCount;
 			}
+			continue;
+		}
 
-			
-
-			//Calculate W the depth
-			const float WdepthV0{ (verticesNDC[vertexIndex0].position.w) };
-			const float WdepthV1{ (verticesNDC[vertexIndex1].position.w) };
-			const float WdepthV2{ (verticesNDC[vertexIndex2].position.w) };
-			
-			
-			// Calculate the depth at this pixel -> Linear [0,1]
-			const float interpolatedWDepth
-			{
-				1.0f /
-					(weightV0  / WdepthV0 +
-					weightV1  / WdepthV1 +
-					weightV2 / WdepthV2)
-			};
-			
-
-
-			//Interpolate the needed values for shading
-			Vertex_Out shadePixel{};
-			
-			//Calculate the UV
-			shadePixel.uv =
-			{
-				(weightV0 * verticesNDC[vertexIndex0].uv / WdepthV0 +
-				weightV1 * verticesNDC[vertexIndex1].uv / WdepthV1 +
-				weightV2 * verticesNDC[vertexIndex2].uv / WdepthV2) * interpolatedWDepth
-			};
-			
-			
-			#if TextureTiling
-			// Wrap UV coordinates to the [0, 1] range
-			shadePixel.uv.x = fmod(shadePixel.uv.x, 1.0f);
-			shadePixel.uv.y = fmod(shadePixel.uv.y, 1.0f);
-			if (shadePixel.uv.x < 0.0f) shadePixel.uv.x += 1.0f;
-			if (shadePixel.uv.y < 0.0f) shadePixel.uv.y += 1.0f;
-			#else
-			
-			// Clamp UV coordinates to the [0, 1] range
-			shadePixel.uv.x = std::clamp(shadePixel.uv.x, 0.0f, 1.0f);
-			shadePixel.uv.y = std::clamp(shadePixel.uv.y, 0.0f, 1.0f);
-			#endif
-
-			//Calculate the normal
-			shadePixel.normal =
-			{
-				((weightV0 * verticesNDC[vertexIndex0].normal / WdepthV0 +
-				weightV1 * verticesNDC[vertexIndex1].normal / WdepthV1 +
-				weightV2 * verticesNDC[vertexIndex2].normal / WdepthV2) * interpolatedWDepth).Normalized()
-			};
-
-			//Calculate the tangent
-			shadePixel.tangent =
-			{
-				((weightV0 * verticesNDC[vertexIndex0].tangent / WdepthV0 +
-				weightV1 * verticesNDC[vertexIndex1].tangent / WdepthV1 +
-				weightV2 * verticesNDC[vertexIndex2].tangent / WdepthV2) * interpolatedWDepth).Normalized()
-			};
-
-
-			//Calculate the view direction
-			shadePixel.viewDirection = 
+		if (canCullBackFaces && IsMeshletBackFacing(meshlet, cameraPosition))
+		{
+			if constexpr (FrameStats::m_IsEnabled)
 			{
-				((weightV0 * verticesNDC[vertexIndex0].viewDirection / WdepthV0 +
-				weightV1 * verticesNDC[vertexIndex1].viewDirection / WdepthV1 +
-				weightV2 * verticesNDC[vertexIndex2].viewDirection / WdepthV2) * interpolatedWDepth).Normalized()
-			};
-
-			
-			Shade(shadePixel, finalColor);
-			
-			finalColor.MaxToOne();
-			
-			m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-				static_cast<uint8_t>(finalColor.r * 255),
-				static_cast<uint8_t>(finalColor.g * 255),
-				static_cast<uint8_t>(finalColor.b * 255));
+				++stats.meshletsBackFaceCulled;
+				stats.trianglesMeshletCulled += meshlet.triangleCount;
+			}
+			continue;
 		}
+
+		visibleMeshlets.push_back(meshletIdx);
 	}
+	return visibleMeshlets;
 }
 
+void Renderer::CycleSpecularMode()
+{
+	m_SpecularEvaluator.CycleMode();
+
+	//Report how far the selected method is from std::pow
+	const SpecularEvaluator::ErrorReport report{ m_SpecularEvaluator.MeasureError(m_SpecularEvaluator.GetMode()) };
+	std::cout << "Specular mode: " << SpecularEvaluator::GetModeName(report.mode)
+		<< " | max error: " << report.maxAbsoluteError
+		<< " | mean error: " << report.meanAbsoluteError
+		<< " (" << report.sampleCount << " samples)" << std::endl;
+}
 
-
-
-
-
-void Renderer::Shade(const Vertex_Out& vertex, ColorRGB& finalColor) const
+void Renderer::CycleDepthFormat()
 {
+	//Takes effect at the next frame, the depth buffer is cleared in the new format then
+	m_DepthFormat = static_cast<DepthFormat>((static_cast<int>(m_DepthFormat) + 1) % 4);
+	std::cout << "Depth format: " << GetDepthFormatName(m_DepthFormat) << std::endl;
+}
 
-	assert(m_pTexture);
-	assert(m_pGlossinessTexture);
-	assert(m_pNormalTexture);
-	assert(m_pSpecularTexture);
+bool Renderer::SaveBufferToImage() const
+{
+	return !SaveImage(m_RenderTarget, "Rasterizer_ColorBuffer.bmp", ImageFileFormat::BMP);
+}
 
-	
-	Vector3 normal{ vertex.normal };
 
-	//Use the normal map when enabled and the texture is loaded correctly
-	if(m_UseNormalMap && m_pNormalTexture)
-	{
-		//First we would need the normal in tangent space
-		//Calculate the biNormal
-		const Vector3 biNormal{ Vector3::Cross(vertex.normal, vertex.tangent) };
-		const Matrix tangentSpaceAxis{vertex.tangent, biNormal, vertex.normal, Vector3::Zero};
-
-		//Sample the normal map
-		ColorRGB normalSample = m_pNormalTexture->Sample(vertex.uv);
-		
-		//bring the normal map from [0, 1] to [-1, 1]
-		normalSample = (normalSample * 2.f) - ColorRGB{ 1.f, 1.f, 1.f };
-		
-		const Vector3 normalSampled =  {normalSample.r, normalSample.g, normalSample.b};
-		normal = tangentSpaceAxis.TransformVector(normalSampled);
-	}
-	
-	
-	
-	const float observedArea{ std::max(Vector3::Dot(normal.Normalized(), -m_DirectionLight.Normalized()), 0.0f) };
+void Renderer::ResetClearedTiles()
+{
+	m_ClearColor = m_PixelLayout.Pack(100, 100, 100);
+	std::fill(m_ClearedTiles.begin(), m_ClearedTiles.end(), uint8_t{});
+}
 
+void Renderer::ResolveColorBuffer() const
+{
+	const RasterTarget screenTarget{ GetScreenTarget() };
+	const TraceZone zone{ "Present" };
+	const ScopedStageTimer timer{ screenTarget.pStageTimes, RenderStage::Present };
 
-	
-	switch (m_ShadeMode)
+	for (int tileY{}; tileY < m_NrTilesY; ++tileY)
 	{
-		case ShadeMode::ObservedArea:
+		for (int tileX{}; tileX < m_NrTilesX; ++tileX)
 		{
-			finalColor = ColorRGB{ observedArea, observedArea, observedArea };
-			return;
-		}
-		
-		case ShadeMode::Diffuse:
-		{
-			// cd * (kd) / PI
-			const ColorRGB lambert{ m_pTexture->Sample(vertex.uv) / PI };
-			finalColor = ColorRGB(m_lightIntensity * observedArea * lambert);
-			return;
-		}
+			const int tileStartX{ tileX * m_TileSize };
+			const int tileStartY{ tileY * m_TileSize };
+			const int tileEndX{ std::min(tileStartX + m_TileSize, m_Width) };
+			const int tileEndY{ std::min(tileStartY + m_TileSize, m_Height) };
 
-		case ShadeMode::Specular:
-		{
-				const auto reflectedLight{ Vector3::Reflect(-m_DirectionLight, normal) };
-				const auto reflectedViewDot{ std::max(Vector3::Dot(reflectedLight, vertex.viewDirection), 0.0f) };
-				
-
-				const float phongExponent{ m_Glossiness * (m_pGlossinessTexture->Sample(vertex.uv).r / 255.f) };
-				const auto phong = std::powf(reflectedViewDot, phongExponent);
-				const ColorRGB phongColor{ phong, phong, phong };
-				const ColorRGB specularColor{ m_pSpecularTexture->Sample(vertex.uv)  * phongColor };
+			if (!m_ClearedTiles[tileX + tileY * m_NrTilesX])
+			{
+				//The renderer never reads these pixels back, so they bypass the cache
+				for (int y{ tileStartY }; y < tileEndY; ++y)
+				{
+					StreamFill(m_pTargetPixels + tileStartX + y * m_TargetPitch, tileEndX - tileStartX, m_ClearColor);
+				}
+				continue;
+			}
 
+			for (int y{ tileStartY }; y < tileEndY; ++y)
+			{
+				uint32_t* pDestination{ m_pTargetPixels + y * m_TargetPitch };
 
-				finalColor = m_lightIntensity * specularColor * observedArea;
-				return;
-		}
-		
-		case ShadeMode::Combined:
-		{
-				const auto reflectedLight{ Vector3::Reflect(-m_DirectionLight, normal) };
-				const auto reflectedViewDot{ std::max(Vector3::Dot(reflectedLight, vertex.viewDirection), 0.0f) };
-				
-
-				const float phongExponent{ m_Glossiness * (m_pGlossinessTexture->Sample(vertex.uv).r / 255.f) };
-				const auto phong = std::powf(reflectedViewDot, phongExponent);
-				const ColorRGB phongColor{ phong, phong, phong };
-				const ColorRGB specularColor{ m_pSpecularTexture->Sample(vertex.uv)  * phongColor };
-				
-				const ColorRGB lambert{ m_pTexture->Sample(vertex.uv) / PI };
-				const ColorRGB ambient{ m_AmbientLight, m_AmbientLight, m_AmbientLight} ;
-				
-				finalColor = (m_lightIntensity * lambert + specularColor + ambient) * observedArea;
-				return;
+				for (int x{ tileStartX }; x < tileEndX; x += m_BlockSize)
+				{
+					ResolveBlockRow(m_pColorBuffer + screenTarget.GetPixelIndex(x, y) * m_SampleCount, pDestination + x, std::min(m_BlockSize, tileEndX - x), m_SampleCount);
+				}
+			}
 		}
 	}
+
+	StoreFence();
+}
+
+StageTimes Renderer::GetStageTimes() const
+{
+	StageTimes stageTimes{};
+	for (const StageTimes& threadStageTimes : m_ThreadStageTimes)
+	{
+		stageTimes += threadStageTimes;
+	}
+	return stageTimes;
 }
 
-std::vector<Vertex_Out> dae::Renderer::ClipAgainstPlane(const std::vector<Vertex_Out>& inputVertices,
-	const Vector4& plane)
+void Renderer::RenderDeferredTiles()
 {
-	std::vector<Vertex_Out> outputVertices;
+	const int nrTiles{ m_NrTilesX * m_NrTilesY };
+	const TraceZone zone{ "Render tiles" };
 
-	// Loop through each edge of the polygon
-	const size_t numVertices = inputVertices.size();
-	for (size_t i = 0; i < numVertices; ++i)
+	//The raster state can not change during a frame, so every draw was recorded with this one
+	DispatchRasterState([&]<DepthFormat Format, int SampleCount>()
 	{
-		// Current and next vertex in the input list
-		const Vertex_Out& currentVertex = inputVertices[i];
-		const Vertex_Out& nextVertex = inputVertices[(i + 1) % numVertices];
+		m_ThreadPool.ParallelFor(nrTiles, [this](int tileIdx, uint32_t threadIdx)
+		{
+			RenderDeferredTile<Format, SampleCount>(tileIdx, threadIdx);
+		});
+	});
 
-		// Calculate distances from the plane for the current and next vertices
+	m_DeferredDraws.clear();
+}
 
-		const float d1 = Vector4::Dot(plane, currentVertex.position) + plane.w;
-		const float d2 = Vector4::Dot(plane, nextVertex.position)+ plane.w;
+Renderer::RasterTarget Renderer::GetScreenTarget() const
+{
+	RasterTarget target{};
+	target.pColor = m_pColorBuffer;
+	target.pDepth = m_pDepthBuffer;
+	target.maxX = m_Width;
+	target.maxY = m_Height;
+	target.nrBlocksX = m_NrBlocksX;
+	target.clearsLazily = true;
+	target.pStageTimes = GetThreadStageTimes(0);
+	target.pStats = &m_ThreadFrameStats[0];
+	return target;
+}
 
+void Renderer::GetTriangleTiles(const Vector2& v0, const Vector2& v1, const Vector2& v2, int& minTileX, int& minTileY, int& maxTileX, int& maxTileY) const
+{
+	const Vector2 minBoundingBox{ Vector2::Min(v0, Vector2::Min(v1, v2)) };
+	const Vector2 maxBoundingBox{ Vector2::Max(v0, Vector2::Max(v1, v2)) };
 
-		// Check if the vertices are inside or outside the clipping plane
-		if (d1 >= 0)
-		{
-			outputVertices.push_back(currentVertex);
-		}
+	// Same margin and quad alignment as RenderTriangle, the last quad can reach one pixel past the end
+	const int margin{ m_SampleCount > 1 ? 2 : 1 };
+	const int startX{ std::clamp(static_cast<int>(minBoundingBox.x - margin), 0, m_Width) & ~1 };
+	const int startY{ std::clamp(static_cast<int>(minBoundingBox.y - margin), 0, m_Height) & ~1 };
+	const int endX{ std::min(std::clamp(static_cast<int>(maxBoundingBox.x + margin), 0, m_Width) + 1, m_Width) };
+	const int endY{ std::min(std::clamp(static_cast<int>(maxBoundingBox.y + margin), 0, m_Height) + 1, m_Height) };
 
-		// Check for intersection and add the intersection point
-		if(d1 * d2 < 0)
-		//if((d1 >= 0 && d2 < 0) || (d1 < 0 && d2 >= 0))
-		{
-			const float t = d1 / (d1 - d2);
-			const Vector4 intersectionPoint = currentVertex.position + (nextVertex.position - currentVertex.position) * t;
-			
-			Vertex_Out newVertex = currentVertex;
-			newVertex.position = intersectionPoint;
-			outputVertices.push_back(newVertex);
-		}
-	}
+	minTileX = startX / m_TileSize;
+	minTileY = startY / m_TileSize;
 
-	return outputVertices;
+	// An empty range gives max < min
+	maxTileX = endX > startX ? (endX - 1) / m_TileSize : minTileX - 1;
+	maxTileY = endY > startY ? (endY - 1) / m_TileSize : minTileY - 1;
 }
 
-std::vector<Vertex_Out> Renderer::SutherlandHodgmanClipping(const std::vector<Vertex_Out>& inputVertices)
+float Renderer::ReadDepth(int x, int y) const
 {
-	//std::vector<Vertex_Out> outputVertices = inputVertices;
-	// if(inputVertices.size() < 3) return outputVertices;
-	//
-	// // Define the clipping cube in NDC space
-	// const float xmin = -1.0f, xmax = 1.0f;
-	// const float ymin = -1.0f, ymax = 1.0f;
-	// const float zmin = -1.0f, zmax = 1.0f;
-	//
-	// // Clip against each of the six planes of the clipping cube
-	// outputVertices = ClipAgainstPlane(outputVertices, { 1, 0, 0, -xmin });
-	// outputVertices = ClipAgainstPlane(outputVertices, { -1, 0, 0, xmax });
-	// outputVertices = ClipAgainstPlane(outputVertices, { 0, 1, 0, -ymin });
-	// outputVertices = ClipAgainstPlane(outputVertices, { 0, -1, 0, ymax });
-	// outputVertices = ClipAgainstPlane(outputVertices, { 0, 0, 1, -zmin });
-	// outputVertices = ClipAgainstPlane(outputVertices, { 0, 0, -1, zmax });
-
-	std::vector<Vertex_Out> outputVertices;
-	outputVertices.reserve(inputVertices.size());
-	
-	for(uint32_t vertex{}; vertex < inputVertices.size(); vertex += 3)
+	const int sampleIdx{ GetScreenTarget().GetPixelIndex(x, y) * m_SampleCount };
+	const bool isWritten{ m_UseDeferredTiles ? m_DepthReadback : m_ClearedTiles[x / m_TileSize + (y / m_TileSize) * m_NrTilesX] != 0 };
+
+	float depth{};
+	DispatchRasterState([&]<DepthFormat Format, int SampleCount>()
 	{
-		std::vector<uint32_t> index =  {vertex, vertex + 1, vertex + 2};
+		depth = DecodeDepth<Format>(sampleIdx, isWritten);
+	});
+	return depth;
+}
 
-		bool isOneOutofFrustum = false;
-		for(const auto vertexIndex : index)
-		{
-			if(Camera::IsOutsideFrustum(inputVertices[vertexIndex].position))
-			{
-				isOneOutofFrustum = true;
-				break;
-			}
-		}
-		
-		if(!isOneOutofFrustum)
-		{
-			outputVertices.push_back(inputVertices[index[0]]);
-			outputVertices.push_back(inputVertices[index[1]]);
-			outputVertices.push_back(inputVertices[index[2]]);
-		}
+void Renderer::StreamFill(uint32_t* pPixels, int count, uint32_t value)
+{
+#if RENDERER_SSE
+	//The unaligned start and end of the row use regular stores
+	int i{};
+	for (; i < count && reinterpret_cast<uintptr_t>(pPixels + i) % 16 != 0; ++i)
+	{
+		pPixels[i] = value;
 	}
 
-			
-	outputVertices.shrink_to_fit();
-	return outputVertices;
-}
+	const __m128i values{ _mm_set1_epi32(static_cast<int>(value)) };
+	for (; i + 4 <= count; i += 4)
+	{
+		_mm_stream_si128(reinterpret_cast<__m128i*>(pPixels + i), values);
+	}
 
+	for (; i < count; ++i)
+	{
+		pPixels[i] = value;
+	}
+#else
+	std::fill_n(pPixels, count, value);
+#endif
+}
 
-bool Renderer::SaveBufferToImage() const
+void Renderer::StoreFence()
 {
-	return SDL_SaveBMP(m_pBackBuffer, "Rasterizer_ColorBuffer.bmp");
+#if RENDERER_SSE
+	_mm_sfence();
+#endif
 }
 
-
-void Renderer::ClearBackground() const
+void Renderer::CopyBlockRow(const uint32_t* pSource, uint32_t* pDestination, int count)
 {
-	SDL_FillRect(m_pBackBuffer, nullptr, SDL_MapRGB(m_pBackBuffer->format, 100, 100, 100));
+#if RENDERER_SSE
+	//A full block row is 8 pixels, two 16 byte vectors
+	if (count == m_BlockSize)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination), _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSource)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination + 4), _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSource + 4)));
+		return;
+	}
+#endif
+	std::copy_n(pSource, count, pDestination);
 }
 
-void Renderer::ResetDepthBuffer() const
+void Renderer::ResolveBlockRow(const uint32_t* pSamples, uint32_t* pDestination, int count, int sampleCount)
 {
-	const int nrPixels{ m_Width * m_Height };
-	std::fill_n(m_pDepthBufferPixels, nrPixels, FLT_MAX);
+	if (sampleCount == 1)
+	{
+		CopyBlockRow(pSamples, pDestination, count);
+		return;
+	}
+
+	//Averages every 8 bit channel, two channels at a time in the 16 bit halves of a word
+	//Works for any 32 bit format with 8 bits per channel, the sample count is a power of 2
+	const int shift{ std::countr_zero(static_cast<uint32_t>(sampleCount)) };
+	const uint32_t rounding{ (static_cast<uint32_t>(sampleCount) / 2) * 0x00010001u };
+
+	for (int pixel{}; pixel < count; ++pixel)
+	{
+		uint32_t evenChannels{ rounding };
+		uint32_t oddChannels{ rounding };
+		for (int sample{}; sample < sampleCount; ++sample)
+		{
+			const uint32_t color{ pSamples[pixel * sampleCount + sample] };
+			evenChannels += color & 0x00FF00FF;
+			oddChannels += (color >> 8) & 0x00FF00FF;
+		}
+
+		pDestination[pixel] = ((evenChannels >> shift) & 0x00FF00FF) | (((oddChannels >> shift) & 0x00FF00FF) << 8);
+	}
 }
@@ -1,83 +1,362 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
 #include <cstdint>
+#include <functional>
+#include <numeric>
+#include <span>
+#include <string>
+#include <unordered_map>
 #include <vector>
+#include "AssetManager.h"
 #include "Camera.h"
 #include "DataTypes.h"
-
-struct SDL_Window;
-struct SDL_Surface;
+#include "DepthFormat.h"
+#include "FrameStats.h"
+#include "Frustum.h"
+#include "Instancing.h"
+#include "RenderTarget.h"
+#include "SceneBVH.h"
+#include "Shader.h"
+#include "Shaders.h"
+#include "StageTimer.h"
+#include "ThreadPool.h"
+#include "Trace.h"
 
 namespace dae
 {
 	class Texture;
 	struct Mesh;
 	struct Vertex;
-	struct Vertex_Out;
 	class Timer;
 	class Scene;
 
-
-
-	enum class ShadeMode
-	{
-		ObservedArea,
-		Diffuse,
-		Specular,
-		Combined
-	};
-
 	class Renderer final
 	{
 	public:
-		Renderer(SDL_Window* pWindow);
+		//Renders into caller owned memory, no window or SDL video subsystem is needed
+		//Loads the assets, camera and light of the scene file, see ParseScene, an empty path starts without a scene
+		//Check IsSceneLoaded, a scene that failed to load leaves the renderer empty
+		explicit Renderer(const RenderTarget& renderTarget, const std::string& scenePath = "Resources/vehicle.scene");
 		~Renderer();
 
+		bool IsSceneLoaded() const { return m_IsSceneLoaded; }
+
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
 		void Update(Timer* pTimer);
+
+		//Drive the scene without input or a timer, for batch rendering
+		//Angles are in radians, the meshes rotate around the world up axis
+		void SetCameraPose(const Vector3& origin, float yaw, float pitch) { m_Camera.SetPose(origin, yaw, pitch); }
+		void RotateMeshes(float angle);
 		void Render();
 		bool SaveBufferToImage() const;
 
+		//Points the renderer at other memory, the internal buffers are only reallocated when the size changes
+		void SetRenderTarget(const RenderTarget& renderTarget);
+		const RenderTarget& GetRenderTarget() const { return m_RenderTarget; }
+
+		//Clears the buffers, every Draw call has to happen between BeginFrame and EndFrame
+		//EndFrame writes the finished frame into the render target
+		void BeginFrame();
+		void EndFrame();
+
+		//Draws a mesh with a user defined material, nothing happens when its bounds are outside of the frustum
+		//The shaders are template parameters so the shade call is resolved at compile time
+		template<VertexShader TVertexShader, PixelShader<typename TVertexShader::Varyings> TPixelShader>
+		void Draw(const Mesh& mesh, const TVertexShader& vertexShader, const TPixelShader& pixelShader);
+		//Same, with the world matrix and parameters of the instance instead of the worldMatrix of the mesh, so meshes can be shared
+		//The instance keeps its address between frames, it identifies the draw for the level of detail hysteresis
+		template<VertexShader TVertexShader, PixelShader<typename TVertexShader::Varyings> TPixelShader>
+		void Draw(const Mesh& mesh, const MeshInstance& instance, const TVertexShader& vertexShader, const TPixelShader& pixelShader);
+
+		//Draws the mesh once per instance with the world matrix of the instance, the worldMatrix of the mesh is not used
+		//The level of detail is picked per instance, so instances keep their address between frames for the hysteresis
+		//The instances are culled four at a time before any vertex work, the visible ones share the object space vertices of the mesh
+		template<VertexShader TVertexShader, PixelShader<typename TVertexShader::Varyings> TPixelShader>
+		void DrawInstanced(const Mesh& mesh, std::span<const MeshInstance> instances, const TVertexShader& vertexShader, const TPixelShader& pixelShader);
+
 		void ToggleDepthBufferDisplay() { m_DisplayDepthBuffer = !m_DisplayDepthBuffer; }
 		void ToggleNormalMap() { m_UseNormalMap = !m_UseNormalMap; }
 		void CycleShadeMode() { m_ShadeMode = static_cast<ShadeMode>((static_cast<int>(m_ShadeMode) + 1) % 4); }
 		void ToggleRotation() {m_Rotate = !m_Rotate;}
-		
+		//Meshes are drawn with their coarsest level of detail whose simplification error stays below m_LodPixelError pixels
+		void ToggleLods() { m_UseLods = !m_UseLods; }
+		void SetLods(bool isEnabled) { m_UseLods = isEnabled; }
+		void CycleSpecularMode();
+		void CycleDepthFormat();
+		void SetDepthFormat(DepthFormat format) { m_DepthFormat = format; }
+
+		//Tile based deferred mode: draws are binned per tile and every tile is rendered by a worker thread
+		//in a stack buffer, so depth never leaves the cache unless depth readback is enabled
+		void ToggleDeferredTiles() { m_UseDeferredTiles = !m_UseDeferredTiles; }
+		void SetDeferredTiles(bool isEnabled) { m_UseDeferredTiles = isEnabled; }
+		void SetDepthReadback(bool isEnabled) { m_DepthReadback = isEnabled; }
+
+		bool IsUsingDeferredTiles() const { return m_UseDeferredTiles; }
+		int GetSampleCount() const { return m_SampleCount; }
+		DepthFormat GetDepthFormat() const { return m_DepthFormat; }
+		uint32_t GetThreadCount() const { return m_ThreadPool.GetThreadCount(); }
+
+		//Times every stage of the frame, reset in BeginFrame so GetStageTimes returns the last frame
+		//The times are summed over all threads, so with the deferred mode they add up to more than the frame time
+		void SetStageTiming(bool isEnabled) { m_MeasureStages = isEnabled; }
+		StageTimes GetStageTimes() const;
+
+		//Pipeline counters of the last frame, all zero when built with RASTERIZER_STATS=0
+		const FrameStats& GetFrameStats() const { return m_FrameStats; }
+
+		//Depth of the last frame in the encoding of the current depth format, the first sample with MSAA
+		//Only valid in the immediate mode or with depth readback enabled
+		float ReadDepth(int x, int y) const;
+
+		//4x MSAA: coverage and depth per sample, shading once per pixel and triangle, resolved at present
+		void ToggleMSAA() { m_SampleCount = m_SampleCount == 1 ? m_MaxSampleCount : 1; }
+		void SetMSAA(bool isEnabled) { m_SampleCount = isEnabled ? m_MaxSampleCount : 1; }
+
 	private:
-		void ClearBackground() const;
-		void ResetDepthBuffer() const;
+		//Largest simplification error in pixels a level of detail may show
+		static constexpr float m_LodPixelError{ 1.f };
+		//A coarser level is only taken below this part of m_LodPixelError, so a mesh near the limit does not switch every frame
+		static constexpr float m_LodHysteresis{ 0.75f };
+
+		//Number of fragments that are shaded together by a batch pixel shader
+		static constexpr int m_FragmentBatchSize{ 16 };
+
+		//The color and depth buffers are stored in 8x8 blocks, a block is 64 consecutive pixels
+		//so the footprint of a small triangle only touches a few cache lines
+		static constexpr int m_BlockShift{ 3 };
+		static constexpr int m_BlockSize{ 1 << m_BlockShift };
+		static constexpr int m_BlockPixels{ m_BlockSize * m_BlockSize };
+
+		//Samples of a pixel are stored next to each other, so the blocked layout stays the same per pixel
+		//Rotated grid positions in pixels, relative to the position the single sample mode uses
+		static constexpr int m_MaxSampleCount{ 4 };
+		static constexpr std::array<float, m_MaxSampleCount> m_SampleOffsetsX{ -2.f / 16.f, 6.f / 16.f, -6.f / 16.f, 2.f / 16.f };
+		static constexpr std::array<float, m_MaxSampleCount> m_SampleOffsetsY{ -6.f / 16.f, -2.f / 16.f, 2.f / 16.f, 6.f / 16.f };
+
+		//Tiles are the unit of lazy clearing and of the deferred mode, a whole number of blocks
+		//The color and depth of a tile take 8KB, small enough to stay in the cache of a worker
+		static constexpr int m_TileSize{ 32 };
+		static constexpr int m_TileBlocks{ m_TileSize / m_BlockSize };
+		static constexpr int m_TilePixels{ m_TileSize * m_TileSize };
+
+		//The buffers the raster functions write to, either the full screen buffers or the stack buffers of one tile
+		//Both are stored in blocks, the target covers the pixels [minX, maxX) x [minY, maxY) of the screen
+		struct RasterTarget
+		{
+			uint32_t* pColor{};
+			uint8_t* pDepth{};
+			int minX{};
+			int minY{};
+			int maxX{};
+			int maxY{};
+			int nrBlocksX{};
+
+			//Only the full screen target, tiles are cleared the first time a triangle touches them
+			bool clearsLazily{};
+
+			//Stage times of the thread that renders into the target, null when stage timing is off
+			StageTimes* pStageTimes{};
+			FrameStats* pStats{};
+
+			int GetPixelIndex(int x, int y) const
+			{
+				x -= minX;
+				y -= minY;
+				return (((y >> m_BlockShift) * nrBlocksX + (x >> m_BlockShift)) << (2 * m_BlockShift))
+					| ((y & (m_BlockSize - 1)) << m_BlockShift)
+					| (x & (m_BlockSize - 1));
+			}
+
+			//The depth buffer is untyped memory, big enough for the largest format
+			template<DepthFormat Format>
+			typename DepthTraits<Format>::Storage* GetDepthBuffer() const { return reinterpret_cast<typename DepthTraits<Format>::Storage*>(pDepth); }
+		};
+
+		//A draw of the deferred mode, recorded during the frame and rendered per tile in EndFrame
+		struct DeferredDraw
+		{
+			//Triangles per tile as the first clipped vertex of the triangle, tile i uses [tileOffsets[i], tileOffsets[i + 1])
+			std::vector<uint32_t> tileOffsets{};
+			std::vector<uint32_t> tileTriangles{};
+
+			//Owns the vertices and shaders of the draw
+			std::function<void(const RasterTarget& target, const uint32_t* pTriangles, uint32_t nrTriangles)> renderTriangles{};
+		};
 
-		//Transforms the vertices from WORLD space to NDC space
-		static void VertexTransformationFunction(const std::vector<Vertex>& vertices_in, std::vector<Vertex_Out>& vertices_out, const Matrix& worldViewProjectionMatrix, const Matrix& meshWorldMatrix);
+		//Fragments that passed the depth test and wait to be shaded
+		//Fragments of different triangles share a queue, so small triangles still fill a batch
+		struct FragmentQueue
+		{
+			int count{};
+			std::array<int, m_FragmentBatchSize> pixelIndices{};
+
+			//Samples of the pixel the fragment covers and passed the depth test for
+			std::array<uint8_t, m_FragmentBatchSize> sampleMasks{};
+
+			//Triangle of the fragment, as indices into the clipped vertices of the draw
+			std::array<std::array<uint32_t, m_FragmentBatchSize>, 3> vertexIndices{};
+
+			//Perspective correct barycentric weights and their screen space derivatives
+			std::array<std::array<float, m_FragmentBatchSize>, 3> weights{};
+			std::array<std::array<float, m_FragmentBatchSize>, 3> weightsDdx{};
+			std::array<std::array<float, m_FragmentBatchSize>, 3> weightsDdy{};
+		};
+
+		//Sizes the blocked buffers and tile flags after the render target
+		void CreateBuffers();
+		void DeleteBuffers();
+
+		//The buffers are cleared lazily per tile, a tile is cleared the first time a triangle touches it
+		void ResetClearedTiles();
+
+		//Detiles the color buffer into the render target, tiles that no triangle touched get the background color
+		void ResolveColorBuffer() const;
+
+		RasterTarget GetScreenTarget() const;
+
+		//Calls function.template operator()<Format, SampleCount>() with the current depth format and sample count
+		//so the raster functions are specialized for both
+		template<typename TFunction>
+		void DispatchRasterState(TFunction&& function) const;
+
+		//Clears the tiles overlapping the pixel rectangle [minX, maxX) x [minY, maxY) that are not cleared yet
+		template<DepthFormat Format, int SampleCount>
+		void ClearTouchedTiles(int minX, int minY, int maxX, int maxY) const;
+
+		//Back facing and small triangles can not cover a sample, so they are dropped before binning and rasterization
+		//The vertices are in the winding order of RenderTriangle
+		template<int SampleCount>
+		static bool IsTriangleCulled(const Vector2& v0, const Vector2& v1, const Vector2& v2, FrameStats& stats);
+
+		//Tiles a triangle can write to, the same bounds RenderTriangle uses
+		void GetTriangleTiles(const Vector2& v0, const Vector2& v1, const Vector2& v2, int& minTileX, int& minTileY, int& maxTileX, int& maxTileY) const;
+
+		//Bins the triangles of a draw and keeps everything it needs until EndFrame
+		template<DepthFormat Format, int SampleCount, typename TVaryings, typename TPixelShader>
+		void RecordDeferredDraw(std::vector<Vertex_Out<TVaryings>>&& verticesNDC, std::vector<Vector2>&& verticesScreenSpace, const std::vector<uint32_t>& triangles, const TPixelShader& pixelShader);
+
+		void RenderDeferredTiles();
+		template<DepthFormat Format, int SampleCount>
+		void RenderDeferredTile(int tileIdx, uint32_t threadIdx) const;
+
+		template<DepthFormat Format>
+		float DecodeDepth(int sampleIdx, bool isWritten) const;
+
+		//Fills with non temporal stores, call StoreFence once the streamed pixels are needed by another thread or the caller
+		static void StreamFill(uint32_t* pPixels, int count, uint32_t value);
+		static void StoreFence();
+
+		//Copies up to one row of a block to a linear buffer
+		static void CopyBlockRow(const uint32_t* pSource, uint32_t* pDestination, int count);
+
+		//Same as CopyBlockRow, but averages the samples of every pixel first
+		static void ResolveBlockRow(const uint32_t* pSamples, uint32_t* pDestination, int count, int sampleCount);
+
+		//Draw of one instance with the depth format and sample count resolved at compile time
+		template<DepthFormat Format, int SampleCount, VertexShader TVertexShader, PixelShader<typename TVertexShader::Varyings> TPixelShader>
+		void DrawWithRasterState(const Mesh& mesh, const MeshInstance& instance, const TVertexShader& vertexShader, const TPixelShader& pixelShader);
+
+		//Creates the pixel shader of the built in material with the textures of the material and the current render settings
+		BuiltInPixelShader CreateBuiltInPixelShader(uint32_t materialIdx) const;
+
+		//Creates the meshes, textures and materials of the scene
+		//Returns false and leaves the scene empty when the file is malformed or an asset fails to load
+		bool LoadScene(const std::string& scenePath);
+
+		//Builds m_SceneBVH from the current world matrices of m_Objects
+		void BuildSceneBVH();
+
+		//True when the bounds of the mesh placed with worldMatrix are outside of the frustum
+		//Never for a draw whose vertex shader does not use the world view projection matrix, it still counts as submitted
+		bool IsMeshCulled(const Mesh& mesh, const Matrix& worldMatrix, bool isCullable) const;
+
+		//Picks the level of detail from the size of the bounding sphere on screen
+		//pKey identifies the mesh or instance across frames, the hysteresis depends on the level it was drawn with the frame before
+		const Mesh& SelectLod(const Mesh& mesh, const Matrix& worldMatrix, const void* pKey);
+
+		//Indices of the instances whose bounds are not outside of the frustum, all of them when the draw is not cullable
+		std::vector<uint32_t> CullInstances(const Mesh& mesh, std::span<const MeshInstance> instances, bool isCullable) const;
+
+		//Indices of the meshlets of the mesh that are inside of the frustum and face the camera
+		std::vector<uint32_t> CullMeshlets(const Mesh& mesh, const DrawConstants& constants, FrameStats& stats) const;
+
+		//Transforms the vertices from WORLD space to NDC space, vertices_out has the size of vertices_in
+		template<VertexShader TVertexShader>
+		static void VertexTransformationFunction(std::span<const Vertex> vertices_in, std::span<Vertex_Out<typename TVertexShader::Varyings>> vertices_out, const DrawConstants& constants, const TVertexShader& vertexShader);
 
 		//Transforms the vertices from NDC space to SCREEN space
-		void VertexTransformationToScreenSpace(const std::vector<Vertex_Out>& vertices_in, std::vector<Vector2>& vertex_out) const;
+		template<typename TVaryings>
+		void VertexTransformationToScreenSpace(const std::vector<Vertex_Out<TVaryings>>& vertices_in, std::vector<Vector2>& vertex_out) const;
+
+		//Renders the triangle in 2x2 quads so the pixel shader can get screen space derivatives
+		//Batch pixel shaders get their fragments queued, the others are shaded per quad
+		template<DepthFormat Format, int SampleCount, typename TVaryings, typename TPixelShader>
+		void RenderTriangle(const RasterTarget& target, const std::vector<Vector2>& verticesScreenSpace, const std::vector<Vertex_Out<TVaryings>>& verticesNDC, const std::array<uint32_t, 3>& verticesIndexes, const TPixelShader& pixelShader,
+			FragmentQueue& fragmentQueue, FragmentBatch<TVaryings, m_FragmentBatchSize>& fragmentBatch) const;
+
+		//Interpolates the queued fragments into the batch, shades them and writes the colors
+		template<int SampleCount, typename TVaryings, typename TPixelShader>
+		void ShadeFragments(const RasterTarget& target, FragmentQueue& fragmentQueue, FragmentBatch<TVaryings, m_FragmentBatchSize>& fragmentBatch, const std::vector<Vertex_Out<TVaryings>>& verticesNDC, const TPixelShader& pixelShader) const;
+
+		//Clamps the color and stores it in the samples of the mask
+		template<int SampleCount>
+		void WritePixel(const RasterTarget& target, int pixelIdx, int sampleMask, ColorRGB finalColor) const;
 
-		//Renders the triangle
-		void RenderTriangle(const std::vector<Vector2>& verticesScreenSpace, std::vector<Vertex_Out>& verticesNDC, const std::vector<uint32_t>& verticesIndexes) const;
 
-		//Shades the pixel
-		void Shade(const Vertex_Out& vertex, ColorRGB& finalColor) const;
+		//Clips the triangles and appends them to outputVertices, index i refers to inputVertices[i - indexBias]
+		//Without indices every three input vertices are a triangle
+		template<typename TVaryings>
+		static void SutherlandHodgmanClipping(const std::vector<Vertex_Out<TVaryings>>& inputVertices, std::span<const uint32_t> indices, uint32_t indexBias, std::vector<Vertex_Out<TVaryings>>& outputVertices, FrameStats& stats);
+		template<typename TVaryings>
+		static std::vector<Vertex_Out<TVaryings>> ClipAgainstPlane(const std::vector<Vertex_Out<TVaryings>>& inputVertices, const Vector4& plane);
 
 
-		//Clips the triangle
-		std::vector<Vertex_Out> SutherlandHodgmanClipping(const std::vector<Vertex_Out>& inputVertices);
-		std::vector<Vertex_Out> ClipAgainstPlane(const std::vector<Vertex_Out>& inputVertices, const Vector4& plane);
 
+		RenderTarget m_RenderTarget{};
+		PixelLayout m_PixelLayout{};
+		uint32_t* m_pTargetPixels{};
+		//In pixels
+		int m_TargetPitch{};
 
-		
-		SDL_Window* m_pWindow{};
+		//Blocked buffers, padded to a whole number of blocks
+		uint32_t* m_pColorBuffer{};
+		uint8_t* m_pDepthBuffer{};
+		int m_NrBlocksX{};
+		int m_NrBlocksY{};
+		DepthFormat m_DepthFormat{ DepthFormat::Float32 };
 
-		SDL_Surface* m_pFrontBuffer{ nullptr };
-		SDL_Surface* m_pBackBuffer{ nullptr };
-		uint32_t* m_pBackBufferPixels{};
-		float* m_pDepthBufferPixels{};
+		uint32_t m_ClearColor{};
+		int m_NrTilesX{};
+		int m_NrTilesY{};
+		//Mutable so the const raster functions can clear tiles
+		mutable std::vector<uint8_t> m_ClearedTiles{};
+
+		int m_SampleCount{ 1 };
+		bool m_UseDeferredTiles{ true };
+		bool m_DepthReadback{ false };
+		std::vector<DeferredDraw> m_DeferredDraws{};
+		ThreadPool m_ThreadPool{};
+
+		bool m_MeasureStages{ false };
+		//One per thread of the pool, mutable so the const raster functions can add to them
+		mutable std::vector<StageTimes> m_ThreadStageTimes{};
+		StageTimes* GetThreadStageTimes(uint32_t threadIdx) const { return m_MeasureStages ? &m_ThreadStageTimes[threadIdx] : nullptr; }
+
+		mutable std::vector<FrameStats> m_ThreadFrameStats{};
+		FrameStats m_FrameStats{};
 
 		Camera m_Camera{};
+		//Taken from the camera at BeginFrame
+		Frustum m_Frustum{};
 		int m_Width{};
 		int m_Height{};
 		float m_AspectRatio{};
@@ -87,17 +366,47 @@ namespace dae
 		bool m_Rotate{ true };
 		ShadeMode m_ShadeMode{ ShadeMode::Diffuse };
 
-		//Todo make wrapper class for mesh with a texture and a mesh in it?
-		
-		std::unique_ptr<Texture> m_pTexture{};
-		std::unique_ptr<Texture> m_pGlossinessTexture{};
-		std::unique_ptr<Texture> m_pNormalTexture{};
-		std::unique_ptr<Texture> m_pSpecularTexture{};
+		bool m_UseLods{ true };
+		//The level of detail every mesh or instance was drawn with, by address, dropped when it was not drawn in the last frame
+		//The mesh it was drawn with, an instance that is drawn with another mesh starts over
+		struct LodState
+		{
+			const Mesh* pMesh{};
+			uint32_t level{};
+			uint32_t lastFrame{};
+		};
+		std::unordered_map<const void*, LodState> m_LodStates{};
+		uint32_t m_FrameIndex{};
+
+		struct Material
+		{
+			const Texture* pDiffuseTexture{};
+			const Texture* pGlossinessTexture{};
+			const Texture* pNormalTexture{};
+			const Texture* pSpecularTexture{};
+		};
+		//Every texture and mesh is loaded once, materials and objects that use it share the handle
+		AssetManager m_AssetManager{};
+		std::vector<std::shared_ptr<const Texture>> m_Textures{};
+		std::vector<Material> m_Materials{};
 		const float m_Glossiness{ 25.f };
 		const float m_AmbientLight{ 0.025f };
 
-		
-		std::vector<Mesh> m_MeshesWorld;
+		//The gloss map scales the phong exponent between 0 and m_Glossiness
+		SpecularEvaluator m_SpecularEvaluator{ m_Glossiness };
+
+
+		//A shared mesh placed in the world with a material
+		struct Object
+		{
+			std::shared_ptr<const Mesh> pMesh{};
+			MeshInstance instance{};
+			uint32_t materialIdx{};
+		};
+		std::vector<Object> m_Objects{};
+		bool m_IsSceneLoaded{};
+		//Over the world bounds of m_Objects, refit when the objects move
+		SceneBVH m_SceneBVH{};
 
 
 
@@ -106,6 +415,982 @@ namespace dae
 		float m_lightIntensity{ 7.f };
 
 
-		
+
 	};
+
+	//-------------------------------------------------------------------------------
+	//Template implementations
+
+	template<VertexShader TVertexShader, PixelShader<typename TVertexShader::Varyings> TPixelShader>
+	void Renderer::Draw(const Mesh& mesh, const TVertexShader& vertexShader, const TPixelShader& pixelShader)
+	{
+		//A mesh outside of the frustum is skipped before any of its vertices is touched
+		if (IsMeshCulled(mesh, mesh.worldMatrix, UsesWorldViewProjection<TVertexShader>)) return;
+
+		const Mesh& lod{ SelectLod(mesh, mesh.worldMatrix, &mesh) };
+		DispatchRasterState([&]<DepthFormat Format, int SampleCount>()
+		{
+			DrawWithRasterState<Format, SampleCount>(lod, MeshInstance{ mesh.worldMatrix }, vertexShader, pixelShader);
+		});
+	}
+
+	template<VertexShader TVertexShader, PixelShader<typename TVertexShader::Varyings> TPixelShader>
+	void Renderer::Draw(const Mesh& mesh, const MeshInstance& instance, const TVertexShader& vertexShader, const TPixelShader& pixelShader)
+	{
+		if (IsMeshCulled(mesh, instance.worldMatrix, UsesWorldViewProjection<TVertexShader>)) return;
+
+		const Mesh& lod{ SelectLod(mesh, instance.worldMatrix, &instance) };
+		DispatchRasterState([&]<DepthFormat Format, int SampleCount>()
+		{
+			DrawWithRasterState<Format, SampleCount>(lod, instance, vertexShader, pixelShader);
+		});
+	}
+
+	template<VertexShader TVertexShader, PixelShader<typename TVertexShader::Varyings> TPixelShader>
+	void Renderer::DrawInstanced(const Mesh& mesh, std::span<const MeshInstance> instances, const TVertexShader& vertexShader, const TPixelShader& pixelShader)
+	{
+		const std::vector<uint32_t> visibleInstances{ CullInstances(mesh, instances, UsesWorldViewProjection<TVertexShader>) };
+		if (visibleInstances.empty()) return;
+
+		DispatchRasterState([&]<DepthFormat Format, int SampleCount>()
+		{
+			for (const uint32_t instanceIdx : visibleInstances)
+			{
+				const MeshInstance& instance{ instances[instanceIdx] };
+				DrawWithRasterState<Format, SampleCount>(SelectLod(mesh, instance.worldMatrix, &instance), instance, vertexShader, pixelShader);
+			}
+		});
+	}
+
+	template<typename TFunction>
+	void Renderer::DispatchRasterState(TFunction&& function) const
+	{
+		const auto dispatchSampleCount = [&]<DepthFormat Format>()
+		{
+			if (m_SampleCount == m_MaxSampleCount)
+			{
+				function.template operator()<Format, m_MaxSampleCount>();
+			}
+			else
+			{
+				function.template operator()<Format, 1>();
+			}
+		};
+
+		switch (m_DepthFormat)
+		{
+		case DepthFormat::Float32:
+			dispatchSampleCount.template operator()<DepthFormat::Float32>();
+			break;
+		case DepthFormat::Unorm16:
+			dispatchSampleCount.template operator()<DepthFormat::Unorm16>();
+			break;
+		case DepthFormat::Unorm24:
+			dispatchSampleCount.template operator()<DepthFormat::Unorm24>();
+			break;
+		case DepthFormat::ReversedFloat32:
+			dispatchSampleCount.template operator()<DepthFormat::ReversedFloat32>();
+			break;
+		}
+	}
+
+	template<DepthFormat Format, int SampleCount, VertexShader TVertexShader, PixelShader<typename TVertexShader::Varyings> TPixelShader>
+	void Renderer::DrawWithRasterState(const Mesh& mesh, const MeshInstance& instance, const TVertexShader& vertexShader, const TPixelShader& pixelShader)
+	{
+		using Varyings = typename TVertexShader::Varyings;
+
+		//Draws are recorded on the calling thread
+		StageTimes* pStageTimes{ GetThreadStageTimes(0) };
+		FrameStats& stats{ m_ThreadFrameStats[0] };
+		if constexpr (FrameStats::m_IsEnabled)
+		{
+			stats.trianglesSubmitted += mesh.GetTriangleCount();
+		}
+
+		//Define Triangle in NDC Space
+		const DrawConstants constants{ instance.worldMatrix * m_Camera.viewMatrix * m_Camera.projectionMatrix, instance.worldMatrix, instance.parameters };
+
+		//Meshlets outside of the frustum or facing away never reach the vertex stage
+		//Their bounds say nothing about where a shader that does not use the world view projection matrix puts them
+		std::vector<uint32_t> visibleMeshlets{};
+		if (!mesh.meshlets.empty())
+		{
+			if constexpr (UsesWorldViewProjection<TVertexShader>)
+			{
+				const TraceZone zone{ "Cull meshlets" };
+				const ScopedStageTimer timer{ pStageTimes, RenderStage::Clip };
+				visibleMeshlets = CullMeshlets(mesh, constants, stats);
+			}
+			else
+			{
+				visibleMeshlets.resize(mesh.meshlets.size());
+				std::iota(visibleMeshlets.begin(), visibleMeshlets.end(), 0u);
+			}
+		}
+
+		//The vertices of the visible meshlets are packed one meshlet after the other
+		std::vector<Vertex_Out<Varyings>> vertices_ndc{};
+		{
+			const TraceZone zone{ "Vertex" };
+			const ScopedStageTimer timer{ pStageTimes, RenderStage::Vertex };
+			if (mesh.meshlets.empty())
+			{
+				vertices_ndc.resize(mesh.vertices.size());
+				VertexTransformationFunction(mesh.vertices, vertices_ndc, constants, vertexShader);
+			}
+			else
+			{
+				size_t vertexCount{};
+				for (const uint32_t meshletIdx : visibleMeshlets) vertexCount += mesh.meshlets[meshletIdx].vertexCount;
+				vertices_ndc.resize(vertexCount);
+
+				size_t firstVertex{};
+				for (const uint32_t meshletIdx : visibleMeshlets)
+				{
+					const Meshlet& meshlet{ mesh.meshlets[meshletIdx] };
+					VertexTransformationFunction(std::span{ mesh.vertices }.subspan(meshlet.vertexOffset, meshlet.vertexCount),
+						std::span{ vertices_ndc }.subspan(firstVertex, meshlet.vertexCount), constants, vertexShader);
+					firstVertex += meshlet.vertexCount;
+				}
+			}
+		}
+
+		if constexpr (FrameStats::m_IsEnabled)
+		{
+			stats.verticesTransformed += vertices_ndc.size();
+		}
+
+		std::vector<Vertex_Out<Varyings>> clippedVertices_ndc{};
+		{
+			const TraceZone zone{ "Clip" };
+			const ScopedStageTimer timer{ pStageTimes, RenderStage::Clip };
+			if (mesh.meshlets.empty())
+			{
+				clippedVertices_ndc.reserve(mesh.indices.empty() ? vertices_ndc.size() : mesh.indices.size());
+				SutherlandHodgmanClipping(vertices_ndc, mesh.indices, 0, clippedVertices_ndc, stats);
+			}
+			else
+			{
+				size_t indexCount{};
+				for (const uint32_t meshletIdx : visibleMeshlets) indexCount += mesh.meshlets[meshletIdx].triangleCount * 3;
+				clippedVertices_ndc.reserve(indexCount);
+
+				//The indices of a meshlet refer to the whole mesh, its vertices start at firstVertex in the packed vertices
+				uint32_t firstVertex{};
+				for (const uint32_t meshletIdx : visibleMeshlets)
+				{
+					const Meshlet& meshlet{ mesh.meshlets[meshletIdx] };
+					SutherlandHodgmanClipping(vertices_ndc, std::span{ mesh.indices }.subspan(meshlet.indexOffset, meshlet.triangleCount * 3),
+						meshlet.vertexOffset - firstVertex, clippedVertices_ndc, stats);
+					firstVertex += meshlet.vertexCount;
+				}
+			}
+			clippedVertices_ndc.shrink_to_fit();
+		}
+
+		std::vector<Vector2> vertices_screen{};
+		{
+			const TraceZone zone{ "Screen space" };
+			const ScopedStageTimer timer{ pStageTimes, RenderStage::Vertex };
+			VertexTransformationToScreenSpace(clippedVertices_ndc, vertices_screen);
+		}
+
+		//Culling and binning count as raster work, shading and the lazy clears hand their time over to their own stage
+		const TraceZone zone{ m_UseDeferredTiles ? "Cull and bin" : "Raster" };
+		const ScopedStageTimer timer{ pStageTimes, RenderStage::Raster };
+
+		//Triangles as their first clipped vertex
+		std::vector<uint32_t> triangles{};
+		triangles.reserve(clippedVertices_ndc.size() / 3);
+		for (uint32_t vertex{}; vertex < clippedVertices_ndc.size(); vertex += 3)
+		{
+			if (IsTriangleCulled<SampleCount>(vertices_screen[vertex], vertices_screen[vertex + 2], vertices_screen[vertex + 1], stats)) continue;
+			triangles.push_back(vertex);
+		}
+
+		if constexpr (FrameStats::m_IsEnabled)
+		{
+			stats.trianglesRasterized += triangles.size();
+		}
+
+		if (m_UseDeferredTiles)
+		{
+			RecordDeferredDraw<Format, SampleCount>(std::move(clippedVertices_ndc), std::move(vertices_screen), triangles, pixelShader);
+			return;
+		}
+
+		const RasterTarget target{ GetScreenTarget() };
+		FragmentQueue fragmentQueue{};
+		FragmentBatch<Varyings, m_FragmentBatchSize> fragmentBatch{};
+
+		for (const uint32_t vertex : triangles)
+		{
+			RenderTriangle<Format, SampleCount>(target, vertices_screen, clippedVertices_ndc, { vertex, vertex + 2, vertex + 1 }, pixelShader, fragmentQueue, fragmentBatch);
+		}
+
+		//The queue refers to the clipped vertices of this draw, so it can not outlive it
+		//Only batch pixel shaders queue fragments
+		if constexpr (BatchPixelShader<TPixelShader, Varyings, m_FragmentBatchSize>)
+		{
+			if (fragmentQueue.count > 0)
+			{
+				ShadeFragments<SampleCount>(target, fragmentQueue, fragmentBatch, clippedVertices_ndc, pixelShader);
+			}
+		}
+	}
+
+	template<DepthFormat Format, int SampleCount, typename TVaryings, typename TPixelShader>
+	void Renderer::RecordDeferredDraw(std::vector<Vertex_Out<TVaryings>>&& verticesNDC, std::vector<Vector2>&& verticesScreenSpace, const std::vector<uint32_t>& triangles, const TPixelShader& pixelShader)
+	{
+		const int nrTiles{ m_NrTilesX * m_NrTilesY };
+
+		DeferredDraw& draw{ m_DeferredDraws.emplace_back() };
+
+		//Count the triangles per tile, then fill them in, so the bins are two flat arrays
+		draw.tileOffsets.assign(nrTiles + 1, 0);
+		for (const uint32_t vertex : triangles)
+		{
+			int minTileX{}, minTileY{}, maxTileX{}, maxTileY{};
+			GetTriangleTiles(verticesScreenSpace[vertex], verticesScreenSpace[vertex + 1], verticesScreenSpace[vertex + 2], minTileX, minTileY, maxTileX, maxTileY);
+
+			for (int tileY{ minTileY }; tileY <= maxTileY; ++tileY)
+			{
+				for (int tileX{ minTileX }; tileX <= maxTileX; ++tileX)
+				{
+					++draw.tileOffsets[tileX + tileY * m_NrTilesX + 1];
+				}
+			}
+		}
+
+		for (int tileIdx{}; tileIdx < nrTiles; ++tileIdx)
+		{
+			draw.tileOffsets[tileIdx + 1] += draw.tileOffsets[tileIdx];
+		}
+
+		//Triangles stay in submission order inside a tile, so the depth test gives the same result as the immediate mode
+		draw.tileTriangles.resize(draw.tileOffsets[nrTiles]);
+		std::vector<uint32_t> tileEnds(draw.tileOffsets.begin(), draw.tileOffsets.end() - 1);
+		for (const uint32_t vertex : triangles)
+		{
+			int minTileX{}, minTileY{}, maxTileX{}, maxTileY{};
+			GetTriangleTiles(verticesScreenSpace[vertex], verticesScreenSpace[vertex + 1], verticesScreenSpace[vertex + 2], minTileX, minTileY, maxTileX, maxTileY);
+
+			for (int tileY{ minTileY }; tileY <= maxTileY; ++tileY)
+			{
+				for (int tileX{ minTileX }; tileX <= maxTileX; ++tileX)
+				{
+					draw.tileTriangles[tileEnds[tileX + tileY * m_NrTilesX]++] = vertex;
+				}
+			}
+		}
+
+		draw.renderTriangles = [this, verticesNDC = std::move(verticesNDC), verticesScreenSpace = std::move(verticesScreenSpace), pixelShader]
+		(const RasterTarget& target, const uint32_t* pTriangles, uint32_t nrTriangles)
+		{
+			FragmentQueue fragmentQueue{};
+			FragmentBatch<TVaryings, m_FragmentBatchSize> fragmentBatch{};
+
+			for (uint32_t triangle{}; triangle < nrTriangles; ++triangle)
+			{
+				const uint32_t vertex{ pTriangles[triangle] };
+				RenderTriangle<Format, SampleCount>(target, verticesScreenSpace, verticesNDC, { vertex, vertex + 2, vertex + 1 }, pixelShader, fragmentQueue, fragmentBatch);
+			}
+
+			if constexpr (BatchPixelShader<TPixelShader, TVaryings, m_FragmentBatchSize>)
+			{
+				if (fragmentQueue.count > 0)
+				{
+					ShadeFragments<SampleCount>(target, fragmentQueue, fragmentBatch, verticesNDC, pixelShader);
+				}
+			}
+		};
+	}
+
+	template<DepthFormat Format, int SampleCount>
+	void Renderer::RenderDeferredTile(int tileIdx, uint32_t threadIdx) const
+	{
+		const TraceZone zone{ "Tile", tileIdx };
+
+		using Depth = DepthTraits<Format>;
+
+		const int tileX{ tileIdx % m_NrTilesX };
+		const int tileY{ tileIdx / m_NrTilesX };
+
+		//Tile local buffers, only the final colors are written to memory that is shared with other threads
+		alignas(64) std::array<uint32_t, m_TilePixels * SampleCount> tileColor;
+		alignas(64) std::array<typename Depth::Storage, m_TilePixels * SampleCount> tileDepth;
+
+		RasterTarget target{};
+		target.pColor = tileColor.data();
+		target.pDepth = reinterpret_cast<uint8_t*>(tileDepth.data());
+		target.minX = tileX * m_TileSize;
+		target.minY = tileY * m_TileSize;
+		target.maxX = std::min(target.minX + m_TileSize, m_Width);
+		target.maxY = std::min(target.minY + m_TileSize, m_Height);
+		target.nrBlocksX = m_TileBlocks;
+		target.pStageTimes = GetThreadStageTimes(threadIdx);
+		target.pStats = &m_ThreadFrameStats[threadIdx];
+
+		bool isTouched{};
+		for (const DeferredDraw& draw : m_DeferredDraws)
+		{
+			const uint32_t begin{ draw.tileOffsets[tileIdx] };
+			const uint32_t end{ draw.tileOffsets[tileIdx + 1] };
+			if (begin == end) continue;
+
+			if (!isTouched)
+			{
+				const ScopedStageTimer timer{ target.pStageTimes, RenderStage::Clear };
+				tileColor.fill(m_ClearColor);
+				tileDepth.fill(Depth::clearValue);
+				isTouched = true;
+			}
+
+			const ScopedStageTimer timer{ target.pStageTimes, RenderStage::Raster };
+			draw.renderTriangles(target, draw.tileTriangles.data() + begin, end - begin);
+		}
+
+		if constexpr (FrameStats::m_IsEnabled)
+		{
+			target.pStats->textureSamples += Texture::TakeSampleCount();
+		}
+
+		const ScopedStageTimer timer{ target.pStageTimes, RenderStage::Present };
+		for (int y{ target.minY }; y < target.maxY; ++y)
+		{
+			uint32_t* pDestination{ m_pTargetPixels + y * m_TargetPitch };
+
+			if (!isTouched)
+			{
+				StreamFill(pDestination + target.minX, target.maxX - target.minX, m_ClearColor);
+				continue;
+			}
+
+			for (int x{ target.minX }; x < target.maxX; x += m_BlockSize)
+			{
+				ResolveBlockRow(tileColor.data() + target.GetPixelIndex(x, y) * SampleCount, pDestination + x, std::min(m_BlockSize, target.maxX - x), SampleCount);
+			}
+		}
+
+		if (!isTouched)
+		{
+			StoreFence();
+		}
+
+		if (!m_DepthReadback) return;
+
+		//A row of blocks of the tile has the same layout in the full screen buffer
+		const RasterTarget screenTarget{ GetScreenTarget() };
+		typename Depth::Storage* pScreenDepth{ screenTarget.GetDepthBuffer<Format>() };
+		for (int y{ target.minY }; y < target.maxY; y += m_BlockSize)
+		{
+			typename Depth::Storage* pDestination{ pScreenDepth + screenTarget.GetPixelIndex(target.minX, y) * SampleCount };
+			const int nrSamples{ ((target.maxX - target.minX + m_BlockSize - 1) / m_BlockSize) * m_BlockPixels * SampleCount };
+
+			if (isTouched)
+			{
+				std::copy_n(tileDepth.data() + target.GetPixelIndex(target.minX, y) * SampleCount, nrSamples, pDestination);
+			}
+			else
+			{
+				std::fill_n(pDestination, nrSamples, Depth::clearValue);
+			}
+		}
+	}
+
+	// function that transforms a vector of WORLD space vertices to a vector of NDC space vertices
+	template<VertexShader TVertexShader>
+	void Renderer::VertexTransformationFunction(std::span<const Vertex> vertices_in, std::span<Vertex_Out<typename TVertexShader::Varyings>> vertices_out, const DrawConstants& constants, const TVertexShader& vertexShader)
+	{
+		for (size_t i{}; i < vertices_in.size(); ++i)
+		{
+			vertices_out[i].position = vertexShader.Transform(constants, vertices_in[i], vertices_out[i].varyings);
+
+			// Apply Perspective Divide to the vertices
+			vertices_out[i].position.x /= vertices_out[i].position.w;
+			vertices_out[i].position.y /= vertices_out[i].position.w;
+			vertices_out[i].position.z /= vertices_out[i].position.w;
+		}
+	}
+
+	// function that transforms a vector of NDC space vertices to a vector of SCREEN space vertices
+	template<typename TVaryings>
+	void Renderer::VertexTransformationToScreenSpace(const std::vector<Vertex_Out<TVaryings>>& vertices_in, std::vector<Vector2>& vertex_out) const
+	{
+		vertex_out.reserve(vertices_in.size());
+
+		const float fWidth{ static_cast<float>(m_Width) };
+		const float fHeight{ static_cast<float>(m_Height) };
+
+		for (const Vertex_Out<TVaryings>& ndcVertex : vertices_in)
+		{
+			vertex_out.emplace_back(
+				fWidth * ((ndcVertex.position.x + 1) / 2.0f),
+				fHeight * ((1.0f - ndcVertex.position.y) / 2.0f)
+			);
+		}
+	}
+
+	template<int SampleCount>
+	bool Renderer::IsTriangleCulled(const Vector2& v0, const Vector2& v1, const Vector2& v2, FrameStats& stats)
+	{
+		//Only triangles with a positive signed area pass the coverage test of RenderTriangle, the others face away
+		const float area{ Vector2::Cross(v1 - v0, v2 - v1) };
+		if (area < 0.f)
+		{
+			if constexpr (FrameStats::m_IsEnabled) ++stats.trianglesBackFaceCulled;
+			return true;
+		}
+
+		//Samples sit at whole pixel positions plus their offset, the offsets are symmetric around the pixel
+		constexpr float sampleReach{ SampleCount > 1 ? std::ranges::max(m_SampleOffsetsX) : 0.f };
+		const Vector2 minBoundingBox{ Vector2::Min(v0, Vector2::Min(v1, v2)) };
+		const Vector2 maxBoundingBox{ Vector2::Max(v0, Vector2::Max(v1, v2)) };
+
+		const bool coversNoColumn{ std::ceil(minBoundingBox.x - sampleReach) > std::floor(maxBoundingBox.x + sampleReach) };
+		const bool coversNoRow{ std::ceil(minBoundingBox.y - sampleReach) > std::floor(maxBoundingBox.y + sampleReach) };
+		if (area == 0.f || coversNoColumn || coversNoRow)
+		{
+			if constexpr (FrameStats::m_IsEnabled) ++stats.trianglesSmallCulled;
+			return true;
+		}
+
+		return false;
+	}
+
+	template<DepthFormat Format, int SampleCount, typename TVaryings, typename TPixelShader>
+	void Renderer::RenderTriangle(const RasterTarget& target, const std::vector<Vector2>& verticesScreenSpace, const std::vector<Vertex_Out<TVaryings>>& verticesNDC, const std::array<uint32_t, 3>& verticesIndexes, const TPixelShader& pixelShader,
+		FragmentQueue& fragmentQueue, FragmentBatch<TVaryings, m_FragmentBatchSize>& fragmentBatch) const
+	{
+		const uint32_t vertexIndex0{ verticesIndexes[0] };
+		const uint32_t vertexIndex1{ verticesIndexes[1] };
+		const uint32_t vertexIndex2{ verticesIndexes[2] };
+
+		//If A triangle has the same vertex, skip it
+		if (vertexIndex0 == vertexIndex1 || vertexIndex1 == vertexIndex2 || vertexIndex0 == vertexIndex2) return;
+
+		const Vertex_Out<TVaryings>& vertex0{ verticesNDC[vertexIndex0] };
+		const Vertex_Out<TVaryings>& vertex1{ verticesNDC[vertexIndex1] };
+		const Vertex_Out<TVaryings>& vertex2{ verticesNDC[vertexIndex2] };
+
+		// Get all the current vertices
+		const Vector2 v0{ verticesScreenSpace[vertexIndex0] };
+		const Vector2 v1{ verticesScreenSpace[vertexIndex1] };
+		const Vector2 v2{ verticesScreenSpace[vertexIndex2] };
+
+		// Calculate the edges of the current triangle
+		const Vector2 edge01{ v1 - v0 };
+		const Vector2 edge12{ v2 - v1 };
+		const Vector2 edge20{ v0 - v2 };
+
+		// Calculate the area of the current triangle
+		const float fullTriangleArea{ Vector2::Cross(edge01, edge12) };
+
+		// Calculate the bounding box of this triangle
+		const Vector2 minBoundingBox{ Vector2::Min(v0, Vector2::Min(v1, v2)) };
+		const Vector2 maxBoundingBox{ Vector2::Max(v0, Vector2::Max(v1, v2)) };
+
+		// A margin that enlarges the bounding box, makes sure that some pixels do no get ignored
+		// With MSAA a sample can sit up to 6/16 of a pixel before its pixel position, so one more pixel is needed past the end
+		constexpr int margin{ SampleCount > 1 ? 2 : 1 };
+
+		// Calculate the start and end pixel bounds of this triangle
+		// Quads always start on an even pixel, so neighbouring triangles agree on the quad grid
+		const int startX{ std::clamp(static_cast<int>(minBoundingBox.x - margin), target.minX, target.maxX) & ~1 };
+		const int startY{ std::clamp(static_cast<int>(minBoundingBox.y - margin), target.minY, target.maxY) & ~1 };
+		const int endX{ std::clamp(static_cast<int>(maxBoundingBox.x + margin), target.minX, target.maxX) };
+		const int endY{ std::clamp(static_cast<int>(maxBoundingBox.y + margin), target.minY, target.maxY) };
+
+		// The last quad can reach one pixel past the end
+		if (target.clearsLazily)
+		{
+			const ScopedStageTimer timer{ target.pStageTimes, RenderStage::Clear, RenderStage::Raster };
+			ClearTouchedTiles<Format, SampleCount>(startX, startY, std::min(endX + 1, target.maxX), std::min(endY + 1, target.maxY));
+		}
+
+		//Z and W depth of the vertices
+		const float depthV0{ vertex0.position.z };
+		const float depthV1{ vertex1.position.z };
+		const float depthV2{ vertex2.position.z };
+		const float WdepthV0{ vertex0.position.w };
+		const float WdepthV1{ vertex1.position.w };
+		const float WdepthV2{ vertex2.position.w };
+
+		//Lanes of a quad: 0 top left, 1 top right, 2 bottom left, 3 bottom right
+		constexpr int quadLanes{ 4 };
+		constexpr bool needsDerivatives{ PixelShaderWithDerivatives<TPixelShader, TVaryings> };
+		constexpr bool shadesBatches{ BatchPixelShader<TPixelShader, TVaryings, m_FragmentBatchSize> };
+
+		using Depth = DepthTraits<Format>;
+		typename Depth::Storage* pDepthBuffer{ target.GetDepthBuffer<Format>() };
+		const float nearPlane{ m_Camera.nearPlane };
+
+		//The edge functions are linear, so a sample only adds a constant per edge to the values at the pixel position
+		std::array<float, SampleCount> sampleOffsetsEdge01{};
+		std::array<float, SampleCount> sampleOffsetsEdge12{};
+		std::array<float, SampleCount> sampleOffsetsEdge20{};
+		if constexpr (SampleCount > 1)
+		{
+			for (int sample{}; sample < SampleCount; ++sample)
+			{
+				const Vector2 sampleOffset{ m_SampleOffsetsX[sample], m_SampleOffsetsY[sample] };
+				sampleOffsetsEdge01[sample] = Vector2::Cross(edge01, sampleOffset);
+				sampleOffsetsEdge12[sample] = Vector2::Cross(edge12, sampleOffset);
+				sampleOffsetsEdge20[sample] = Vector2::Cross(edge20, sampleOffset);
+			}
+		}
+
+		//Counted locally and added once per triangle
+		uint64_t testedSamples{};
+		uint64_t passedSamples{};
+		uint64_t shadedPixels{};
+		uint64_t coveredPixels{};
+
+		// For each 2x2 quad
+		for (int qy{ startY }; qy < endY; qy += 2)
+		{
+			for (int qx{ startX }; qx < endX; qx += 2)
+			{
+				std::array<float, quadLanes> weightsV0{};
+				std::array<float, quadLanes> weightsV1{};
+				std::array<float, quadLanes> weightsV2{};
+				std::array<int, quadLanes> pixelIndices{};
+				std::array<int, quadLanes> sampleMasks{};
+
+				//Lanes that are inside the triangle and passed the depth test, the others are helper lanes
+				int shadeMask{};
+
+				for (int lane{}; lane < quadLanes; ++lane)
+				{
+					const int px{ qx + (lane & 1) };
+					const int py{ qy + (lane >> 1) };
+					const Vector2 curPixel{ static_cast<float>(px), static_cast<float>(py) };
+
+					// Calculate cross product from edge to start to point
+					const float edge01PointCross{ Vector2::Cross(edge01, curPixel - v0) };
+					const float edge12PointCross{ Vector2::Cross(edge12, curPixel - v1) };
+					const float edge20PointCross{ Vector2::Cross(edge20, curPixel - v2) };
+
+					// Calculate the barycentric weights, helper lanes extrapolate outside of the triangle
+					weightsV0[lane] = edge12PointCross / fullTriangleArea;
+					weightsV1[lane] = edge20PointCross / fullTriangleArea;
+					weightsV2[lane] = edge01PointCross / fullTriangleArea;
+
+					// Check if pixel is on the screen, if not it stays a helper lane
+					if (px >= target.maxX || py >= target.maxY) continue;
+
+					const int pixelIdx{ target.GetPixelIndex(px, py) };
+
+					// Coverage and depth are tested per sample, the single sample mode samples the pixel position itself
+					int sampleMask{};
+					//Stays true while every sample this triangle writes still held the clear depth
+					bool isFirstCoverage{ true };
+					for (int sample{}; sample < SampleCount; ++sample)
+					{
+						const float sampleEdge01Cross{ edge01PointCross + sampleOffsetsEdge01[sample] };
+						const float sampleEdge12Cross{ edge12PointCross + sampleOffsetsEdge12[sample] };
+						const float sampleEdge20Cross{ edge20PointCross + sampleOffsetsEdge20[sample] };
+
+						// Check if the sample is inside the triangle
+						if (!(sampleEdge01Cross > 0 && sampleEdge12Cross > 0 && sampleEdge20Cross > 0)) continue;
+						if constexpr (FrameStats::m_IsEnabled) ++testedSamples;
+
+						const float sampleWeightV0{ sampleEdge12Cross / fullTriangleArea };
+						const float sampleWeightV1{ sampleEdge20Cross / fullTriangleArea };
+						const float sampleWeightV2{ sampleEdge01Cross / fullTriangleArea };
+
+						// Calculate the depth at this sample
+						float testDepth
+						{
+							1.0f /
+								(sampleWeightV0 / depthV0 +
+								sampleWeightV1 / depthV1 +
+								sampleWeightV2 / depthV2)
+						};
+
+						// Reversed formats store near / W, W is linear in the reciprocal of the barycentric weights
+						if constexpr (Depth::reversed)
+						{
+							testDepth = nearPlane * (sampleWeightV0 / WdepthV0 + sampleWeightV1 / WdepthV1 + sampleWeightV2 / WdepthV2);
+						}
+
+						// If this sample is further away then a previous hit, continue to the next sample
+						const int sampleIdx{ pixelIdx * SampleCount + sample };
+						const typename Depth::Storage encodedDepth{ Depth::Encode(testDepth) };
+						if (!Depth::Passes(encodedDepth, pDepthBuffer[sampleIdx])) continue;
+
+						// Save the new depth
+						if constexpr (FrameStats::m_IsEnabled) isFirstCoverage = isFirstCoverage && pDepthBuffer[sampleIdx] == Depth::clearValue;
+						pDepthBuffer[sampleIdx] = encodedDepth;
+						sampleMask |= 1 << sample;
+						if constexpr (FrameStats::m_IsEnabled) ++passedSamples;
+					}
+
+					// The pixel is shaded once when at least one sample survived
+					if (!sampleMask) continue;
+
+					// Covered for the first time when the samples this triangle did not write are still clear as well
+					if constexpr (FrameStats::m_IsEnabled)
+					{
+						for (int sample{}; isFirstCoverage && sample < SampleCount; ++sample)
+						{
+							isFirstCoverage = (sampleMask & (1 << sample)) || pDepthBuffer[pixelIdx * SampleCount + sample] == Depth::clearValue;
+						}
+						if (isFirstCoverage) ++coveredPixels;
+					}
+
+					pixelIndices[lane] = pixelIdx;
+					sampleMasks[lane] = sampleMask;
+					shadeMask |= 1 << lane;
+				}
+
+				if (!shadeMask) continue;
+
+				if constexpr (FrameStats::m_IsEnabled)
+				{
+					if (!m_DisplayDepthBuffer) shadedPixels += std::popcount(static_cast<uint32_t>(shadeMask));
+				}
+
+				if (m_DisplayDepthBuffer)
+				{
+					for (int lane{}; lane < quadLanes; ++lane)
+					{
+						if (!(shadeMask & (1 << lane))) continue;
+
+						//Display the depth buffer when needed
+						//Remap the interpolated depthColor to a range between 0 and 1
+						// Min and Max values of the original range
+						constexpr float minValue = 0.92f;
+						constexpr float maxValue = 1.f;
+
+						const float depth{ 1.0f / (weightsV0[lane] / depthV0 + weightsV1[lane] / depthV1 + weightsV2[lane] / depthV2) };
+
+						// Remap the value to the range [0, 1]
+						float remappedValue = (depth - minValue) / (maxValue - minValue);
+						remappedValue = std::clamp(remappedValue, 0.f, 1.f);
+
+						WritePixel<SampleCount>(target, pixelIndices[lane], sampleMasks[lane], ColorRGB{ remappedValue, remappedValue, remappedValue });
+					}
+
+					continue;
+				}
+
+				//Perspective correct weights
+				//Helper lanes are only needed when the shader asks for derivatives
+				std::array<float, quadLanes> correctedWeightsV0{};
+				std::array<float, quadLanes> correctedWeightsV1{};
+				std::array<float, quadLanes> correctedWeightsV2{};
+				for (int lane{}; lane < quadLanes; ++lane)
+				{
+					if (!needsDerivatives && !(shadeMask & (1 << lane))) continue;
+
+					// Calculate the depth at this pixel -> Linear [0,1]
+					const float interpolatedWDepth
+					{
+						1.0f /
+							(weightsV0[lane] / WdepthV0 +
+							weightsV1[lane] / WdepthV1 +
+							weightsV2[lane] / WdepthV2)
+					};
+
+					correctedWeightsV0[lane] = weightsV0[lane] / WdepthV0 * interpolatedWDepth;
+					correctedWeightsV1[lane] = weightsV1[lane] / WdepthV1 * interpolatedWDepth;
+					correctedWeightsV2[lane] = weightsV2[lane] / WdepthV2 * interpolatedWDepth;
+				}
+
+				if constexpr (shadesBatches)
+				{
+					//Queue the covered lanes, the varyings are interpolated once the batch is full
+					for (int lane{}; lane < quadLanes; ++lane)
+					{
+						if (!(shadeMask & (1 << lane))) continue;
+
+						const int fragment{ fragmentQueue.count++ };
+						fragmentQueue.pixelIndices[fragment] = pixelIndices[lane];
+						fragmentQueue.sampleMasks[fragment] = static_cast<uint8_t>(sampleMasks[lane]);
+						fragmentQueue.vertexIndices[0][fragment] = vertexIndex0;
+						fragmentQueue.vertexIndices[1][fragment] = vertexIndex1;
+						fragmentQueue.vertexIndices[2][fragment] = vertexIndex2;
+						fragmentQueue.weights[0][fragment] = correctedWeightsV0[lane];
+						fragmentQueue.weights[1][fragment] = correctedWeightsV1[lane];
+						fragmentQueue.weights[2][fragment] = correctedWeightsV2[lane];
+
+						//Coarse derivatives of the weights, the varyings are linear in them
+						if constexpr (needsDerivatives)
+						{
+							fragmentQueue.weightsDdx[0][fragment] = correctedWeightsV0[1] - correctedWeightsV0[0];
+							fragmentQueue.weightsDdx[1][fragment] = correctedWeightsV1[1] - correctedWeightsV1[0];
+							fragmentQueue.weightsDdx[2][fragment] = correctedWeightsV2[1] - correctedWeightsV2[0];
+							fragmentQueue.weightsDdy[0][fragment] = correctedWeightsV0[2] - correctedWeightsV0[0];
+							fragmentQueue.weightsDdy[1][fragment] = correctedWeightsV1[2] - correctedWeightsV1[0];
+							fragmentQueue.weightsDdy[2][fragment] = correctedWeightsV2[2] - correctedWeightsV2[0];
+						}
+
+						if (fragmentQueue.count == m_FragmentBatchSize)
+						{
+							ShadeFragments<SampleCount>(target, fragmentQueue, fragmentBatch, verticesNDC, pixelShader);
+						}
+					}
+
+					continue;
+				}
+
+				//Interpolate the varyings the shader declared
+				std::array<TVaryings, quadLanes> quadVaryings;
+				for (int lane{}; lane < quadLanes; ++lane)
+				{
+					if (!needsDerivatives && !(shadeMask & (1 << lane))) continue;
+
+					quadVaryings[lane] = InterpolateVaryings(vertex0.varyings, vertex1.varyings, vertex2.varyings,
+						correctedWeightsV0[lane], correctedWeightsV1[lane], correctedWeightsV2[lane]);
+				}
+
+				//Coarse derivatives, shared by the whole quad
+				QuadDerivatives<TVaryings> derivatives{};
+				if constexpr (needsDerivatives)
+				{
+					derivatives.ddx = SubtractVaryings(quadVaryings[1], quadVaryings[0]);
+					derivatives.ddy = SubtractVaryings(quadVaryings[2], quadVaryings[0]);
+				}
+
+				for (int lane{}; lane < quadLanes; ++lane)
+				{
+					if (!(shadeMask & (1 << lane))) continue;
+
+					if constexpr (needsDerivatives)
+					{
+						WritePixel<SampleCount>(target, pixelIndices[lane], sampleMasks[lane], pixelShader.Shade(quadVaryings[lane], derivatives));
+					}
+					else
+					{
+						WritePixel<SampleCount>(target, pixelIndices[lane], sampleMasks[lane], pixelShader.Shade(quadVaryings[lane]));
+					}
+				}
+			}
+		}
+
+		if constexpr (FrameStats::m_IsEnabled)
+		{
+			target.pStats->pixelsTested += testedSamples;
+			target.pStats->pixelsDepthPassed += passedSamples;
+			target.pStats->pixelsShaded += shadedPixels;
+			target.pStats->pixelsCovered += coveredPixels;
+		}
+	}
+
+	template<int SampleCount, typename TVaryings, typename TPixelShader>
+	void Renderer::ShadeFragments(const RasterTarget& target, FragmentQueue& fragmentQueue, FragmentBatch<TVaryings, m_FragmentBatchSize>& fragmentBatch, const std::vector<Vertex_Out<TVaryings>>& verticesNDC, const TPixelShader& pixelShader) const
+	{
+		using FloatArray = std::array<float, FragmentBatch<TVaryings, m_FragmentBatchSize>::componentCount>;
+		constexpr bool needsDerivatives{ PixelShaderWithDerivatives<TPixelShader, TVaryings> };
+
+		const ScopedStageTimer timer{ target.pStageTimes, RenderStage::Shade, RenderStage::Raster };
+
+		const int count{ fragmentQueue.count };
+		fragmentBatch.count = count;
+
+		//Gather the vertices of every fragment and transpose them into the SoA batch
+		for (int fragment{}; fragment < count; ++fragment)
+		{
+			const FloatArray values0{ std::bit_cast<FloatArray>(verticesNDC[fragmentQueue.vertexIndices[0][fragment]].varyings) };
+			const FloatArray values1{ std::bit_cast<FloatArray>(verticesNDC[fragmentQueue.vertexIndices[1][fragment]].varyings) };
+			const FloatArray values2{ std::bit_cast<FloatArray>(verticesNDC[fragmentQueue.vertexIndices[2][fragment]].varyings) };
+
+			const float weight0{ fragmentQueue.weights[0][fragment] };
+			const float weight1{ fragmentQueue.weights[1][fragment] };
+			const float weight2{ fragmentQueue.weights[2][fragment] };
+
+			for (size_t component{}; component < values0.size(); ++component)
+			{
+				fragmentBatch.varyings[component][fragment] = values0[component] * weight0 + values1[component] * weight1 + values2[component] * weight2;
+			}
+
+			if constexpr (needsDerivatives)
+			{
+				for (size_t component{}; component < values0.size(); ++component)
+				{
+					fragmentBatch.ddx[component][fragment] =
+						values0[component] * fragmentQueue.weightsDdx[0][fragment] +
+						values1[component] * fragmentQueue.weightsDdx[1][fragment] +
+						values2[component] * fragmentQueue.weightsDdx[2][fragment];
+					fragmentBatch.ddy[component][fragment] =
+						values0[component] * fragmentQueue.weightsDdy[0][fragment] +
+						values1[component] * fragmentQueue.weightsDdy[1][fragment] +
+						values2[component] * fragmentQueue.weightsDdy[2][fragment];
+				}
+			}
+		}
+
+		ColorBatch<m_FragmentBatchSize> colors;
+		pixelShader.ShadeBatch(fragmentBatch, colors);
+
+		//Clamp and pack the whole batch in the pixel format of the render target
+		std::array<uint32_t, m_FragmentBatchSize> packedColors;
+		for (int fragment{}; fragment < count; ++fragment)
+		{
+			const float maxValue{ std::max(1.f, std::max(colors.r[fragment], std::max(colors.g[fragment], colors.b[fragment]))) };
+
+			packedColors[fragment] = m_PixelLayout.Pack(
+				static_cast<uint8_t>(colors.r[fragment] / maxValue * 255),
+				static_cast<uint8_t>(colors.g[fragment] / maxValue * 255),
+				static_cast<uint8_t>(colors.b[fragment] / maxValue * 255));
+		}
+
+		for (int fragment{}; fragment < count; ++fragment)
+		{
+			const int firstSampleIdx{ fragmentQueue.pixelIndices[fragment] * SampleCount };
+			for (int sample{}; sample < SampleCount; ++sample)
+			{
+				if (fragmentQueue.sampleMasks[fragment] & (1 << sample))
+				{
+					target.pColor[firstSampleIdx + sample] = packedColors[fragment];
+				}
+			}
+		}
+
+		fragmentQueue.count = 0;
+	}
+
+	template<DepthFormat Format>
+	float Renderer::DecodeDepth(int sampleIdx, bool isWritten) const
+	{
+		using Depth = DepthTraits<Format>;
+		return Depth::Decode(isWritten ? GetScreenTarget().GetDepthBuffer<Format>()[sampleIdx] : Depth::clearValue);
+	}
+
+	template<DepthFormat Format, int SampleCount>
+	void Renderer::ClearTouchedTiles(int minX, int minY, int maxX, int maxY) const
+	{
+		if (minX >= maxX || minY >= maxY) return;
+
+		typename DepthTraits<Format>::Storage* pDepthBuffer{ GetScreenTarget().GetDepthBuffer<Format>() };
+
+		for (int tileY{ minY / m_TileSize }; tileY <= (maxY - 1) / m_TileSize; ++tileY)
+		{
+			for (int tileX{ minX / m_TileSize }; tileX <= (maxX - 1) / m_TileSize; ++tileX)
+			{
+				uint8_t& isCleared{ m_ClearedTiles[tileX + tileY * m_NrTilesX] };
+				if (isCleared) continue;
+				isCleared = 1;
+
+				//A row of blocks inside the tile is contiguous in memory
+				const int startBlockX{ tileX * m_TileBlocks };
+				const int endBlockX{ std::min(startBlockX + m_TileBlocks, m_NrBlocksX) };
+				const int startBlockY{ tileY * m_TileBlocks };
+				const int endBlockY{ std::min(startBlockY + m_TileBlocks, m_NrBlocksY) };
+				const int nrSamples{ (endBlockX - startBlockX) * m_BlockPixels * SampleCount };
+
+				for (int blockY{ startBlockY }; blockY < endBlockY; ++blockY)
+				{
+					const int start{ (startBlockX + blockY * m_NrBlocksX) * m_BlockPixels * SampleCount };
+					std::fill_n(m_pColorBuffer + start, nrSamples, m_ClearColor);
+					std::fill_n(pDepthBuffer + start, nrSamples, DepthTraits<Format>::clearValue);
+				}
+			}
+		}
+	}
+
+	template<int SampleCount>
+	void Renderer::WritePixel(const RasterTarget& target, int pixelIdx, int sampleMask, ColorRGB finalColor) const
+	{
+		finalColor.MaxToOne();
+
+		const uint32_t color{ m_PixelLayout.Pack(
+			static_cast<uint8_t>(finalColor.r * 255),
+			static_cast<uint8_t>(finalColor.g * 255),
+			static_cast<uint8_t>(finalColor.b * 255)) };
+
+		for (int sample{}; sample < SampleCount; ++sample)
+		{
+			if (sampleMask & (1 << sample))
+			{
+				target.pColor[pixelIdx * SampleCount + sample] = color;
+			}
+		}
+	}
+
+	template<typename TVaryings>
+	std::vector<Vertex_Out<TVaryings>> Renderer::ClipAgainstPlane(const std::vector<Vertex_Out<TVaryings>>& inputVertices, const Vector4& plane)
+	{
+		std::vector<Vertex_Out<TVaryings>> outputVertices;
+
+		// Loop through each edge of the polygon
+		const size_t numVertices = inputVertices.size();
+		for (size_t i = 0; i < numVertices; ++i)
+		{
+			// Current and next vertex in the input list
+			const Vertex_Out<TVaryings>& currentVertex = inputVertices[i];
+			const Vertex_Out<TVaryings>& nextVertex = inputVertices[(i + 1) % numVertices];
+
+			// Calculate distances from the plane for the current and next vertices
+			const float d1 = Vector4::Dot(plane, currentVertex.position) + plane.w;
+			const float d2 = Vector4::Dot(plane, nextVertex.position) + plane.w;
+
+
+			// Check if the vertices are inside or outside the clipping plane
+			if (d1 >= 0)
+			{
+				outputVertices.push_back(currentVertex);
+			}
+
+			// Check for intersection and add the intersection point
+			if (d1 * d2 < 0)
+			{
+				const float t = d1 / (d1 - d2);
+				const Vector4 intersectionPoint = currentVertex.position + (nextVertex.position - currentVertex.position) * t;
+
+				Vertex_Out<TVaryings> newVertex{};
+				newVertex.position = intersectionPoint;
+				newVertex.varyings = InterpolateVaryings(currentVertex.varyings, nextVertex.varyings, nextVertex.varyings, 1.f - t, t, 0.f);
+				outputVertices.push_back(newVertex);
+			}
+		}
+
+		return outputVertices;
+	}
+
+	template<typename TVaryings>
+	void Renderer::SutherlandHodgmanClipping(const std::vector<Vertex_Out<TVaryings>>& inputVertices, std::span<const uint32_t> indices, uint32_t indexBias, std::vector<Vertex_Out<TVaryings>>& outputVertices, FrameStats& stats)
+	{
+		//Indexed meshes are expanded here, every clipped triangle gets its own three vertices
+		const bool isIndexed{ !indices.empty() };
+		const size_t nrIndices{ isIndexed ? indices.size() : inputVertices.size() };
+
+		for (uint32_t vertex{}; vertex < nrIndices; vertex += 3)
+		{
+			const std::array<uint32_t, 3> index = isIndexed
+				? std::array<uint32_t, 3>{ indices[vertex] - indexBias, indices[vertex + 1] - indexBias, indices[vertex + 2] - indexBias }
+				: std::array<uint32_t, 3>{ vertex, vertex + 1, vertex + 2 };
+
+			bool isOneOutofFrustum = false;
+			for (const auto vertexIndex : index)
+			{
+				if (Camera::IsOutsideFrustum(inputVertices[vertexIndex].position))
+				{
+					isOneOutofFrustum = true;
+					break;
+				}
+			}
+
+			if (!isOneOutofFrustum)
+			{
+				outputVertices.push_back(inputVertices[index[0]]);
+				outputVertices.push_back(inputVertices[index[1]]);
+				outputVertices.push_back(inputVertices[index[2]]);
+				continue;
+			}
+
+			if constexpr (FrameStats::m_IsEnabled)
+			{
+				//Fully outside when every vertex is outside of the same plane
+				const auto getOutCode = [](const Vector4& position)
+				{
+					return (position.x < -1.f) | (position.x > 1.f) << 1 | (position.y < -1.f) << 2 | (position.y > 1.f) << 3 | (position.z < -1.f) << 4 | (position.z > 1.f) << 5;
+				};
+
+				const int sharedOutCode{ getOutCode(inputVertices[index[0]].position) & getOutCode(inputVertices[index[1]].position) & getOutCode(inputVertices[index[2]].position) };
+				++(sharedOutCode ? stats.trianglesFrustumCulled : stats.trianglesClipped);
+			}
+		}
+	}
 }
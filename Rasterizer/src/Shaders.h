@@ -0,0 +1,401 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+
+#include "Maths.h"
+#include "Shader.h"
+#include "Specular.h"
+#include "Texture.h"
+
+#define TextureTiling 0
+
+namespace dae
+{
+	enum class ShadeMode
+	{
+		ObservedArea,
+		Diffuse,
+		Specular,
+		Combined
+	};
+
+	//Varyings of the built in vehicle material
+	struct BuiltInVaryings
+	{
+		Vector2 uv{};
+		Vector3 normal{};
+		Vector3 tangent{};
+		Vector3 viewDirection{};
+	};
+
+	//Three floats per lane, used by the batch shading kernels
+	template<int BatchSize>
+	struct Vector3Batch
+	{
+		std::array<float, BatchSize> x{};
+		std::array<float, BatchSize> y{};
+		std::array<float, BatchSize> z{};
+
+		//Loads three consecutive components of a fragment batch and normalizes them
+		static Vector3Batch LoadNormalized(const std::array<float, BatchSize>* pComponents)
+		{
+			Vector3Batch result;
+			for (int lane{}; lane < BatchSize; ++lane)
+			{
+				const float x{ pComponents[0][lane] };
+				const float y{ pComponents[1][lane] };
+				const float z{ pComponents[2][lane] };
+				const float length{ std::sqrt(x * x + y * y + z * z) };
+
+				result.x[lane] = x / length;
+				result.y[lane] = y / length;
+				result.z[lane] = z / length;
+			}
+			return result;
+		}
+	};
+
+	struct BuiltInVertexShader
+	{
+		using Varyings = BuiltInVaryings;
+
+		Vector4 Transform(const DrawConstants& constants, const Vertex& vertex, Varyings& varyings) const
+		{
+			// Transform with VIEW matrix (inverse ONB)
+			const Vector4 position{ constants.worldViewProjectionMatrix.TransformPoint({ vertex.position, 1.0f }) };
+
+			//Safe the vertex in world space (for specular shading)
+			varyings.viewDirection = position;
+
+			//Normals and are transformed with the world matrix
+			varyings.normal = constants.worldMatrix.TransformVector(vertex.normal);
+			varyings.tangent = constants.worldMatrix.TransformVector(vertex.tangent);
+
+			//UV is passed through
+			varyings.uv = vertex.uv;
+
+			return position;
+		}
+	};
+
+	struct BuiltInPixelShader
+	{
+		using Varyings = BuiltInVaryings;
+
+		const Texture* pDiffuseTexture{};
+		const Texture* pGlossinessTexture{};
+		const Texture* pNormalTexture{};
+		const Texture* pSpecularTexture{};
+		const SpecularEvaluator* pSpecularEvaluator{};
+
+		ShadeMode shadeMode{ ShadeMode::Diffuse };
+		bool useNormalMap{ true };
+
+		Vector3 directionLight{};
+		float lightIntensity{};
+		float glossiness{};
+		float ambientLight{};
+
+		//Uses the uv derivatives to pick the mip level of the textures
+		ColorRGB Shade(const Varyings& varyings, const QuadDerivatives<Varyings>& derivatives) const
+		{
+			assert(pDiffuseTexture);
+			assert(pGlossinessTexture);
+			assert(pNormalTexture);
+			assert(pSpecularTexture);
+			assert(pSpecularEvaluator);
+
+			Vector2 uv{ varyings.uv };
+
+			#if TextureTiling
+			// Wrap UV coordinates to the [0, 1] range
+			uv.x = fmod(uv.x, 1.0f);
+			uv.y = fmod(uv.y, 1.0f);
+			if (uv.x < 0.0f) uv.x += 1.0f;
+			if (uv.y < 0.0f) uv.y += 1.0f;
+			#else
+
+			// Clamp UV coordinates to the [0, 1] range
+			uv.x = std::clamp(uv.x, 0.0f, 1.0f);
+			uv.y = std::clamp(uv.y, 0.0f, 1.0f);
+			#endif
+
+			const Vector2& uvDdx{ derivatives.ddx.uv };
+			const Vector2& uvDdy{ derivatives.ddy.uv };
+
+			//Interpolated directions are no longer unit length
+			const Vector3 interpolatedNormal{ varyings.normal.Normalized() };
+			const Vector3 tangent{ varyings.tangent.Normalized() };
+			const Vector3 viewDirection{ varyings.viewDirection.Normalized() };
+
+			Vector3 normal{ interpolatedNormal };
+
+			//Use the normal map when enabled and the texture is loaded correctly
+			if (useNormalMap && pNormalTexture)
+			{
+				//First we would need the normal in tangent space
+				//Calculate the biNormal
+				const Vector3 biNormal{ Vector3::Cross(interpolatedNormal, tangent) };
+				const Matrix tangentSpaceAxis{ tangent, biNormal, interpolatedNormal, Vector3::Zero };
+
+				//Sample the normal map
+				ColorRGB normalSample = pNormalTexture->Sample(uv, uvDdx, uvDdy);
+
+				//bring the normal map from [0, 1] to [-1, 1]
+				normalSample = (normalSample * 2.f) - ColorRGB{ 1.f, 1.f, 1.f };
+
+				const Vector3 normalSampled = { normalSample.r, normalSample.g, normalSample.b };
+				normal = tangentSpaceAxis.TransformVector(normalSampled);
+			}
+
+			const float observedArea{ std::max(Vector3::Dot(normal.Normalized(), -directionLight.Normalized()), 0.0f) };
+
+			switch (shadeMode)
+			{
+				case ShadeMode::ObservedArea:
+				{
+					return ColorRGB{ observedArea, observedArea, observedArea };
+				}
+
+				case ShadeMode::Diffuse:
+				{
+					// cd * (kd) / PI
+					const ColorRGB lambert{ pDiffuseTexture->Sample(uv, uvDdx, uvDdy) / PI };
+					return ColorRGB(lightIntensity * observedArea * lambert);
+				}
+
+				case ShadeMode::Specular:
+				{
+					const auto reflectedLight{ Vector3::Reflect(-directionLight, normal) };
+					const auto reflectedViewDot{ std::max(Vector3::Dot(reflectedLight, viewDirection), 0.0f) };
+
+					const float phongExponent{ glossiness * pGlossinessTexture->Sample(uv, uvDdx, uvDdy).r };
+					const float phong{ pSpecularEvaluator->Evaluate(reflectedViewDot, phongExponent) };
+					const ColorRGB phongColor{ phong, phong, phong };
+					const ColorRGB specularColor{ pSpecularTexture->Sample(uv, uvDdx, uvDdy) * phongColor };
+
+					return lightIntensity * specularColor * observedArea;
+				}
+
+				case ShadeMode::Combined:
+				{
+					const auto reflectedLight{ Vector3::Reflect(-directionLight, normal) };
+					const auto reflectedViewDot{ std::max(Vector3::Dot(reflectedLight, viewDirection), 0.0f) };
+
+					const float phongExponent{ glossiness * pGlossinessTexture->Sample(uv, uvDdx, uvDdy).r };
+					const float phong{ pSpecularEvaluator->Evaluate(reflectedViewDot, phongExponent) };
+					const ColorRGB phongColor{ phong, phong, phong };
+					const ColorRGB specularColor{ pSpecularTexture->Sample(uv, uvDdx, uvDdy) * phongColor };
+
+					const ColorRGB lambert{ pDiffuseTexture->Sample(uv, uvDdx, uvDdy) / PI };
+					const ColorRGB ambient{ ambientLight, ambientLight, ambientLight };
+
+					return (lightIntensity * lambert + specularColor + ambient) * observedArea;
+				}
+			}
+
+			return ColorRGB{};
+		}
+
+		//Same result as Shade, but every step runs over the whole batch before the next one starts
+		//Only the texture fetches stay scalar
+		template<int BatchSize>
+		void ShadeBatch(const FragmentBatch<Varyings, BatchSize>& batch, ColorBatch<BatchSize>& colors) const
+		{
+			assert(pDiffuseTexture);
+			assert(pGlossinessTexture);
+			assert(pNormalTexture);
+			assert(pSpecularTexture);
+			assert(pSpecularEvaluator);
+
+			using Batch = FragmentBatch<Varyings, BatchSize>;
+			using Lanes = std::array<float, BatchSize>;
+
+			constexpr size_t uvIdx{ Batch::ComponentIndex(offsetof(Varyings, uv)) };
+			constexpr size_t normalIdx{ Batch::ComponentIndex(offsetof(Varyings, normal)) };
+			constexpr size_t tangentIdx{ Batch::ComponentIndex(offsetof(Varyings, tangent)) };
+			constexpr size_t viewDirectionIdx{ Batch::ComponentIndex(offsetof(Varyings, viewDirection)) };
+
+			Lanes u{};
+			Lanes v{};
+			for (int lane{}; lane < BatchSize; ++lane)
+			{
+				#if TextureTiling
+				// Wrap UV coordinates to the [0, 1] range
+				u[lane] = fmod(batch.varyings[uvIdx][lane], 1.0f);
+				v[lane] = fmod(batch.varyings[uvIdx + 1][lane], 1.0f);
+				if (u[lane] < 0.0f) u[lane] += 1.0f;
+				if (v[lane] < 0.0f) v[lane] += 1.0f;
+				#else
+				// Clamp UV coordinates to the [0, 1] range
+				u[lane] = std::clamp(batch.varyings[uvIdx][lane], 0.0f, 1.0f);
+				v[lane] = std::clamp(batch.varyings[uvIdx + 1][lane], 0.0f, 1.0f);
+				#endif
+			}
+
+			//Texture fetches, only the maps the shade mode needs
+			const bool needsDiffuse{ shadeMode == ShadeMode::Diffuse || shadeMode == ShadeMode::Combined };
+			const bool needsSpecular{ shadeMode == ShadeMode::Specular || shadeMode == ShadeMode::Combined };
+
+			Vector3Batch<BatchSize> normalSample{};
+			Vector3Batch<BatchSize> diffuseSample{};
+			Vector3Batch<BatchSize> specularSample{};
+			Lanes phongExponent{};
+
+			const auto sample = [&](const Texture* pTexture, int lane)
+			{
+				const Vector2 uvDdx{ batch.ddx[uvIdx][lane], batch.ddx[uvIdx + 1][lane] };
+				const Vector2 uvDdy{ batch.ddy[uvIdx][lane], batch.ddy[uvIdx + 1][lane] };
+				return pTexture->Sample({ u[lane], v[lane] }, uvDdx, uvDdy);
+			};
+
+			for (int lane{}; lane < batch.count; ++lane)
+			{
+				if (useNormalMap)
+				{
+					const ColorRGB color{ sample(pNormalTexture, lane) };
+					normalSample.x[lane] = color.r;
+					normalSample.y[lane] = color.g;
+					normalSample.z[lane] = color.b;
+				}
+
+				if (needsDiffuse)
+				{
+					const ColorRGB color{ sample(pDiffuseTexture, lane) };
+					diffuseSample.x[lane] = color.r;
+					diffuseSample.y[lane] = color.g;
+					diffuseSample.z[lane] = color.b;
+				}
+
+				if (needsSpecular)
+				{
+					const ColorRGB color{ sample(pSpecularTexture, lane) };
+					specularSample.x[lane] = color.r;
+					specularSample.y[lane] = color.g;
+					specularSample.z[lane] = color.b;
+					phongExponent[lane] = glossiness * sample(pGlossinessTexture, lane).r;
+				}
+			}
+
+			//Interpolated directions are no longer unit length
+			const Vector3Batch<BatchSize> interpolatedNormal{ Vector3Batch<BatchSize>::LoadNormalized(&batch.varyings[normalIdx]) };
+			const Vector3Batch<BatchSize> viewDirection{ Vector3Batch<BatchSize>::LoadNormalized(&batch.varyings[viewDirectionIdx]) };
+
+			Vector3Batch<BatchSize> normal{ interpolatedNormal };
+			if (useNormalMap)
+			{
+				const Vector3Batch<BatchSize> tangent{ Vector3Batch<BatchSize>::LoadNormalized(&batch.varyings[tangentIdx]) };
+
+				for (int lane{}; lane < BatchSize; ++lane)
+				{
+					const float nx{ interpolatedNormal.x[lane] };
+					const float ny{ interpolatedNormal.y[lane] };
+					const float nz{ interpolatedNormal.z[lane] };
+					const float tx{ tangent.x[lane] };
+					const float ty{ tangent.y[lane] };
+					const float tz{ tangent.z[lane] };
+
+					//biNormal = normal x tangent
+					const float bx{ ny * tz - nz * ty };
+					const float by{ nz * tx - nx * tz };
+					const float bz{ nx * ty - ny * tx };
+
+					//bring the normal map from [0, 1] to [-1, 1] and transform it out of tangent space
+					const float sx{ normalSample.x[lane] * 2.f - 1.f };
+					const float sy{ normalSample.y[lane] * 2.f - 1.f };
+					const float sz{ normalSample.z[lane] * 2.f - 1.f };
+
+					normal.x[lane] = tx * sx + bx * sy + nx * sz;
+					normal.y[lane] = ty * sx + by * sy + ny * sz;
+					normal.z[lane] = tz * sx + bz * sy + nz * sz;
+				}
+			}
+
+			const Vector3 toLight{ -directionLight.Normalized() };
+
+			Lanes observedArea{};
+			for (int lane{}; lane < BatchSize; ++lane)
+			{
+				const float nx{ normal.x[lane] };
+				const float ny{ normal.y[lane] };
+				const float nz{ normal.z[lane] };
+				const float length{ std::sqrt(nx * nx + ny * ny + nz * nz) };
+
+				observedArea[lane] = std::max((nx * toLight.x + ny * toLight.y + nz * toLight.z) / length, 0.0f);
+			}
+
+			//Phong lobe, the evaluator takes the SIMD path in the fast approximation mode
+			Lanes phong{};
+			if (needsSpecular)
+			{
+				//The light is reflected around the normal as it came out of the normal map, like Shade does
+				Lanes reflectedViewDot{};
+				for (int lane{}; lane < BatchSize; ++lane)
+				{
+					const float nx{ normal.x[lane] };
+					const float ny{ normal.y[lane] };
+					const float nz{ normal.z[lane] };
+
+					const float lightNormalDot{ -(directionLight.x * nx + directionLight.y * ny + directionLight.z * nz) };
+					const float rx{ -directionLight.x - 2.f * lightNormalDot * nx };
+					const float ry{ -directionLight.y - 2.f * lightNormalDot * ny };
+					const float rz{ -directionLight.z - 2.f * lightNormalDot * nz };
+
+					reflectedViewDot[lane] = std::max(rx * viewDirection.x[lane] + ry * viewDirection.y[lane] + rz * viewDirection.z[lane], 0.0f);
+				}
+
+				pSpecularEvaluator->Evaluate(reflectedViewDot.data(), phongExponent.data(), phong.data(), batch.count);
+			}
+
+			//The switch is outside of the lane loops so every loop stays branch free
+			const float diffuseScale{ lightIntensity / PI };
+			switch (shadeMode)
+			{
+				case ShadeMode::ObservedArea:
+				{
+					colors.r = observedArea;
+					colors.g = observedArea;
+					colors.b = observedArea;
+					break;
+				}
+
+				case ShadeMode::Diffuse:
+				{
+					for (int lane{}; lane < BatchSize; ++lane)
+					{
+						colors.r[lane] = diffuseScale * diffuseSample.x[lane] * observedArea[lane];
+						colors.g[lane] = diffuseScale * diffuseSample.y[lane] * observedArea[lane];
+						colors.b[lane] = diffuseScale * diffuseSample.z[lane] * observedArea[lane];
+					}
+					break;
+				}
+
+				case ShadeMode::Specular:
+				{
+					for (int lane{}; lane < BatchSize; ++lane)
+					{
+						const float specular{ lightIntensity * phong[lane] * observedArea[lane] };
+						colors.r[lane] = specularSample.x[lane] * specular;
+						colors.g[lane] = specularSample.y[lane] * specular;
+						colors.b[lane] = specularSample.z[lane] * specular;
+					}
+					break;
+				}
+
+				case ShadeMode::Combined:
+				{
+					for (int lane{}; lane < BatchSize; ++lane)
+					{
+						colors.r[lane] = (diffuseScale * diffuseSample.x[lane] + specularSample.x[lane] * phong[lane] + ambientLight) * observedArea[lane];
+						colors.g[lane] = (diffuseScale * diffuseSample.y[lane] + specularSample.y[lane] * phong[lane] + ambientLight) * observedArea[lane];
+						colors.b[lane] = (diffuseScale * diffuseSample.z[lane] + specularSample.z[lane] * phong[lane] + ambientLight) * observedArea[lane];
+					}
+					break;
+				}
+			}
+		}
+	};
+}
@@ -1,29 +1,61 @@
 //External includes
+//Visual Leak Detector only exists on Windows
+#ifdef _WIN32
 #include "vld.h"
+#endif
 #include "SDL.h"
 #include "SDL_surface.h"
 #undef main
 
 //Standard includes
 #include <iostream>
+#include <string_view>
 
 //Project includes
 #include "Timer.h"
 #include "Renderer.h"
+#include "BatchRenderer.h"
+#include "MicroBenchmarks.h"
+#include "Trace.h"
 
 using namespace dae;
 
-void ShutDown(SDL_Window* pWindow)
+void ShutDown(SDL_Window* pWindow, SDL_Surface* pBackBuffer)
 {
+	SDL_FreeSurface(pBackBuffer);
 	SDL_DestroyWindow(pWindow);
 	SDL_Quit();
 }
 
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	Tracer::SetThreadName("Main");
+
+	//Batch, benchmark and microbenchmark mode render without a window
+	if (argc > 1 && std::string_view{ args[1] } == "--microbench")
+	{
+		return RunMicroBenchmarks(argc, args);
+	}
+
+	const bool isBatch{ argc > 1 && std::string_view{ args[1] } == "--batch" };
+	const bool isBenchmark{ argc > 1 && std::string_view{ args[1] } == "--benchmark" };
+	if (isBatch || isBenchmark)
+	{
+		BatchSettings settings{};
+		if (isBenchmark)
+		{
+			//A turntable by default, so every run measures the same views
+			settings.frameCount = 200;
+			settings.rotationSpeed = 90.f;
+		}
+
+		if (!ParseBatchSettings(argc, args, settings))
+		{
+			PrintBatchUsage();
+			return 1;
+		}
+		return isBenchmark ? RunBenchmark(settings) : RunBatch(settings);
+	}
 
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
@@ -40,19 +72,33 @@ int main(int argc, char* args[])
 	if (!pWindow)
 		return 1;
 
+	//The renderer draws into the back buffer, which is blitted to the window after every frame
+	SDL_Surface* pFrontBuffer = SDL_GetWindowSurface(pWindow);
+	SDL_Surface* pBackBuffer = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGB888);
+
+	const RenderTarget renderTarget{ static_cast<int>(width), static_cast<int>(height), PixelFormat::XRGB8888, pBackBuffer->pixels, pBackBuffer->pitch };
+
+	//Always record, so T can write the last frames to a trace
+	Tracer::SetEnabled(true);
+
 	//Initialize "framework"
 	const auto pTimer = new Timer();
-	const auto pRenderer = new Renderer(pWindow);
+	const auto pRenderer = new Renderer(renderTarget);
+	if (!pRenderer->IsSceneLoaded())
+	{
+		delete pRenderer;
+		delete pTimer;
+		ShutDown(pWindow, pBackBuffer);
+		return 1;
+	}
 
 	//Start loop
 	pTimer->Start();
 
-	// Start Benchmark
-	// TODO pTimer->StartBenchmark();
-
 	float printTimer = 0.f;
 	bool isLooping = true;
 	bool takeScreenshot = false;
+	bool saveTrace = false;
 	while (isLooping)
 	{
 		//--------- Get input events ---------
@@ -66,10 +112,16 @@ int main(int argc, char* args[])
 				break;
 			case SDL_KEYUP:
 				if (e.key.keysym.scancode == SDL_SCANCODE_X) takeScreenshot = true;
+				if (e.key.keysym.scancode == SDL_SCANCODE_T) saveTrace = true;
+				if (e.key.keysym.scancode == SDL_SCANCODE_F3) pRenderer->ToggleLods();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F4) pRenderer->ToggleDepthBufferDisplay();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F5) pRenderer->ToggleRotation();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F6) pRenderer->ToggleNormalMap();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F7) pRenderer->CycleShadeMode();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F8) pRenderer->CycleSpecularMode();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F9) pRenderer->CycleDepthFormat();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F10) pRenderer->ToggleDeferredTiles();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F11) pRenderer->ToggleMSAA();
 				break;
 			}
 		}
@@ -78,7 +130,12 @@ int main(int argc, char* args[])
 		pRenderer->Update(pTimer);
 
 		//--------- Render ---------
+		SDL_LockSurface(pBackBuffer);
 		pRenderer->Render();
+		SDL_UnlockSurface(pBackBuffer);
+
+		SDL_BlitSurface(pBackBuffer, nullptr, pFrontBuffer, nullptr);
+		SDL_UpdateWindowSurface(pWindow);
 
 		//--------- Timer ---------
 		pTimer->Update();
@@ -98,6 +155,16 @@ int main(int argc, char* args[])
 				std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
 			takeScreenshot = false;
 		}
+
+		//Between frames, so no thread is recording
+		if (saveTrace)
+		{
+			if (Tracer::WriteChromeTrace("Rasterizer_Trace.json"))
+				std::cout << "Trace saved!" << std::endl;
+			else
+				std::cout << "Something went wrong. Trace not saved!" << std::endl;
+			saveTrace = false;
+		}
 	}
 	pTimer->Stop();
 
@@ -105,6 +172,6 @@ int main(int argc, char* args[])
 	delete pRenderer;
 	delete pTimer;
 
-	ShutDown(pWindow);
+	ShutDown(pWindow, pBackBuffer);
 	return 0;
 }
\ No newline at end of file
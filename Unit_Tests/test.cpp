@@ -1,12 +1,714 @@
 #include "gtest/gtest.h"
+#include "AssetManager.h"
+#include "DepthFormat.h"
+#include "Frustum.h"
+#include "Instancing.h"
 #include "Maths.h"
+#include "MeshCache.h"
+#include "Meshlet.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "SceneBVH.h"
+#include "Shader.h"
+#include "Specular.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
 
 
 namespace dae
 {
+	namespace
+	{
+		struct PositionVaryings
+		{
+			float depth{};
+		};
+
+		struct ProjectingVertexShader
+		{
+			using Varyings = PositionVaryings;
+			Vector4 Transform(const DrawConstants& constants, const Vertex& vertex, Varyings&) const { return constants.worldViewProjectionMatrix.TransformPoint({ vertex.position, 1.f }); }
+		};
+
+		//Moves the vertices by the instance parameters, so the bounds of the mesh do not hold for it
+		struct DisplacingVertexShader
+		{
+			using Varyings = PositionVaryings;
+			static constexpr bool m_UsesWorldViewProjection{ false };
+			Vector4 Transform(const DrawConstants& constants, const Vertex& vertex, Varyings&) const { return constants.worldViewProjectionMatrix.TransformPoint({ vertex.position + constants.instanceParameters.GetXYZ(), 1.f }); }
+		};
+
+		//The vertices are already in clip space
+		struct ClipSpaceVertexShader
+		{
+			using Varyings = PositionVaryings;
+			static constexpr bool m_UsesWorldViewProjection{ false };
+			Vector4 Transform(const DrawConstants&, const Vertex& vertex, Varyings&) const { return { vertex.position, 1.f }; }
+		};
+
+		struct WhitePixelShader
+		{
+			ColorRGB Shade(const PositionVaryings&) const { return { 1.f, 1.f, 1.f }; }
+		};
+
+		//Binary, so line endings are written as they are
+		std::string WriteTempFile(const std::string& name, const std::string& text)
+		{
+			const std::filesystem::path path{ std::filesystem::temp_directory_path() / name };
+			std::ofstream{ path, std::ios::binary } << text;
+			return path.string();
+		}
+
+		//A quad grid over the same square whatever its size, with its meshlets
+		IndexedMesh CreateGridMesh(uint32_t gridSize, float simplificationError)
+		{
+			IndexedMesh mesh{};
+			for (uint32_t z{}; z <= gridSize; ++z)
+			{
+				for (uint32_t x{}; x <= gridSize; ++x)
+				{
+					const Vector2 uv{ static_cast<float>(x) / gridSize, static_cast<float>(z) / gridSize };
+					mesh.vertices.push_back({ { uv.x * 16.f, uv.x * uv.y, uv.y * 16.f }, uv, { 0.f, 1.f, 0.f }, { 1.f, 0.f, 0.f } });
+				}
+			}
+			for (uint32_t z{}; z < gridSize; ++z)
+			{
+				for (uint32_t x{}; x < gridSize; ++x)
+				{
+					const uint32_t corner{ z * (gridSize + 1) + x };
+					mesh.indices.insert(mesh.indices.end(), { corner, corner + gridSize + 1, corner + 1, corner + 1, corner + gridSize + 1, corner + gridSize + 2 });
+				}
+			}
+			mesh.meshlets = BuildMeshlets(mesh.vertices, mesh.indices);
+			mesh.bounds = { { 0.f, 0.f, 0.f }, { 16.f, 1.f, 16.f } };
+			mesh.simplificationError = simplificationError;
+			return mesh;
+		}
+
+		void ExpectSameLevel(const IndexedMesh& level, const IndexedMesh& expected)
+		{
+			ASSERT_EQ(level.vertices.size(), expected.vertices.size());
+			EXPECT_EQ(std::memcmp(level.vertices.data(), expected.vertices.data(), expected.vertices.size() * sizeof(Vertex)), 0);
+			EXPECT_EQ(level.indices, expected.indices);
+			ASSERT_EQ(level.meshlets.size(), expected.meshlets.size());
+			EXPECT_EQ(std::memcmp(level.meshlets.data(), expected.meshlets.data(), expected.meshlets.size() * sizeof(Meshlet)), 0);
+			EXPECT_EQ(level.simplificationError, expected.simplificationError);
+		}
+
+		//Two of everything, the lines of the scene tests are added after it
+		const std::string m_SceneHeader
+		{
+			"# A comment line\n"
+			"camera 1 2 -30 45\n"
+			"light 0 -1 0 3 # a trailing comment\n"
+			"texture diffuse diffuse.png\n"
+			"texture normal normal.png\n"
+			"material painted diffuse normal diffuse normal\n"
+			"material plain diffuse diffuse diffuse diffuse\n"
+			"mesh box box.obj\n"
+			"mesh ball ball.obj\n"
+		};
+
+		const std::string m_TriangleObj
+		{
+			"v 0 0 0\n"
+			"v 1 0 0\n"
+			"v 0 1 0\n"
+			"vt 0.25 0.5\n"
+			"vt 0.75 1\n"
+			"vn 0 0 1\n"
+			"vn 0 1 0\n"
+			"f 1 2 3\n"
+			"f 1/1 2/2 3/1\n"
+			"f 1//1 2//2 3//1\n"
+			"f 1/2/2 2/1/1 3/2/2\n"
+			"f 1/1/2 2 3\n"
+		};
+	}
+
 	TEST(TestCaseName, TestName) {
 		EXPECT_EQ(Vector3::Cross(Vector3::UnitX, Vector3::UnitY), Vector3::UnitZ);
 		EXPECT_TRUE(true);
 	}
 
+	TEST(Matrix, InverseOfRotationAndTranslation) {
+		//A determinant below one must not count as zero
+		EXPECT_FALSE(AreEqual(0.5f, 0.f));
+
+		const Matrix matrix{ Matrix::CreateRotation(0.3f, 0.2f, 0.1f) * Matrix::CreateTranslation(1.f, 2.f, 3.f) };
+		const Vector3 point{ 4.f, 5.f, 6.f };
+		const Vector3 roundTrip{ Matrix::Inverse(matrix).TransformPoint(matrix.TransformPoint(point)) };
+		EXPECT_NEAR(roundTrip.x, point.x, 1e-5f);
+		EXPECT_NEAR(roundTrip.y, point.y, 1e-5f);
+		EXPECT_NEAR(roundTrip.z, point.z, 1e-5f);
+	}
+
+	TEST(Specular, FastPowErrorIsBounded) {
+		const SpecularEvaluator evaluator{ 25.f };
+		const SpecularEvaluator::ErrorReport report{ evaluator.MeasureError(SpecularMode::FastApproximation) };
+		EXPECT_LT(report.maxAbsoluteError, 3e-4f);
+
+		EXPECT_EQ(FastPow(0.f, 0.f), 1.f);
+		EXPECT_EQ(FastPow(0.f, 10.f), 0.f);
+	}
+
+	TEST(AssetManager, ThreadsShareOneLoadOfTheSameBytes) {
+		//Two paths to the same bytes, the second one only shares the asset through the hash of the file
+		const std::filesystem::path directory{ std::filesystem::temp_directory_path() / "AssetManagerTest" };
+		std::filesystem::create_directories(directory);
+		const std::array<std::string, 2> paths{ (directory / "a.obj").string(), (directory / "b.obj").string() };
+		for (const std::string& path : paths)
+		{
+			std::ofstream{ path } << "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nvn 0 0 1\nf 1/1/1 2/1/1 3/1/1\n";
+		}
+
+		AssetManager assetManager{};
+		ThreadPool threadPool{ 4 };
+		std::vector<std::shared_ptr<const Mesh>> meshes(16);
+		for (int round{}; round < 2; ++round)
+		{
+			threadPool.ParallelFor(static_cast<int>(meshes.size()), [&](int index, uint32_t)
+			{
+				meshes[index] = assetManager.LoadMesh(paths[index % paths.size()]);
+			});
+
+			ASSERT_NE(meshes.front(), nullptr);
+			for (const std::shared_ptr<const Mesh>& pMesh : meshes)
+			{
+				EXPECT_EQ(pMesh, meshes.front());
+			}
+			EXPECT_EQ(assetManager.GetResidentAssets().size(), 1u);
+
+			//Freed with its last handle, the next round loads it again
+			std::fill(meshes.begin(), meshes.end(), nullptr);
+			EXPECT_TRUE(assetManager.GetResidentAssets().empty());
+		}
+
+		std::error_code error{};
+		std::filesystem::remove_all(directory, error);
+	}
+
+	TEST(MeshCache, ReadsBackWhatWasWritten) {
+		IndexedMesh mesh{ CreateGridMesh(16, 0.f) };
+		mesh.lods.push_back(CreateGridMesh(8, .5f));
+		mesh.lods.push_back(CreateGridMesh(4, 2.f));
+
+		const std::string path{ (std::filesystem::temp_directory_path() / "roundtrip.meshcache").string() };
+		ASSERT_TRUE(WriteMeshCache(path, mesh, 0x1234, true));
+
+		IndexedMesh read{};
+		ASSERT_TRUE(ReadMeshCache(path, read, 0x1234, true));
+		ExpectSameLevel(read, mesh);
+		EXPECT_EQ(read.bounds.min, mesh.bounds.min);
+		EXPECT_EQ(read.bounds.max, mesh.bounds.max);
+		ASSERT_EQ(read.lods.size(), mesh.lods.size());
+		for (size_t lodIdx{}; lodIdx < mesh.lods.size(); ++lodIdx)
+		{
+			ExpectSameLevel(read.lods[lodIdx], mesh.lods[lodIdx]);
+			EXPECT_TRUE(read.lods[lodIdx].lods.empty());
+		}
+		std::filesystem::remove(path);
+	}
+
+	TEST(MeshCache, RejectsOtherSourcesAndTruncatedFiles) {
+		IndexedMesh mesh{ CreateGridMesh(16, 0.f) };
+		mesh.lods.push_back(CreateGridMesh(8, .5f));
+
+		const std::string path{ (std::filesystem::temp_directory_path() / "rejected.meshcache").string() };
+		ASSERT_TRUE(WriteMeshCache(path, mesh, 0x1234, true));
+
+		//A failed read leaves the mesh alone
+		IndexedMesh read{};
+		EXPECT_FALSE(ReadMeshCache(path, read, 0x1235, true));
+		EXPECT_FALSE(ReadMeshCache(path, read, 0x1234, false));
+		EXPECT_TRUE(read.vertices.empty());
+
+		std::string bytes(std::filesystem::file_size(path), '\0');
+		std::ifstream{ path, std::ios::binary }.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+
+		//Inside the header, inside the level table, inside the streams of the full mesh and one byte short of the last meshlet
+		for (const size_t size : { size_t{}, size_t{ 16 }, size_t{ 100 }, bytes.size() / 2, bytes.size() - 1 })
+		{
+			EXPECT_FALSE(ReadMeshCache(WriteTempFile("truncated.meshcache", bytes.substr(0, size)), read, 0x1234, true)) << size << " bytes";
+			EXPECT_TRUE(read.vertices.empty());
+		}
+
+		std::filesystem::remove(path);
+		std::filesystem::remove(std::filesystem::temp_directory_path() / "truncated.meshcache");
+	}
+
+	TEST(ParseScene, ReadsAValidFile) {
+		const std::string path{ WriteTempFile("valid.scene", m_SceneHeader +
+			"\n"
+			"object box painted 1 2 3\n"
+			"object ball plain 0 0 0 0 90 0\n"
+			"object ball painted 4 5 6 0 0 0 2\n") };
+
+		SceneDescription scene{};
+		ASSERT_TRUE(ParseScene(path, scene));
+		EXPECT_EQ(scene.cameraOrigin, (Vector3{ 1.f, 2.f, -30.f }));
+		EXPECT_FLOAT_EQ(scene.cameraFovAngle, 45.f);
+		EXPECT_EQ(scene.lightDirection, (Vector3{ 0.f, -1.f, 0.f }));
+		EXPECT_FLOAT_EQ(scene.lightIntensity, 3.f);
+
+		ASSERT_EQ(scene.textures.size(), 2u);
+		EXPECT_EQ(scene.textures[1].name, "normal");
+		EXPECT_EQ(scene.textures[1].path, "normal.png");
+		ASSERT_EQ(scene.materials.size(), 2u);
+		EXPECT_EQ(scene.materials[0].diffuse, 0u);
+		EXPECT_EQ(scene.materials[0].normal, 1u);
+		ASSERT_EQ(scene.meshes.size(), 2u);
+		EXPECT_EQ(scene.meshes[1].path, "ball.obj");
+
+		ASSERT_EQ(scene.objects.size(), 3u);
+		EXPECT_EQ(scene.objects[0].mesh, 0u);
+		EXPECT_EQ(scene.objects[0].material, 0u);
+		EXPECT_EQ(scene.objects[0].worldMatrix.GetTranslation(), (Vector3{ 1.f, 2.f, 3.f }));
+		EXPECT_EQ(scene.objects[1].mesh, 1u);
+		EXPECT_EQ(scene.objects[1].material, 1u);
+		//Yawed a quarter turn, the x axis no longer points along x
+		EXPECT_NEAR(scene.objects[1].worldMatrix.TransformVector({ 1.f, 0.f, 0.f }).x, 0.f, 1e-5f);
+		EXPECT_EQ(scene.objects[2].worldMatrix.GetTranslation(), (Vector3{ 4.f, 5.f, 6.f }));
+		EXPECT_FLOAT_EQ(scene.objects[2].worldMatrix.TransformVector({ 1.f, 0.f, 0.f }).Magnitude(), 2.f);
+	}
+
+	TEST(ParseScene, RejectsMalformedLines) {
+		const std::array<std::string, 18> lines
+		{
+			//The rotation has all three angles and the scale needs it
+			"object box painted 0 0 0 10",
+			"object box painted 0 0 0 10 20",
+			"object box painted 0 0 0 10 20 30 2 5",
+			//A word where a number should be, a stream read of it used to end the line and pass
+			"object box painted 0 0 0 oops",
+			"object box painted 0 0 0 10 20 30 oops",
+			//Numbers that only start like one
+			"object box painted 0 0 0 1.0x 20 30",
+			"object box painted 0 0 0 10 20 30 2x",
+			"object box painted 1.0x 0 0",
+			"camera 0 0 -30 1.0x",
+			"light 0 -1 0",
+			//Names that were never declared
+			"material broken diffuse normal missing normal",
+			"object cube painted 0 0 0",
+			"object box rusty 0 0 0",
+			//Names that were declared already
+			"texture diffuse other.png",
+			"material painted diffuse diffuse diffuse diffuse",
+			"mesh box other.obj",
+			"unknown 1 2 3",
+			"object box",
+		};
+
+		for (const std::string& line : lines)
+		{
+			SceneDescription scene{};
+			EXPECT_FALSE(ParseScene(WriteTempFile("invalid.scene", m_SceneHeader + line + "\n"), scene)) << line;
+		}
+
+		SceneDescription scene{};
+		EXPECT_FALSE(ParseScene((std::filesystem::temp_directory_path() / "missing.scene").string(), scene));
+	}
+
+	TEST(ParseOBJ, ReadsEveryCornerFormat) {
+		std::vector<Vertex> vertices{};
+		ASSERT_TRUE(Utils::ParseOBJ(WriteTempFile("corners.obj", m_TriangleObj), vertices, false));
+		ASSERT_EQ(vertices.size(), 15u);
+
+		const std::array<Vector3, 3> positions{ Vector3{ 0.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f } };
+		//V is flipped
+		const std::array<Vector2, 3> uvs{ Vector2{}, Vector2{ .25f, .5f }, Vector2{ .75f, 0.f } };
+		const std::array<Vector3, 3> normals{ Vector3{}, Vector3{ 0.f, 0.f, 1.f }, Vector3{ 0.f, 1.f, 0.f } };
+
+		//Indices into uvs and normals per corner, 0 for none
+		//The corners of the last face without uv and normal keep the ones of the first corner, like the stream parser did
+		const std::array<std::array<int, 3>, 5> expectedUVs{ { { 0, 0, 0 }, { 1, 2, 1 }, { 0, 0, 0 }, { 2, 1, 2 }, { 1, 1, 1 } } };
+		const std::array<std::array<int, 3>, 5> expectedNormals{ { { 0, 0, 0 }, { 0, 0, 0 }, { 1, 2, 1 }, { 2, 1, 2 }, { 2, 2, 2 } } };
+		for (size_t face{}; face < 5; ++face)
+		{
+			for (size_t corner{}; corner < 3; ++corner)
+			{
+				const Vertex& vertex{ vertices[face * 3 + corner] };
+				EXPECT_EQ(vertex.position, positions[corner]) << "face " << face << ", corner " << corner;
+				EXPECT_EQ(vertex.uv, uvs[expectedUVs[face][corner]]) << "face " << face << ", corner " << corner;
+				EXPECT_EQ(vertex.normal, normals[expectedNormals[face][corner]]) << "face " << face << ", corner " << corner;
+			}
+		}
+	}
+
+	TEST(ParseOBJ, CRLFLineEndingsGiveTheSameVertices) {
+		std::string crlfObj{};
+		for (const char character : m_TriangleObj)
+		{
+			if (character == '\n') crlfObj += '\r';
+			crlfObj += character;
+		}
+
+		std::vector<Vertex> lfVertices{};
+		std::vector<Vertex> crlfVertices{};
+		ASSERT_TRUE(Utils::ParseOBJ(WriteTempFile("lf.obj", m_TriangleObj), lfVertices));
+		ASSERT_TRUE(Utils::ParseOBJ(WriteTempFile("crlf.obj", crlfObj), crlfVertices));
+		ASSERT_EQ(crlfVertices.size(), lfVertices.size());
+		EXPECT_EQ(std::memcmp(crlfVertices.data(), lfVertices.data(), lfVertices.size() * sizeof(Vertex)), 0);
+	}
+
+	TEST(ParseOBJ, RejectsIndicesOutOfRange) {
+		const std::string positions{ "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nvn 0 0 1\n" };
+		for (const std::string face : { "f 1 2 4\n", "f 0 1 2\n", "f 1/2 2 3\n", "f 1//2 2 3\n", "f 1/1/1 2/1/1 3/1/2\n" })
+		{
+			std::vector<Vertex> vertices{};
+			EXPECT_FALSE(Utils::ParseOBJ(WriteTempFile("range.obj", positions + face), vertices)) << face;
+			EXPECT_TRUE(vertices.empty()) << face;
+		}
+	}
+
+	TEST(ParseOBJ, ChunksOnTheThreadPoolMatchOneChunk) {
+		//A grid of quads, faces in the later chunks use the positions of the first ones
+		constexpr int size{ 32 };
+		std::string obj{};
+		for (int y{}; y <= size; ++y)
+		{
+			for (int x{}; x <= size; ++x)
+			{
+				obj += "v " + std::to_string(x) + " " + std::to_string(y) + " " + std::to_string((x * y) % 7) + "\n";
+				obj += "vt " + std::to_string(x / static_cast<float>(size)) + " " + std::to_string(y / static_cast<float>(size)) + "\n";
+				obj += "vn 0 0 1\n";
+			}
+		}
+		for (int y{}; y < size; ++y)
+		{
+			for (int x{}; x < size; ++x)
+			{
+				const std::string i0{ std::to_string(x + y * (size + 1) + 1) };
+				const std::string i1{ std::to_string(x + 1 + y * (size + 1) + 1) };
+				const std::string i2{ std::to_string(x + (y + 1) * (size + 1) + 1) };
+				const std::string i3{ std::to_string(x + 1 + (y + 1) * (size + 1) + 1) };
+				obj += "f " + i0 + "/" + i0 + "/" + i0 + " " + i1 + "/" + i1 + "/" + i1 + " " + i2 + "/" + i2 + "/" + i2 + "\n";
+				obj += "f " + i1 + "/" + i1 + " " + i3 + "/" + i3 + " " + i2 + "//" + i2 + "\n";
+			}
+		}
+		const std::string path{ WriteTempFile("grid.obj", obj) };
+
+		std::vector<Vertex> oneChunk{};
+		ASSERT_TRUE(Utils::ParseOBJ(path, oneChunk));
+		ASSERT_EQ(oneChunk.size(), static_cast<size_t>(size * size * 6));
+
+		//At most four chunks per thread, so a small minimum splits the file into 16
+		ThreadPool threadPool{ 4 };
+		std::vector<Vertex> chunked{};
+		ASSERT_TRUE(Utils::ParseOBJ(path, chunked, true, &threadPool, obj.size() / 64));
+		ASSERT_EQ(chunked.size(), oneChunk.size());
+		EXPECT_EQ(std::memcmp(chunked.data(), oneChunk.data(), oneChunk.size() * sizeof(Vertex)), 0);
+
+		//Still every index is checked against the whole file
+		std::vector<Vertex> vertices{};
+		EXPECT_FALSE(Utils::ParseOBJ(WriteTempFile("grid_range.obj", obj + "f 1 2 9999\n"), vertices, true, &threadPool, obj.size() / 64));
+	}
+
+	TEST(DepthFormat, EncodingKeepsDepthOrder) {
+		using Unorm16 = DepthTraits<DepthFormat::Unorm16>;
+		EXPECT_EQ(Unorm16::Encode(1.f), Unorm16::clearValue);
+		EXPECT_TRUE(Unorm16::Passes(Unorm16::Encode(0.5f), Unorm16::Encode(0.6f)));
+
+		using Unorm24 = DepthTraits<DepthFormat::Unorm24>;
+		EXPECT_EQ(Unorm24::Encode(1.f), Unorm24::clearValue);
+		EXPECT_FALSE(Unorm24::Passes(Unorm24::Encode(0.9f), Unorm24::Encode(0.8f)));
+
+		//Reversed depth is bigger when closer
+		using Reversed = DepthTraits<DepthFormat::ReversedFloat32>;
+		EXPECT_TRUE(Reversed::Passes(Reversed::Encode(0.5f), Reversed::clearValue));
+		EXPECT_FALSE(Reversed::Passes(Reversed::Encode(0.1f), Reversed::Encode(0.2f)));
+	}
+
+	TEST(MeshOptimizer, KeepsTheSurfaceAndRemovesDegenerates) {
+		//A grid of quads in a shuffled order, plus a triangle without area
+		constexpr uint32_t gridSize{ 16 };
+		std::vector<Vertex> vertices{};
+		for (uint32_t y{}; y <= gridSize; ++y)
+		{
+			for (uint32_t x{}; x <= gridSize; ++x)
+			{
+				vertices.push_back(Vertex{ .position{ static_cast<float>(x), static_cast<float>(y), 0.f } });
+			}
+		}
+
+		std::vector<uint32_t> indices{};
+		for (uint32_t quad{}; quad < gridSize * gridSize; ++quad)
+		{
+			const uint32_t shuffled{ quad * 37 % (gridSize * gridSize) };
+			const uint32_t corner{ shuffled / gridSize * (gridSize + 1) + shuffled % gridSize };
+			indices.insert(indices.end(), { corner, corner + gridSize + 1, corner + 1, corner + 1, corner + gridSize + 1, corner + gridSize + 2 });
+		}
+		indices.insert(indices.end(), { 0, 1, 2 });
+
+		//Triangles as their sorted positions, the optimizer may rotate them
+		const auto getTriangles = [](const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+		{
+			std::vector<std::array<float, 6>> triangles{};
+			for (size_t index{}; index < indices.size(); index += 3)
+			{
+				std::array<std::pair<float, float>, 3> corners{};
+				for (size_t corner{}; corner < 3; ++corner) corners[corner] = { vertices[indices[index + corner]].position.x, vertices[indices[index + corner]].position.y };
+				std::ranges::sort(corners);
+				triangles.push_back({ corners[0].first, corners[0].second, corners[1].first, corners[1].second, corners[2].first, corners[2].second });
+			}
+			std::ranges::sort(triangles);
+			return triangles;
+		};
+		const std::vector<std::array<float, 6>> expectedTriangles{ getTriangles(vertices, std::vector<uint32_t>(indices.begin(), indices.end() - 3)) };
+
+		const MeshOptimizationReport report{ OptimizeMesh(vertices, indices) };
+		EXPECT_EQ(report.degenerateTriangles, 1u);
+		EXPECT_EQ(getTriangles(vertices, indices), expectedTriangles);
+		EXPECT_LT(report.vertexCacheAfter.acmr, report.vertexCacheBefore.acmr);
+
+		//Vertices are in the order of their first use
+		EXPECT_EQ(indices[0], 0u);
+		EXPECT_EQ(*std::ranges::max_element(indices), vertices.size() - 1);
+	}
+
+	TEST(MeshSimplifier, FlatGridLosesTrianglesButNotItsShape) {
+		//A 16 by 16 quad grid in the xz plane, every triangle facing up
+		constexpr uint32_t gridSize{ 16 };
+		std::vector<Vertex> vertices{};
+		for (uint32_t z{}; z <= gridSize; ++z)
+		{
+			for (uint32_t x{}; x <= gridSize; ++x)
+			{
+				vertices.push_back({ { static_cast<float>(x), 0.f, static_cast<float>(z) }, { static_cast<float>(x) / gridSize, static_cast<float>(z) / gridSize }, { 0.f, 1.f, 0.f } });
+			}
+		}
+		std::vector<uint32_t> indices{};
+		for (uint32_t z{}; z < gridSize; ++z)
+		{
+			for (uint32_t x{}; x < gridSize; ++x)
+			{
+				const uint32_t corner{ z * (gridSize + 1) + x };
+				indices.insert(indices.end(), { corner, corner + gridSize + 1, corner + 1, corner + 1, corner + gridSize + 1, corner + gridSize + 2 });
+			}
+		}
+
+		const std::array<uint32_t, 2> targets{ 128, 32 };
+		const std::vector<SimplifiedMesh> lods{ SimplifyMesh(vertices, indices, targets) };
+		ASSERT_EQ(lods.size(), targets.size());
+		for (uint32_t lodIdx{}; lodIdx < lods.size(); ++lodIdx)
+		{
+			//A plane is simplified without error, and the border keeps the grid the same rectangle
+			EXPECT_LE(lods[lodIdx].indices.size() / 3, targets[lodIdx]);
+			EXPECT_NEAR(lods[lodIdx].error, 0.f, 1e-3f);
+			for (const Vertex& vertex : lods[lodIdx].vertices)
+			{
+				EXPECT_NEAR(vertex.position.y, 0.f, 1e-5f);
+				EXPECT_NEAR(vertex.uv.x * gridSize, vertex.position.x, 1e-3f);
+			}
+		}
+	}
+
+	TEST(Frustum, CullsBoundsOutsideOfTheView) {
+		//Looking down +z from the origin with a 90 degree field of view
+		const Frustum frustum{ Frustum::FromMatrix(Matrix::CreatePerspectiveFovLH(1.f, 1.f, 1.f, 100.f)) };
+		const BoundingBox box{ { -1.f, -1.f, -1.f }, { 1.f, 1.f, 1.f } };
+		const BoundingSphere sphere{ {}, std::sqrt(3.f) };
+
+		EXPECT_FALSE(frustum.AreBoundsOutside(box, sphere, Matrix::CreateTranslation(0.f, 0.f, 10.f)));
+		EXPECT_TRUE(frustum.AreBoundsOutside(box, sphere, Matrix::CreateTranslation(0.f, 0.f, -10.f)));
+		EXPECT_TRUE(frustum.AreBoundsOutside(box, sphere, Matrix::CreateTranslation(0.f, 0.f, 200.f)));
+		EXPECT_TRUE(frustum.AreBoundsOutside(box, sphere, Matrix::CreateTranslation(20.f, 0.f, 10.f)));
+
+		//Touching the left plane, x = -z, with a corner
+		EXPECT_FALSE(frustum.AreBoundsOutside(box, sphere, Matrix::CreateTranslation(-11.9f, 0.f, 10.f)));
+		//Scaled up, the box reaches into the view again
+		EXPECT_FALSE(frustum.AreBoundsOutside(box, sphere, Matrix::CreateScale(5.f, 5.f, 5.f) * Matrix::CreateTranslation(-15.f, 0.f, 10.f)));
+	}
+
+	TEST(Instancing, FindsTheSameInstancesAsTheScalarTest) {
+		const Frustum frustum{ Frustum::FromMatrix(Matrix::CreatePerspectiveFovLH(1.f, 1.f, 1.f, 100.f)) };
+		const BoundingSphere sphere{ { 0.5f, 0.f, -0.25f }, 1.5f };
+
+		//Rotated, scaled and mirrored instances on a line that leaves the frustum on both sides, not a multiple of four
+		std::vector<MeshInstance> instances{};
+		for (int instanceIdx{}; instanceIdx < 103; ++instanceIdx)
+		{
+			const float step{ static_cast<float>(instanceIdx) };
+			const Matrix scale{ Matrix::CreateScale(instanceIdx % 3 == 0 ? -1.f : 1.f, 1.f + step * 0.01f, 2.f) };
+			instances.push_back({ scale * Matrix::CreateRotation(step, step * 0.5f, 0.f) * Matrix::CreateTranslation(step - 50.f, 0.f, 20.f + step * 0.5f) });
+		}
+
+		std::vector<uint32_t> visibleInstances{};
+		FindVisibleInstances(frustum, sphere, instances, visibleInstances);
+
+		std::vector<uint32_t> expected{};
+		for (uint32_t instanceIdx{}; instanceIdx < instances.size(); ++instanceIdx)
+		{
+			const Matrix& world{ instances[instanceIdx].worldMatrix };
+			if (!frustum.IsSphereOutside(world.TransformPoint(sphere.center), sphere.radius * Frustum::GetMaxScale(world))) expected.push_back(instanceIdx);
+		}
+		EXPECT_EQ(visibleInstances, expected);
+		EXPECT_LT(visibleInstances.size(), instances.size());
+		EXPECT_FALSE(visibleInstances.empty());
+	}
+
+	TEST(SceneBVH, QueryMatchesTestingEveryObject) {
+		const Frustum frustum{ Frustum::FromMatrix(Matrix::CreatePerspectiveFovLH(1.f, 1.f, 1.f, 100.f)) };
+
+		//A sloped grid of boxes around the frustum, every box is its own object
+		//Offset along x so no box touches a plane exactly, where rounding could decide either way
+		std::vector<BoundingBox> bounds{};
+		for (int x{ -50 }; x <= 50; ++x)
+		{
+			for (int z{ -50 }; z <= 50; ++z)
+			{
+				const Vector3 center{ static_cast<float>(x) * 3.f + 0.37f, static_cast<float>(x + z) * 0.5f, static_cast<float>(z) * 4.f };
+				bounds.push_back({ center - Vector3{ 1.f, 1.f, 1.f }, center + Vector3{ 1.f, 1.f, 1.f } });
+			}
+		}
+
+		SceneBVH bvh{};
+		bvh.Build(bounds);
+
+		const auto expectMatch = [&]()
+		{
+			std::vector<uint32_t> visited{};
+			const uint32_t boxTests{ bvh.Query(frustum, [&visited](uint32_t object) { visited.push_back(object); }) };
+			std::sort(visited.begin(), visited.end());
+
+			std::vector<uint32_t> expected{};
+			for (uint32_t object{}; object < bounds.size(); ++object)
+			{
+				if (!frustum.IsBoxOutside(bounds[object].GetCenter(), bounds[object].GetExtents())) expected.push_back(object);
+			}
+			EXPECT_EQ(visited, expected);
+			return boxTests;
+		};
+		//Most of the grid is outside, whole subtrees of it are rejected with one test
+		EXPECT_LT(expectMatch(), bounds.size() / 4);
+
+		//Move every third object far away, the refit tree has to find them, though with more tests as its boxes grew
+		for (uint32_t object{}; object < bounds.size(); object += 3)
+		{
+			const Vector3 offset{ object % 2 ? Vector3{ 0.f, 0.f, -150.f } : Vector3{ 0.f, 0.f, 60.f } };
+			bounds[object] = { bounds[object].min + offset, bounds[object].max + offset };
+			bvh.UpdateObject(object, bounds[object]);
+		}
+		bvh.Refit();
+		expectMatch();
+	}
+
+	TEST(Renderer, MSAACoversTheSamplesPastTheLastPixel) {
+		constexpr int size{ 32 };
+		std::vector<uint32_t> pixels(size * size);
+		const RenderTarget target{ size, size, PixelFormat::XRGB8888, pixels.data(), size * 4 };
+		Renderer renderer{ target, "" };
+		renderer.SetMSAA(true);
+
+		//The right and bottom edges lie 11/16 past an odd pixel, so samples of the even pixel after them are inside
+		//Quarter and sixteenth pixels are exact in floats, so the test below agrees with the rasterizer on every sample
+		const std::array<Vector2, 3> screenVertices{ Vector2{ 21.75f, 3.5f }, Vector2{ 4.25f, 25.6875f }, Vector2{ 21.75f, 25.6875f } };
+		std::vector<Vertex> vertices{};
+		for (const Vector2& screenVertex : screenVertices)
+		{
+			vertices.push_back({ { 2.f * screenVertex.x / size - 1.f, 1.f - 2.f * screenVertex.y / size, .5f } });
+		}
+		const Mesh mesh{ vertices };
+
+		//The rasterizer takes the vertices as 0, 2, 1
+		const Vector2& v0{ screenVertices[0] };
+		const Vector2& v1{ screenVertices[2] };
+		const Vector2& v2{ screenVertices[1] };
+		const std::array<float, 4> sampleOffsetsX{ -2.f / 16.f, 6.f / 16.f, -6.f / 16.f, 2.f / 16.f };
+		const std::array<float, 4> sampleOffsetsY{ -6.f / 16.f, -2.f / 16.f, 2.f / 16.f, 6.f / 16.f };
+
+		for (const bool isDeferred : { false, true })
+		{
+			renderer.SetDeferredTiles(isDeferred);
+			renderer.BeginFrame();
+			renderer.Draw(mesh, ClipSpaceVertexShader{}, WhitePixelShader{});
+			renderer.EndFrame();
+
+			int coveredSamples{};
+			for (int y{}; y < size; ++y)
+			{
+				for (int x{}; x < size; ++x)
+				{
+					int pixelSamples{};
+					for (int sample{}; sample < 4; ++sample)
+					{
+						const Vector2 pixel{ static_cast<float>(x), static_cast<float>(y) };
+						const Vector2 offset{ sampleOffsetsX[sample], sampleOffsetsY[sample] };
+						const bool isInside{ Vector2::Cross(v1 - v0, pixel - v0) + Vector2::Cross(v1 - v0, offset) > 0.f
+							&& Vector2::Cross(v2 - v1, pixel - v1) + Vector2::Cross(v2 - v1, offset) > 0.f
+							&& Vector2::Cross(v0 - v2, pixel - v2) + Vector2::Cross(v0 - v2, offset) > 0.f };
+						if (isInside) ++pixelSamples;
+					}
+					coveredSamples += pixelSamples;
+
+					//White over the gray clear color, averaged over the samples
+					const int expectedRed{ (pixelSamples * 255 + (4 - pixelSamples) * 100) / 4 };
+					const int red{ static_cast<int>(pixels[x + y * size] >> 16 & 0xFF) };
+					EXPECT_NEAR(red, expectedRed, 1) << "pixel " << x << ", " << y << (isDeferred ? " deferred" : " immediate");
+				}
+			}
+			EXPECT_GT(coveredSamples, 0);
+		}
+	}
+
+	TEST(Renderer, OverdrawRatioIsShadedPerCoveredPixel) {
+		if constexpr (!FrameStats::m_IsEnabled) GTEST_SKIP();
+
+		constexpr int size{ 32 };
+		std::vector<uint32_t> pixels(size * size);
+		const RenderTarget target{ size, size, PixelFormat::XRGB8888, pixels.data(), size * 4 };
+		Renderer renderer{ target, "" };
+
+		//Drawn twice at the same depth, so every covered pixel is shaded twice
+		const Mesh mesh{ { { { .5f, .75f, .5f } }, { { -.75f, -.75f, .5f } }, { { .5f, -.75f, .5f } } } };
+		for (const bool isDeferred : { false, true })
+		{
+			renderer.SetDeferredTiles(isDeferred);
+			renderer.BeginFrame();
+			renderer.Draw(mesh, ClipSpaceVertexShader{}, WhitePixelShader{});
+			renderer.Draw(mesh, ClipSpaceVertexShader{}, WhitePixelShader{});
+			renderer.EndFrame();
+
+			const uint64_t whitePixels{ static_cast<uint64_t>(std::ranges::count(pixels, 0x00FFFFFFu)) };
+			const FrameStats& stats{ renderer.GetFrameStats() };
+			EXPECT_GT(whitePixels, 0u);
+			EXPECT_EQ(stats.pixelsCovered, whitePixels);
+			EXPECT_EQ(stats.pixelsShaded, 2 * whitePixels);
+			EXPECT_DOUBLE_EQ(stats.GetOverdrawRatio(), 2.0);
+		}
+	}
+
+	TEST(Shader, VertexShadersOptOutOfTheCullingWithTheirTrait) {
+		static_assert(VertexShader<ProjectingVertexShader> && VertexShader<DisplacingVertexShader>);
+		EXPECT_TRUE(UsesWorldViewProjection<ProjectingVertexShader>);
+		EXPECT_FALSE(UsesWorldViewProjection<DisplacingVertexShader>);
+	}
+
+	TEST(ThreadPool, ParallelForVisitsEveryIndexOnce) {
+		ThreadPool threadPool{ 4 };
+		std::vector<std::atomic<int>> visits(1000);
+
+		threadPool.ParallelFor(static_cast<int>(visits.size()), [&](int index, uint32_t threadIdx)
+		{
+			EXPECT_LT(threadIdx, threadPool.GetThreadCount());
+			++visits[index];
+		});
+
+		for (const std::atomic<int>& visit : visits)
+		{
+			EXPECT_EQ(visit, 1);
+		}
+	}
+
 }